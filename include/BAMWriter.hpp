@@ -0,0 +1,241 @@
+#ifndef BAM_WRITER_HPP
+#define BAM_WRITER_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "SAMWriter.hpp"
+
+/**
+ * Maps the index's full reference names onto the ids of the @SQ lines in
+ * the BAM header.  References left out of the header (filterGenomics) map
+ * to -1, i.e. no reference.
+ **/
+struct BAMRefIds {
+  const std::string* refNamesBase{nullptr};
+  std::vector<int32_t> ids;
+
+  int32_t id(const std::string* refName) const {
+    if (refName == nullptr) { return -1; }
+    return ids[static_cast<size_t>(refName - refNamesBase)];
+  }
+};
+
+// Where the alignment writers put BAM records; see emitSAMRecord below
+struct BAMRecordSink {
+  fmt::MemoryWriter& out;
+  const BAMRefIds& refs;
+};
+
+namespace bam {
+// the longest read name a record can hold (l_read_name is a uint8_t and counts the NUL)
+constexpr size_t maxQNameLength = 254;
+
+template <typename T>
+inline void put(fmt::MemoryWriter& out, T v) {
+  // BAM is little-endian, as is every platform we build on
+  const char* p = reinterpret_cast<const char*>(&v);
+  out.buffer().append(p, p + sizeof(T));
+}
+
+inline void putBytes(fmt::MemoryWriter& out, const char* p, size_t len) {
+  out.buffer().append(p, p + len);
+}
+
+// the UCSC bin of the 0-based, half-open interval [beg, end)
+inline uint16_t reg2bin(int32_t beg, int32_t end) {
+  --end;
+  if (beg >> 14 == end >> 14) return ((1 << 15) - 1) / 7 + (beg >> 14);
+  if (beg >> 17 == end >> 17) return ((1 << 12) - 1) / 7 + (beg >> 17);
+  if (beg >> 20 == end >> 20) return ((1 << 9) - 1) / 7 + (beg >> 20);
+  if (beg >> 23 == end >> 23) return ((1 << 6) - 1) / 7 + (beg >> 23);
+  if (beg >> 26 == end >> 26) return ((1 << 3) - 1) / 7 + (beg >> 26);
+  return 0;
+}
+
+// an integer tag, stored in the narrowest type that holds it
+inline void putIntTag(fmt::MemoryWriter& out, const char tag[2], int64_t v) {
+  putBytes(out, tag, 2);
+  if (v >= 0) {
+    if (v <= std::numeric_limits<uint8_t>::max()) {
+      put(out, 'C'); put(out, static_cast<uint8_t>(v));
+    } else if (v <= std::numeric_limits<uint16_t>::max()) {
+      put(out, 'S'); put(out, static_cast<uint16_t>(v));
+    } else {
+      put(out, 'I'); put(out, static_cast<uint32_t>(v));
+    }
+  } else {
+    if (v >= std::numeric_limits<int8_t>::min()) {
+      put(out, 'c'); put(out, static_cast<int8_t>(v));
+    } else if (v >= std::numeric_limits<int16_t>::min()) {
+      put(out, 's'); put(out, static_cast<int16_t>(v));
+    } else {
+      put(out, 'i'); put(out, static_cast<int32_t>(v));
+    }
+  }
+}
+
+// 4-bit code of a base in "=ACMGRSVTWYHKDBN"; anything unknown is N
+inline uint8_t seqCode(char c) {
+  switch (c) {
+    case '=': return 0;
+    case 'A': case 'a': return 1;
+    case 'C': case 'c': return 2;
+    case 'M': case 'm': return 3;
+    case 'G': case 'g': return 4;
+    case 'R': case 'r': return 5;
+    case 'S': case 's': return 6;
+    case 'V': case 'v': return 7;
+    case 'T': case 't': return 8;
+    case 'W': case 'w': return 9;
+    case 'Y': case 'y': return 10;
+    case 'H': case 'h': return 11;
+    case 'K': case 'k': return 12;
+    case 'D': case 'd': return 13;
+    case 'B': case 'b': return 14;
+    default: return 15;
+  }
+}
+
+inline int cigarOpCode(char c) {
+  switch (c) {
+    case 'M': return 0;
+    case 'I': return 1;
+    case 'D': return 2;
+    case 'N': return 3;
+    case 'S': return 4;
+    case 'H': return 5;
+    case 'P': return 6;
+    case '=': return 7;
+    case 'X': return 8;
+    default: return -1;
+  }
+}
+} // namespace bam
+
+/**
+ * Encode the reference dictionary and header text into `hd` as the start of
+ * a BAM file, and record which header id each of the index's references got.
+ **/
+template <typename IndexT>
+inline void encodeBAMHeader(IndexT& pfi, fmt::MemoryWriter& hd,
+        bool filterGenomics,
+        const phmap::flat_hash_set<std::string>& gene_names,
+        const phmap::flat_hash_set<std::string>& rrna_names,
+        BAMRefIds& refIds) {
+  fmt::MemoryWriter text;
+  formatSAMHeader(pfi, text, filterGenomics, gene_names, rrna_names);
+
+  auto& txpNames = pfi.getFullRefNames();
+  auto& txpLens = pfi.getFullRefLengths();
+  refIds.refNamesBase = txpNames.data();
+  refIds.ids.assign(txpNames.size(), -1);
+
+  int32_t numRef{0};
+  for (size_t i = 0; i < txpNames.size(); ++i) {
+    if (filterGenomics and
+    (gene_names.find(txpNames[i]) != gene_names.end() or rrna_names.find(txpNames[i]) != rrna_names.end()))
+      continue;
+    refIds.ids[i] = numRef++;
+  }
+
+  bam::putBytes(hd, "BAM\1", 4);
+  bam::put(hd, static_cast<int32_t>(text.size()));
+  bam::putBytes(hd, text.data(), text.size());
+  bam::put(hd, numRef);
+  for (size_t i = 0; i < txpNames.size(); ++i) {
+    if (refIds.ids[i] < 0) { continue; }
+    bam::put(hd, static_cast<int32_t>(txpNames[i].size() + 1));
+    bam::putBytes(hd, txpNames[i].c_str(), txpNames[i].size() + 1);
+    bam::put(hd, static_cast<int32_t>(txpLens[i]));
+  }
+}
+
+// The BAM encoding of a record the alignment writers in SAMWriter.hpp produce
+inline void emitSAMRecord(BAMRecordSink& sink, const SAMRecord& rec) {
+  auto& out = sink.out;
+  size_t start = out.size();
+  bam::put(out, int32_t{0}); // block_size, filled in below
+
+  // the CIGAR ops, and how much of the reference they span
+  uint32_t numOps{0};
+  int32_t refSpan{0};
+  auto cigarLen = rec.cigar.size();
+  if (!(cigarLen == 1 and rec.cigar.data()[0] == '*')) {
+    uint32_t len{0};
+    for (size_t j = 0; j < cigarLen; ++j) {
+      char c = rec.cigar.data()[j];
+      if (c >= '0' and c <= '9') {
+        len = len * 10 + static_cast<uint32_t>(c - '0');
+        continue;
+      }
+      int op = bam::cigarOpCode(c);
+      if (op < 0) {
+        std::cerr << "invalid CIGAR operation '" << c << "' for read "
+                  << std::string(rec.qname.data(), rec.qname.size()) << "\n";
+        std::exit(1);
+      }
+      // M, D, N, = and X consume the reference
+      if (op == 0 or op == 2 or op == 3 or op == 7 or op == 8) { refSpan += static_cast<int32_t>(len); }
+      ++numOps;
+      len = 0;
+    }
+  }
+
+  int32_t refId = sink.refs.id(rec.refName);
+  int32_t mateRefId = rec.mateOnSameRef ? refId : -1;
+  int32_t end = rec.pos + (refSpan > 0 ? refSpan : 1);
+  uint16_t bin = rec.pos < 0 ? 4680 : bam::reg2bin(rec.pos, end);
+  uint32_t seqLen = static_cast<uint32_t>(rec.seq->size());
+  // longer names are cut, the same way for both mates
+  size_t qnameLen = std::min(rec.qname.size(), bam::maxQNameLength);
+
+  bam::put(out, refId);
+  bam::put(out, rec.pos);
+  bam::put(out, static_cast<uint8_t>(qnameLen + 1));
+  bam::put(out, rec.mapq);
+  bam::put(out, bin);
+  bam::put(out, static_cast<uint16_t>(numOps));
+  bam::put(out, rec.flag);
+  bam::put(out, seqLen);
+  bam::put(out, mateRefId);
+  bam::put(out, rec.matePos);
+  bam::put(out, rec.tlen);
+  bam::putBytes(out, rec.qname.data(), qnameLen);
+  bam::put(out, '\0');
+
+  if (numOps > 0) {
+    uint32_t len{0};
+    for (size_t j = 0; j < cigarLen; ++j) {
+      char c = rec.cigar.data()[j];
+      if (c >= '0' and c <= '9') {
+        len = len * 10 + static_cast<uint32_t>(c - '0');
+        continue;
+      }
+      bam::put(out, (len << 4) | static_cast<uint32_t>(bam::cigarOpCode(c)));
+      len = 0;
+    }
+  }
+
+  const std::string& seq = *rec.seq;
+  for (size_t j = 0; j < seqLen; j += 2) {
+    uint8_t packed = static_cast<uint8_t>(bam::seqCode(seq[j]) << 4);
+    if (j + 1 < seqLen) { packed |= bam::seqCode(seq[j + 1]); }
+    bam::put(out, packed);
+  }
+  // no qualities
+  for (uint32_t j = 0; j < seqLen; ++j) { bam::put(out, static_cast<uint8_t>(0xff)); }
+
+  bam::putIntTag(out, "NH", static_cast<int64_t>(rec.numHits));
+  bam::putIntTag(out, "HI", static_cast<int64_t>(rec.hitIndex));
+  bam::putIntTag(out, "AS", rec.score);
+
+  int32_t blockSize = static_cast<int32_t>(out.size() - start - sizeof(int32_t));
+  std::memcpy(&out.buffer()[start], &blockSize, sizeof(blockSize));
+}
+
+#endif // BAM_WRITER_HPP
@@ -0,0 +1,89 @@
+#ifndef __BGZF_STREAM_HPP__
+#define __BGZF_STREAM_HPP__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+/**
+ * A streambuf that writes BGZF: a series of independent gzip members of at
+ * most 64KB, each holding up to 0xff00 bytes of input (as produced by
+ * htslib).  The result is a valid .gz file and, for BAM content, directly
+ * usable by samtools sort / index.
+ *
+ * Blocks are filled in place and compressed on a pool of `numThreads`
+ * workers; the thread writing into the stream writes the compressed blocks
+ * to `sink` in order, waiting only when all blocks of the ring are in flight.
+ * close() (or destruction) flushes the last block and appends the BGZF EOF
+ * marker.
+ **/
+class BGZFStreamBuf : public std::streambuf {
+public:
+  BGZFStreamBuf(std::streambuf* sink, uint32_t numThreads, int level = -1);
+  ~BGZFStreamBuf() override;
+
+  BGZFStreamBuf(const BGZFStreamBuf&) = delete;
+  BGZFStreamBuf& operator=(const BGZFStreamBuf&) = delete;
+
+  void close();
+
+  // size of the input held by one block
+  static constexpr size_t blockInputSize = 0xff00;
+
+protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+  int sync() override;
+
+private:
+  struct Block {
+    std::vector<char> in;
+    std::vector<char> out;
+    size_t inLen{0};
+    size_t outLen{0};
+    bool done{false};
+  };
+
+  Block& current() { return blocks_[tail_ % blocks_.size()]; }
+  // hand the block being filled to the pool and start on the next one
+  void submitCurrent();
+  // write finished blocks from the head of the ring; with `all`, wait for
+  // every submitted block
+  void writeFinished(bool all);
+  void compressLoop();
+
+  std::streambuf* sink_;
+  int level_;
+  std::vector<Block> blocks_;
+  // blocks [head_, tail_) are submitted and not yet written
+  uint64_t head_{0};
+  uint64_t tail_{0};
+
+  std::mutex mutex_;
+  std::condition_variable jobCV_;
+  std::condition_variable doneCV_;
+  std::deque<Block*> jobs_;
+  bool stopping_{false};
+  bool closed_{false};
+  std::vector<std::thread> workers_;
+};
+
+class BGZFOStream : public std::ostream {
+public:
+  BGZFOStream(std::streambuf* sink, uint32_t numThreads, int level = -1)
+      : std::ostream(nullptr), buf_(sink, numThreads, level) {
+    rdbuf(&buf_);
+  }
+  ~BGZFOStream() override { buf_.close(); }
+  void close() { buf_.close(); }
+
+private:
+  BGZFStreamBuf buf_;
+};
+
+#endif // __BGZF_STREAM_HPP__
@@ -644,6 +644,14 @@ we need this 2-functors scheme because HashFunctors won't work with unordered_ma
 
 		uint64_t bitSize() const {return (_nchar*64ULL + _ranks.capacity()*64ULL );}
 
+		// calls f(pointer, bytes) for the bit array and the rank samples
+		template <typename F>
+		void visitBuffers(F f) const
+		{
+			f(_bitArray, _nchar * sizeof(uint64_t));
+			f(_ranks.data(), _ranks.size() * sizeof(_ranks[0]));
+		}
+
 		//clear whole array
 		void clear()
 		{
@@ -1015,6 +1023,16 @@ we need this 2-functors scheme because HashFunctors won't work with unordered_ma
             return _nelem;
         }
 
+		// calls f(pointer, bytes) for the bit arrays of every level
+		template <typename F>
+		void visitBuffers(F f) const
+		{
+			for(int ii=0; ii<_nb_levels; ii++)
+			{
+				_levels[ii].bitset.visitBuffers(f);
+			}
+		}
+
 		uint64_t totalBitSize()
 		{
 
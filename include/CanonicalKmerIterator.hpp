@@ -37,6 +37,12 @@ public:
         k_(CanonicalKmer::k()) {
     find_next(-1, -1);
   }
+  // iterates over a sequence it doesn't own, e.g. a record in a parser buffer
+  CanonicalKmerIterator(stx::string_view s)
+    : s_(s), p_(), /*km_(), pos_(),*/ invalid_(false), lastinvalid_(-1),
+        k_(CanonicalKmer::k()) {
+    find_next(-1, -1);
+  }
   CanonicalKmerIterator(const CanonicalKmerIterator& o)
     : s_(o.s_), p_(o.p_), /*km_(o.km_), pos_(o.pos_),*/ invalid_(o.invalid_),
         lastinvalid_(o.lastinvalid_), k_(o.k_) {}
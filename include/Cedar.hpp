@@ -88,13 +88,6 @@ struct Stats {
     }
 };
 
-struct ReadInfo {
-    std::string rid;
-    uint32_t cnt = 0;
-    uint32_t len = 0;
-    std::vector<TaxaNode> mappings;
-};
-
 #include "PuffMappingReader.hpp"
 #include "SAMReader.hpp"
 
@@ -43,10 +43,12 @@ struct TGValue {
 
 class EquivalenceClassBuilder {
 public:
-  EquivalenceClassBuilder()//std::shared_ptr<spdlog::logger> loggerIn)
+  // room for expectedClasses classes is reserved up front; builders that
+  // only see part of the reads (one per mapping thread) can ask for less
+  explicit EquivalenceClassBuilder(size_t expectedClasses = 1000000)//std::shared_ptr<spdlog::logger> loggerIn)
       //: logger_(loggerIn) {
   {
-    countMap_.reserve(1000000);
+    countMap_.reserve(expectedClasses);
   }
 
   //~EquivalenceClassBuilder() {}
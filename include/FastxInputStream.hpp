@@ -0,0 +1,85 @@
+#ifndef __FASTX_INPUT_STREAM__
+#define __FASTX_INPUT_STREAM__
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+namespace fastx_parser {
+
+/**
+ * The byte source kseq parses a FASTA/Q file from.
+ *
+ * With numThreads == 0 it is a thin wrapper around gzopen / gzread, as the
+ * parser has always used.  Otherwise decompression moves off the parsing
+ * thread:
+ *
+ *  - BGZF input (gzip members carrying the "BC" extra field, as written by
+ *    bgzip or `pufferfish align -z`) is split at its block boundaries and the
+ *    blocks are inflated by `numThreads` workers, then handed out in order;
+ *  - any other input (ordinary gzip or plain text) is inflated by one
+ *    read-ahead thread into large buffers, so that inflate overlaps parsing.
+ **/
+class InputStream {
+public:
+  InputStream(const std::string& path, uint32_t numThreads);
+  ~InputStream();
+
+  InputStream(const InputStream&) = delete;
+  InputStream& operator=(const InputStream&) = delete;
+
+  bool isOpen() const { return isOpen_; }
+  bool isBGZF() const { return mode_ == Mode::BGZF; }
+
+  // like gzread: the number of bytes copied, 0 at the end of input, -1 on error
+  int read(void* buf, unsigned len);
+
+private:
+  enum class Mode { Direct, ReadAhead, BGZF };
+  enum class SlotState { Free, Filled, Done };
+
+  struct Slot {
+    std::vector<unsigned char> in;
+    std::vector<unsigned char> out;
+    size_t outLen{0};
+    size_t outPos{0};
+    SlotState state{SlotState::Free};
+    // the end of the input (no data), or a read / inflate error
+    bool last{false};
+    bool error{false};
+  };
+
+  // read and inflate ahead of the consumer (ReadAhead), or split BGZF blocks
+  void produce();
+  // inflate BGZF blocks handed over by produce()
+  void inflateLoop();
+  bool readBGZFBlock(Slot& s);
+  static bool looksLikeBGZF(FILE* fp);
+
+  Mode mode_{Mode::Direct};
+  bool isOpen_{false};
+  gzFile gz_{nullptr};
+  FILE* fp_{nullptr};
+
+  std::vector<Slot> slots_;
+  uint64_t readSeq_{0};
+
+  std::mutex mutex_;
+  std::condition_variable slotCV_;
+  std::condition_variable jobCV_;
+  std::deque<Slot*> jobs_;
+  bool stopping_{false};
+  std::thread producer_;
+  std::vector<std::thread> workers_;
+};
+
+} // namespace fastx_parser
+
+#endif // __FASTX_INPUT_STREAM__
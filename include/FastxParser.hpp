@@ -4,9 +4,11 @@
 #include "fcntl.h"
 #include "unistd.h"
 #include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -15,6 +17,7 @@ extern "C" {
 }
 
 #include "concurrentqueue.h"
+#include "string_view.hpp"
 
 #ifndef __FASTX_PARSER_PRECXX14_MAKE_UNIQUE__
 #define __FASTX_PARSER_PRECXX14_MAKE_UNIQUE__
@@ -82,18 +85,43 @@ struct ReadQualPair {
   ReadQual second;
 };
 
+// A record parsed in place (FastxParser<ReadSeqView> / <ReadViewPair>).  The
+// views point into the buffer of the chunk that holds the record, and stay
+// valid until that chunk goes back to the parser (refill / finishedWithGroup).
+struct ReadSeqView {
+  stx::string_view seq;
+  stx::string_view name;
+  // empty for FASTA records
+  stx::string_view qual;
+};
+
+struct ReadViewPair {
+  ReadSeqView first;
+  ReadSeqView second;
+};
+
 template <typename T> class ReadChunk {
 public:
   ReadChunk(size_t want) : group_(want), want_(want), have_(want) {}
+  // ask for `num` records in this chunk, growing it if need be
+  inline void setWant(size_t num) {
+    if (group_.size() < num) { group_.resize(num); }
+    want_ = num;
+    have_ = num;
+  }
   inline void have(size_t num) { have_ = num; }
   inline size_t size() { return have_; }
   inline size_t want() const { return want_; }
   T& operator[](size_t i) { return group_[i]; }
   typename std::vector<T>::iterator begin() { return group_.begin(); }
   typename std::vector<T>::iterator end() { return group_.begin() + have_; }
+  // The bytes the records of an in-place chunk point into (one buffer per
+  // input file); they are recycled along with the chunk.
+  std::vector<char>& buffer(size_t i) { return buffers_[i]; }
 
 private:
   std::vector<T> group_;
+  std::vector<char> buffers_[2];
   size_t want_;
   size_t have_;
 };
@@ -118,13 +146,87 @@ public:
   }
   void setChunkEmpty() { chunk_.release(); }
   bool empty() const { return chunk_.get() == nullptr; }
+  // when the chunk this ReadGroup holds was handed to it
+  std::chrono::steady_clock::time_point& refilledAt() { return refilledAt_; }
 
 private:
   std::unique_ptr<ReadChunk<T>> chunk_{nullptr};
+  std::chrono::steady_clock::time_point refilledAt_;
   moodycamel::ProducerToken pt_;
   moodycamel::ConsumerToken ct_;
 };
 
+// What the queues between the parsing threads and the consumers saw over a
+// run; see FastxParser::stats().
+struct QueueStats {
+  uint64_t chunks{0};
+  uint64_t reads{0};
+  // from start() to stop()
+  double elapsedSec{0};
+  // summed over the parsing threads: waiting for the consumers to hand back
+  // an empty chunk, or to make room in the read queue
+  double parserWaitSec{0};
+  // summed over the consumers: waiting in refill() for a filled chunk
+  double consumerWaitSec{0};
+  // filled chunks waiting in the read queue, as seen at each refill()
+  double meanDepth{0};
+  uint64_t maxDepth{0};
+  // the range the chunk size moved in
+  size_t minChunkSize{0};
+  size_t maxChunkSize{0};
+};
+
+/**
+ * Keeps the statistics behind QueueStats, and picks the number of reads per
+ * chunk: with a range set, the size follows the consumers' time per read so
+ * that a chunk is about `targetChunkTime` of work for a consumer.  Big
+ * enough chunks keep queue traffic negligible; smaller ones bound the memory
+ * held in the pool and get the first (and last) chunks to the consumers sooner.
+ **/
+class QueueMonitor {
+public:
+  using clock = std::chrono::steady_clock;
+  static constexpr std::chrono::milliseconds targetChunkTime{50};
+
+  explicit QueueMonitor(size_t chunkSize);
+
+  void setChunkSizeRange(size_t minSize, size_t maxSize);
+  size_t chunkSize() const { return chunkSize_.load(std::memory_order_relaxed); }
+  size_t maxChunkSize() const { return maxSize_; }
+  // the consumers' recent time per read, in ns (0 before the first chunk is done)
+  double timePerReadNs() const { return timePerRead_.load(std::memory_order_relaxed) / 16.0; }
+
+  void started() { start_ = clock::now(); }
+  void stopped() { stop_ = clock::now(); }
+  void parserWaited(clock::duration d);
+  void consumerWaited(clock::duration d);
+  void chunkFilled(size_t numReads);
+  void sampleDepth(size_t depth);
+  // a consumer is done with a chunk of numReads reads it worked on for d
+  void chunkConsumed(size_t numReads, clock::duration d);
+
+  QueueStats stats() const;
+
+private:
+  std::atomic<size_t> chunkSize_;
+  size_t minSize_;
+  size_t maxSize_;
+  // consumer time per read (in 1/16 ns), a moving average
+  std::atomic<uint64_t> timePerRead_{0};
+  std::atomic<size_t> minSeen_;
+  std::atomic<size_t> maxSeen_;
+
+  std::atomic<uint64_t> chunks_{0};
+  std::atomic<uint64_t> reads_{0};
+  std::atomic<uint64_t> parserWaitNs_{0};
+  std::atomic<uint64_t> consumerWaitNs_{0};
+  std::atomic<uint64_t> depthSum_{0};
+  std::atomic<uint64_t> depthSamples_{0};
+  std::atomic<uint64_t> maxDepth_{0};
+  clock::time_point start_;
+  clock::time_point stop_;
+};
+
 template <typename T> class FastxParser {
 public:
   FastxParser(std::vector<std::string> files, uint32_t numConsumers,
@@ -136,6 +238,16 @@ public:
   ~FastxParser();
   bool start();
   bool stop();
+  // Inflate each input on this many threads (see InputStream); 0, the default,
+  // decompresses on the parsing thread.  Must be called before start().
+  void setDecompressionThreads(uint32_t n) { decompressionThreads_ = n; }
+  // Let the number of reads per chunk adapt between minSize and maxSize
+  // (see QueueMonitor), starting from chunkSize.  Must be called before start().
+  void setChunkSizeRange(size_t minSize, size_t maxSize) { monitor_.setChunkSizeRange(minSize, maxSize); }
+  // queue statistics of the run; complete once stop() has returned
+  QueueStats stats() const { return monitor_.stats(); }
+  // for consumers that split chunks further (see ReadTaskQueue) to report to
+  QueueMonitor& monitor() { return monitor_; }
   ReadGroup<T> getReadGroup();
   bool refill(ReadGroup<T>& rg);
   void finishedWithGroup(ReadGroup<T>& s);
@@ -143,10 +255,13 @@ public:
 private:
   moodycamel::ProducerToken getProducerToken_();
   moodycamel::ConsumerToken getConsumerToken_();
+  // the starting size of an in-place chunk's buffers
+  size_t chunkBufferSize_() const;
 
   std::vector<std::string> inputStreams_;
   std::vector<std::string> inputStreams2_;
   uint32_t numParsers_;
+  uint32_t decompressionThreads_{0};
   std::atomic<uint32_t> numParsing_;
 
   // NOTE: Would like to use std::future<int> here instead, but that
@@ -158,8 +273,11 @@ private:
   // the return value of kseq_read() for the last call to that function.
   // A value < -1 signifies some sort of error.
   std::vector<int> threadResults_;
+  // the message for a thread that stopped on an input it could not open
+  std::vector<std::string> threadErrors_;
 
   size_t blockSize_;
+  QueueMonitor monitor_;
   moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>> readQueue_,
       seqContainerQueue_;
 
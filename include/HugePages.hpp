@@ -0,0 +1,66 @@
+#ifndef __PUFFERFISH_HUGE_PAGES_HPP__
+#define __PUFFERFISH_HUGE_PAGES_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "compact_vector/compact_vector.hpp"
+
+namespace pufferfish {
+namespace hugepages {
+
+constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+/**
+ * Asks the kernel to back the index's randomly accessed arrays with 2MB
+ * transparent huge pages, so that a lookup costs one cache miss rather than
+ * a cache miss plus a page walk.  The arrays are already loaded when they
+ * are advised, so each one is collapsed in place (MADV_COLLAPSE, Linux 6.1+);
+ * on older kernels it is only marked (MADV_HUGEPAGE) and khugepaged
+ * collapses it in the background.  Only the 2MB-aligned interior of each
+ * array can be covered, so arrays smaller than a huge page are skipped.
+ **/
+class Advisor {
+public:
+  struct Summary {
+    // bytes of the arrays passed in
+    size_t requestedBytes{0};
+    // bytes in 2MB-aligned ranges the kernel accepted the advice for
+    size_t advisedBytes{0};
+    // of those, bytes backed by huge pages when the summary was taken
+    size_t hugeBytes{0};
+    // false when we could only mark the ranges and leave them to khugepaged
+    bool collapsed{true};
+  };
+
+  void advise(const void* data, size_t bytes);
+
+  template <typename T>
+  void advise(const std::vector<T>& v) { advise(v.data(), v.size() * sizeof(T)); }
+
+  template <typename IDX, unsigned BITS, typename W, typename A>
+  void advise(const compact::vector<IDX, BITS, W, A>& v) { advise(v.get(), v.bytes()); }
+
+  // anything that can list its arrays, such as the MPHF or rank / select structures
+  template <typename Structure>
+  void adviseBuffers(const Structure& s) {
+    s.visitBuffers([this](const void* data, size_t bytes) { advise(data, bytes); });
+  }
+
+  // Reads the current huge page coverage of the advised ranges from /proc/self/smaps
+  Summary summary() const;
+  std::string describe() const;
+
+private:
+  std::vector<std::pair<uintptr_t, uintptr_t>> ranges_;
+  size_t requestedBytes_{0};
+  bool collapsed_{true};
+};
+
+} // namespace hugepages
+} // namespace pufferfish
+
+#endif // __PUFFERFISH_HUGE_PAGES_HPP__
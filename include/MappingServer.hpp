@@ -0,0 +1,47 @@
+#ifndef __PUFFERFISH_MAPPING_SERVER_HPP__
+#define __PUFFERFISH_MAPPING_SERVER_HPP__
+
+#include <string>
+#include <vector>
+
+/**
+ * The local socket protocol between `pufferfish serve`, which keeps an index
+ * loaded, and `pufferfish align --server`, which hands it a job.
+ *
+ * Every message is a list of strings: a 32-bit count, then each string as a
+ * 32-bit length and its bytes (host byte order; both ends are on the same
+ * machine).  A job is
+ *   [jobMagic, working directory of the client, align arguments...]
+ * and the reply, sent once the job is done, is
+ *   [exit status, everything the job logged].
+ **/
+namespace pufferfish {
+namespace server {
+
+constexpr const char* jobMagic = "pufferfish-job 1";
+
+struct Job {
+  int fd{-1};
+  std::string cwd;
+  std::vector<std::string> args;
+};
+
+// Binds and listens on `path`.  A stale socket file left by a server that
+// is gone is replaced; a live one, or a file that is not a socket, is an
+// error.  Returns -1 with `err` set on failure.
+int listenOn(const std::string& path, std::string& err);
+// Waits for the next client and reads its job; false if the connection did
+// not carry a well-formed job in time (it is closed, and the
+// caller should go on)
+bool acceptJob(int listenFd, Job& job, std::string& err);
+// Sends the outcome of `job` and closes its connection
+bool finishJob(Job& job, int status, const std::string& log);
+
+// The client side: runs `args` on the server at `path`, copies the job's log
+// to std::cerr and returns its exit status (1 if the server can't be reached)
+int runOnServer(const std::string& path, const std::vector<std::string>& args);
+
+} // namespace server
+} // namespace pufferfish
+
+#endif // __PUFFERFISH_MAPPING_SERVER_HPP__
@@ -0,0 +1,84 @@
+#ifndef __MAPPING_WORKSPACE_HPP__
+#define __MAPPING_WORKSPACE_HPP__
+
+#include "MemCollector.hpp"
+#include "ProgOpts.hpp"
+#include "PuffAligner.hpp"
+#include "Util.hpp"
+#include "ksw2pp/KSW2Aligner.hpp"
+
+/**
+ * What one mapping thread keeps from read to read: the MEM collector and
+ * chainer, the ksw2 aligner and the PuffAligner driving it, all set up from
+ * the command line options.  PairedReadMapper, ReadScreener and the
+ * single-end loop of the aligner each own one.
+ **/
+template <typename PufferfishIndexT>
+struct MappingWorkspace {
+  MappingWorkspace(PufferfishIndexT* pfi, const pufferfish::AlignmentOpts* mopts)
+      : MappingWorkspace(pfi, mopts, alignmentConfig(mopts)) {}
+
+  // with an alignment configuration derived from alignmentConfig(mopts)
+  MappingWorkspace(PufferfishIndexT* pfi, const pufferfish::AlignmentOpts* mopts,
+                   const pufferfish::util::AlignmentConfig& config)
+      : memCollector(pfi), aligner(mopts->matchScore, mopts->missMatchScore), aconf(config),
+        puffaligner(pfi->refseq_, pfi->refAccumLengths_, pfi->k(), aconf, aligner) {
+    memCollector.configureMemClusterer(mopts->maxAllowedRefsPerHit);
+    memCollector.setConsensusFraction(mopts->consensusFraction);
+    memCollector.setMaxChainLookback(mopts->maxChainLookback);
+
+    ksw2pp::KSW2Config kswConfig;
+    kswConfig.dropoff = -1;
+    kswConfig.gapo = mopts->gapOpenPenalty;
+    kswConfig.gape = mopts->gapExtendPenalty;
+    kswConfig.bandwidth = 15;
+    kswConfig.flag = 0;
+    kswConfig.flag |= KSW_EZ_RIGHT;
+    kswConfig.flag |= KSW_EZ_SCORE_ONLY;
+    aligner.config() = kswConfig;
+
+    mpol.noDiscordant = mopts->noDiscordant;
+    mpol.noOrphans = mopts->noOrphan;
+    mpol.noDovetail = false; // Add flag for this
+  }
+
+  MappingWorkspace(const MappingWorkspace&) = delete;
+  MappingWorkspace& operator=(const MappingWorkspace&) = delete;
+
+  static pufferfish::util::AlignmentConfig alignmentConfig(const pufferfish::AlignmentOpts* mopts) {
+    pufferfish::util::AlignmentConfig config;
+    config.refExtendLength = mopts->refExtendLength;
+    config.fullAlignment = mopts->fullAlignment;
+    config.matchScore = mopts->matchScore;
+    config.gapExtendPenalty = mopts->gapExtendPenalty;
+    config.gapOpenPenalty = mopts->gapOpenPenalty;
+    config.minScoreFraction = mopts->minScoreFraction;
+    config.mimicBT2 = mopts->mimicBt2Default;
+    config.missMatchScore = mopts->missMatchScore;
+    config.scoreBoundFilter = !mopts->noScoreBoundFilter;
+    config.crossReadCacheSize = mopts->crossReadCacheSize;
+    config.batchAlignment = mopts->batchAlignment;
+    return config;
+  }
+
+  // The counters of these buffers, added once the thread is done with its reads
+  void addStats(pufferfish::util::HitCounters& hctr) {
+    auto& clusterPool = pufferfish::util::MemClusterBufferPool::local();
+    hctr.clusterBufferReuses += clusterPool.hits();
+    hctr.clusterBufferMisses += clusterPool.misses();
+    hctr.chainsReplayed += memCollector.numReplayedChains();
+    auto workspace = aligner.workspaceStats();
+    hctr.ksw2WorkspaceBytes += workspace.capacity;
+    hctr.ksw2WorkspaceGrowths += workspace.numGrowths;
+  }
+
+  MemCollector<PufferfishIndexT> memCollector;
+  ksw2pp::KSW2Aligner aligner;
+  // PuffAligner keeps references to both of these
+  pufferfish::util::AlignmentConfig aconf;
+  PuffAligner puffaligner;
+  pufferfish::util::MappingConstraintPolicy mpol;
+  pufferfish::util::QueryCache qc;
+};
+
+#endif // __MAPPING_WORKSPACE_HPP__
@@ -11,6 +11,7 @@
 #include "CommonTypes.hpp"
 #include "Util.hpp"
 
+#include <array>
 #include <sparsepp/spp.h>
 #include "parallel_hashmap/phmap.h"
 
@@ -18,6 +19,12 @@ class MemClusterer {
 private:
   uint32_t maxAllowedRefsPerHit_ = 1000;
   double consensusFraction_ = 0.65;
+  // maximum number of preceding MEMs considered as chain predecessors
+  uint32_t maxChainLookback_ = 64;
+  // chain scores are fixed point, in units of 1/chainScoreScale bases
+  static constexpr int32_t chainScoreScale = 1024;
+  // number of predecessor candidates scored together in one block
+  static constexpr int32_t chainBlockSize = 8;
   using RefMemMap = pufferfish::util::CachedVectorMap<std::pair<pufferfish::common_types::ReferenceID, bool>, std::vector<pufferfish::util::MemInfo>, pufferfish::util::pair_hash>;
 
 public:
@@ -25,6 +32,8 @@ public:
   void setConsensusFraction(double cf);
   double getConsensusFraction() const;
   void setMaxAllowedRefsPerHit(uint32_t max);
+  void setMaxChainLookback(uint32_t lookback);
+  uint32_t getMaxChainLookback() const;
   uint32_t getMaxAllowedRefsPerHit();
   void setHitFilterPolicy(pufferfish::util::HitFilterPolicy hfp);
   pufferfish::util::HitFilterPolicy getHitFilterPolicy() const;
@@ -46,12 +55,52 @@ public:
                     //pufferfish::common_types::RefMemMapT& trMemMap,
                     bool verbose = false);
 
+  // number of (reference, orientation) pairs whose chains were replayed from
+  // another reference with the same MEM layout rather than recomputed
+  uint64_t numReplayedChains() const { return numReplayedChains_; }
+
 private:
-  chobo::small_vector<double> f;
+  // A set of references whose MEM lists are identical up to a constant
+  // shift in reference position; they are chained once.
+  struct ChainGroup {
+    bool isFw{true};
+    bool hasClusters{false};
+    int32_t bestScore{0};
+    int64_t origin{0};
+    uint32_t layoutStart{0}, layoutEnd{0};
+    uint32_t clustStart{0}, clustEnd{0};
+  };
+  struct ChainGroupCluster {
+    uint32_t memStart{0}, memEnd{0};
+    double coverage{0};
+    bool perfectChain{false};
+  };
+
+  uint64_t layoutSignature(std::vector<pufferfish::util::MemInfo>& memList,
+                           std::vector<pufferfish::util::UniMemInfo>& memCollection,
+                           bool isFw, int64_t origin) const;
+  bool layoutMatches(const ChainGroup& g,
+                     std::vector<pufferfish::util::MemInfo>& memList,
+                     std::vector<pufferfish::util::UniMemInfo>& memCollection,
+                     bool isFw, int64_t origin) const;
+  void compactMemClusters(std::vector<pufferfish::util::MemCluster>& clusters, bool isFw, int32_t signedReadLen);
+
+  chobo::small_vector<int32_t> f;
   chobo::small_vector<int32_t> p;
   chobo::small_vector<uint8_t> keepMem;
   chobo::small_vector<uint64_t> memIndicesInReverse;
   chobo::small_vector<int32_t> bestChainEndList;
+  chobo::small_vector<uint8_t> seen;
+  chobo::small_vector<int32_t> qKey_;
+  chobo::small_vector<int32_t> rKey_;
+  chobo::small_vector<int32_t> mLen_;
+  std::array<int32_t, chainBlockSize> candScore_;
+  phmap::flat_hash_map<uint64_t, int32_t> chainGroupIndex_;
+  std::vector<ChainGroup> chainGroups_;
+  std::vector<std::pair<int64_t, int64_t>> chainGroupLayouts_;
+  std::vector<ChainGroupCluster> chainGroupClusters_;
+  std::vector<pufferfish::util::MemInfo> chainGroupMems_;
+  uint64_t numReplayedChains_{0};
   pufferfish::util::HitFilterPolicy hitFilterPolicy_{pufferfish::util::HitFilterPolicy::FILTER_AFTER_CHAINING};
 };
 
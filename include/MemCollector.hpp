@@ -29,12 +29,12 @@ public:
                           pufferfish::CanonicalKmerIterator& kit,
                           ExpansionTerminationType& et);
 
-  bool operator()(std::string &read,
+  bool operator()(stx::string_view read,
                   pufferfish::util::QueryCache& qc,
                   bool isLeft=false,
                   bool verbose=false);
 
-  bool findChains(std::string &read,
+  bool findChains(stx::string_view read,
                   pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>>& memClusters,
                   //phmap::flat_hash_map<size_t, std::vector<pufferfish::util::MemCluster>>& memClusters,
                   uint32_t maxSpliceGap,
@@ -46,6 +46,10 @@ public:
 
   void configureMemClusterer(uint32_t max);
 
+  void setMaxChainLookback(uint32_t lookback);
+
+  uint64_t numReplayedChains() const;
+
   void setConsensusFraction(double cf);
 
   double getConsensusFraction() const;
@@ -0,0 +1,39 @@
+#ifndef __PUFFERFISH_NUMA_UTILS_HPP__
+#define __PUFFERFISH_NUMA_UTILS_HPP__
+
+#include <cstddef>
+#include <vector>
+
+namespace pufferfish {
+namespace numa {
+
+/**
+ * The NUMA nodes this process may run on, read from
+ * /sys/devices/system/node and restricted to the CPUs in our affinity mask.
+ * Where that information is missing (non-Linux, or no sysfs), all the CPUs
+ * we may use are reported as a single node 0.
+ **/
+struct Topology {
+  std::vector<int> nodeIds;
+  // the CPUs of each node, parallel to nodeIds
+  std::vector<std::vector<int>> nodeCpus;
+
+  size_t numNodes() const { return nodeIds.size(); }
+  static Topology detect();
+};
+
+// Spread the pages the calling thread allocates from now on across all the
+// nodes of `topo`.  Returns false (with errno set) if the kernel refused.
+bool interleaveAllocations(const Topology& topo);
+// Place the pages the calling thread allocates from now on on `nodeId` where
+// possible, falling back to other nodes when it is full.
+bool preferNode(int nodeId);
+// Back to the default policy of allocating on the node that first touches a page.
+bool resetAllocations();
+// Restrict the calling thread to the CPUs of the node at index `node` of `topo`.
+bool pinToNode(const Topology& topo, size_t node);
+
+} // namespace numa
+} // namespace pufferfish
+
+#endif // __PUFFERFISH_NUMA_UTILS_HPP__
@@ -0,0 +1,175 @@
+#ifndef __OUTPUT_RING_HPP__
+#define __OUTPUT_RING_HPP__
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "spdlog/fmt/fmt.h"
+
+/**
+ * A fixed ring of output buffers between the mapping threads and a single
+ * writer thread.  A worker takes a free buffer together with its next chunk
+ * of reads (nextChunk), formats that chunk's records straight into the
+ * buffer and hands it back (submit).  The writer thread writes every filled
+ * buffer to the output stream in one call and returns it to the free list
+ * with its capacity intact, so after warm-up neither side allocates.
+ *
+ * When `ordered` is set, chunks are numbered as the parser hands them out and
+ * their buffers are written in that order, rather than in the order the
+ * workers happen to finish them.
+ **/
+class OutputRing {
+public:
+  struct Buffer {
+    fmt::MemoryWriter text;
+    uint64_t ticket{0};
+  };
+
+  OutputRing(std::ostream& out, size_t numBuffers, bool ordered)
+      : out_(out), ordered_(ordered), buffers_(numBuffers > 0 ? numBuffers : 1),
+        slots_(buffers_.size(), nullptr) {
+    free_.reserve(buffers_.size());
+    filled_.reserve(buffers_.size());
+    for (auto& b : buffers_) { free_.push_back(&b); }
+    writer_ = std::thread(&OutputRing::drain, this);
+  }
+
+  ~OutputRing() { stop(); }
+
+  OutputRing(const OutputRing&) = delete;
+  OutputRing& operator=(const OutputRing&) = delete;
+
+  /**
+   * Take a free buffer and the next chunk of reads from `parser` (via
+   * `refill(rg)`).  The buffer is taken first, so that whoever holds the
+   * chunk the writer is waiting for in ordered mode can always finish it.
+   * Returns nullptr once the parser is exhausted.
+   **/
+  template <typename ParserT, typename ReadGroupT>
+  Buffer* nextChunk(ParserT* parser, ReadGroupT& rg) {
+    Buffer* b = acquire();
+    bool more{false};
+    if (ordered_) {
+      std::lock_guard<std::mutex> l(ticketMutex_);
+      more = parser->refill(rg);
+      if (more) { b->ticket = nextTicket_++; }
+    } else {
+      more = parser->refill(rg);
+    }
+    if (!more) {
+      release(b);
+      return nullptr;
+    }
+    return b;
+  }
+
+  // hand a filled buffer to the writer thread
+  void submit(Buffer* b) {
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      if (ordered_) {
+        slots_[b->ticket % slots_.size()] = b;
+      } else {
+        filled_.push_back(b);
+      }
+    }
+    readyCV_.notify_one();
+  }
+
+  // write out everything submitted so far and stop the writer thread
+  void stop() {
+    if (!writer_.joinable()) { return; }
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      done_ = true;
+    }
+    readyCV_.notify_one();
+    writer_.join();
+    out_.flush();
+  }
+
+private:
+  Buffer* acquire() {
+    std::unique_lock<std::mutex> l(mutex_);
+    freeCV_.wait(l, [this]() { return !free_.empty(); });
+    Buffer* b = free_.back();
+    free_.pop_back();
+    return b;
+  }
+
+  void release(Buffer* b) {
+    b->text.clear();
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      free_.push_back(b);
+    }
+    freeCV_.notify_one();
+  }
+
+  // move whatever may be written now into `batch`; called with mutex_ held
+  void collectReady(std::vector<Buffer*>& batch) {
+    if (!ordered_) {
+      batch.swap(filled_);
+      return;
+    }
+    // at most one ticket per buffer is in flight, so tickets map onto slots
+    Buffer* b{nullptr};
+    while ((b = slots_[nextWrite_ % slots_.size()]) != nullptr) {
+      slots_[nextWrite_ % slots_.size()] = nullptr;
+      batch.push_back(b);
+      ++nextWrite_;
+    }
+  }
+
+  void drain() {
+    std::vector<Buffer*> batch;
+    batch.reserve(buffers_.size());
+    while (true) {
+      {
+        std::unique_lock<std::mutex> l(mutex_);
+        readyCV_.wait(l, [this, &batch]() {
+          collectReady(batch);
+          return !batch.empty() or done_;
+        });
+        if (batch.empty()) { break; }
+      }
+      for (auto* b : batch) {
+        if (b->text.size() > 0) {
+          out_.write(b->text.data(), b->text.size());
+        }
+        b->text.clear();
+      }
+      {
+        std::lock_guard<std::mutex> l(mutex_);
+        for (auto* b : batch) { free_.push_back(b); }
+      }
+      batch.clear();
+      freeCV_.notify_all();
+    }
+  }
+
+  std::ostream& out_;
+  bool ordered_;
+  std::vector<Buffer> buffers_;
+  std::vector<Buffer*> free_;
+  // unordered mode: buffers in the order they were submitted
+  std::vector<Buffer*> filled_;
+  // ordered mode: buffers indexed by ticket, written from nextWrite_ on
+  std::vector<Buffer*> slots_;
+  uint64_t nextWrite_{0};
+
+  std::mutex ticketMutex_;
+  uint64_t nextTicket_{0};
+
+  std::mutex mutex_;
+  std::condition_variable freeCV_;
+  std::condition_variable readyCV_;
+  bool done_{false};
+  std::thread writer_;
+};
+
+#endif // __OUTPUT_RING_HPP__
@@ -0,0 +1,396 @@
+#ifndef __PAM_FORMAT_HPP__
+#define __PAM_FORMAT_HPP__
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "string_view.hpp"
+
+/**
+ * Version 2 of the krakOut / PAM binary mapping format.
+ *
+ *   header : "PAM2", isPaired (u8), hasIntervals (u8), 2 reserved bytes,
+ *            varint refCount, then per reference varint name length, name,
+ *            varint reference length
+ *   blocks : one per chunk of reads, see PAMBlockBuilder
+ *   index  : "PAMI", u64 block count, then per block its u64 file offset
+ *            and u32 read count
+ *   trailer: u64 offset of the index, "PAM2IDX\0"
+ *
+ * A block is self-contained: a fixed header followed by its fields stored
+ * column by column (names, counts, ref ids, scores, positions, intervals),
+ * every integer as a LEB128 varint and ref ids delta-coded within a read.
+ * Readers can therefore skip columns they do not need, decode blocks on any
+ * thread, and seek to a block through the index.
+ *
+ * All fixed-width fields are little-endian.
+ **/
+namespace pam {
+
+constexpr char fileMagic[4] = {'P', 'A', 'M', '2'};
+constexpr uint32_t blockMagic = 0x424d4150;  // "PAMB"
+constexpr uint32_t indexMagic = 0x494d4150;  // "PAMI"
+constexpr char trailerMagic[8] = {'P', 'A', 'M', '2', 'I', 'D', 'X', '\0'};
+constexpr size_t blockHeaderSize = 24;
+constexpr size_t trailerSize = 16;
+// the reads a writer collects into a block before writing it out
+constexpr uint32_t targetBlockReads = 4096;
+
+// block flags
+constexpr uint8_t integralScores = 0x1;
+
+inline void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+inline uint64_t getVarint(const uint8_t*& p, const uint8_t* end) {
+  uint64_t v{0};
+  for (uint32_t shift = 0; p < end and shift < 64; shift += 7) {
+    uint8_t b = *p++;
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (!(b & 0x80)) { return v; }
+  }
+  std::cerr << "ERROR!! Truncated PAM v2 block.\n";
+  std::exit(1);
+}
+
+inline void corruptBlock(const char* what) {
+  std::cerr << "ERROR!! Corrupt PAM v2 block: " << what << ".\n";
+  std::exit(1);
+}
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+template <typename T>
+inline void putFixed(std::vector<uint8_t>& out, T v) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+  out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+inline T getFixed(const uint8_t* p) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+// One end of a mapping, as recorded in a block
+struct MappedEnd {
+  bool available{false};
+  uint32_t numIntervals{0};
+  double score{0.0};
+  uint32_t pos{0};
+  bool fw{true};
+};
+
+/**
+ * Collects the mappings of one chunk of reads column by column and
+ * serializes them as a v2 block.  Reads are added with beginRead, then
+ * one addMapping per mapping followed by that mapping's intervals (left
+ * end first).
+ **/
+class PAMBlockBuilder {
+public:
+  PAMBlockBuilder(bool isPaired, bool hasIntervals) : isPaired_(isPaired), hasIntervals_(hasIntervals) {}
+
+  void beginRead(stx::string_view name, uint32_t numMappings, uint32_t len1, uint32_t len2 = 0) {
+    if (name.size() >= 0x100) {
+      std::cerr << "ERROR!! DOESN'T SUPPORT STRING LENGTH LONGER THAN 255. String length: "
+                << name.size() << "\n";
+      std::exit(1);
+    }
+    putVarint(nameLens_, name.size());
+    names_.insert(names_.end(), name.data(), name.data() + name.size());
+    putVarint(mappingCounts_, numMappings);
+    putVarint(readLens_, len1);
+    if (isPaired_) { putVarint(readLens_, len2); }
+    prevRefId_ = 0;
+    ++numReads_;
+  }
+
+  void addMapping(uint32_t refId, const MappedEnd& left, const MappedEnd& right = MappedEnd()) {
+    putVarint(refIds_, zigzag(static_cast<int64_t>(refId) - static_cast<int64_t>(prevRefId_)));
+    prevRefId_ = refId;
+    addEnd(left);
+    if (isPaired_) { addEnd(right); }
+    ++numMappings_;
+  }
+
+  void addInterval(uint32_t rpos, uint32_t len) {
+    if (!hasIntervals_) { return; }
+    putVarint(intervals_, rpos);
+    putVarint(intervals_, len);
+  }
+
+  uint32_t numReads() const { return numReads_; }
+  bool empty() const { return numReads_ == 0; }
+
+  // Append the block to `out` and reset the builder for the next chunk
+  void finish(std::vector<uint8_t>& out) {
+    bool intScores{true};
+    for (double s : scores_) {
+      if (std::floor(s) != s or std::fabs(s) > 9007199254740992.0) { intScores = false; break; }
+    }
+    auto& scoreCol = scoreBytes_;
+    scoreCol.clear();
+    for (double s : scores_) {
+      if (intScores) {
+        putVarint(scoreCol, zigzag(static_cast<int64_t>(s)));
+      } else {
+        putFixed(scoreCol, s);
+      }
+    }
+
+    const std::vector<uint8_t>* columns[] = {&nameLens_, &names_, &mappingCounts_, &readLens_, &refIds_,
+                                             &intervalCounts_, &scoreCol, &positions_, &intervals_};
+    uint64_t payload{0};
+    for (auto* c : columns) { payload += varintSize(c->size()) + c->size(); }
+
+    out.reserve(out.size() + blockHeaderSize + payload);
+    putFixed(out, blockMagic);
+    putFixed(out, numReads_);
+    putFixed(out, numMappings_);
+    putFixed(out, static_cast<uint8_t>(intScores ? integralScores : 0));
+    putFixed(out, static_cast<uint8_t>(0));
+    putFixed(out, static_cast<uint16_t>(0));
+    putFixed(out, payload);
+    for (auto* c : columns) {
+      putVarint(out, c->size());
+      out.insert(out.end(), c->begin(), c->end());
+    }
+    clear();
+  }
+
+  void clear() {
+    for (auto* c : {&nameLens_, &names_, &mappingCounts_, &readLens_, &refIds_, &intervalCounts_,
+                    &positions_, &intervals_}) {
+      c->clear();
+    }
+    scores_.clear();
+    numReads_ = numMappings_ = 0;
+    prevRefId_ = 0;
+  }
+
+private:
+  static size_t varintSize(uint64_t v) {
+    size_t n{1};
+    while (v >= 0x80) { v >>= 7; ++n; }
+    return n;
+  }
+
+  void addEnd(const MappedEnd& e) {
+    // 0 when the end is not mapped, so a mapped end with no intervals is still visible
+    putVarint(intervalCounts_, e.available ? e.numIntervals + 1 : 0);
+    if (e.available) {
+      scores_.push_back(e.score);
+      putVarint(positions_, (static_cast<uint64_t>(e.pos) << 1) | (e.fw ? 1 : 0));
+    }
+  }
+
+  bool isPaired_;
+  bool hasIntervals_;
+  uint32_t numReads_{0};
+  uint32_t numMappings_{0};
+  uint32_t prevRefId_{0};
+  std::vector<uint8_t> nameLens_, names_, mappingCounts_, readLens_, refIds_, intervalCounts_,
+      positions_, intervals_, scoreBytes_;
+  std::vector<double> scores_;
+};
+
+/**
+ * The columns of one decoded block.  Intervals are left undecoded; `intervals`
+ * points at their column for readers that want them.
+ **/
+struct PAMBlock {
+  uint32_t numReads{0};
+  uint32_t numMappings{0};
+  std::vector<uint32_t> nameOffsets;  // numReads + 1 offsets into names
+  std::string names;
+  std::vector<uint32_t> mappingCounts;
+  std::vector<uint32_t> readLens;     // one or two per read
+  std::vector<uint32_t> refIds;
+  std::vector<uint32_t> intervalCounts; // one or two per mapping, 0 = end not mapped
+  std::vector<double> scores;         // per mapped end
+  std::vector<uint32_t> positions;    // per mapped end
+  std::vector<uint8_t> fw;            // per mapped end
+  const uint8_t* intervals{nullptr};
+  size_t intervalsSize{0};
+
+  // decode the block whose header starts at `data`
+  void decode(const uint8_t* data, size_t size, bool isPaired) {
+    if (size < blockHeaderSize or getFixed<uint32_t>(data) != blockMagic) {
+      std::cerr << "ERROR!! Not a PAM v2 block.\n";
+      std::exit(1);
+    }
+    numReads = getFixed<uint32_t>(data + 4);
+    numMappings = getFixed<uint32_t>(data + 8);
+    uint8_t flags = data[12];
+    const uint8_t* p = data + blockHeaderSize;
+    const uint8_t* end = data + size;
+    uint32_t ends = isPaired ? 2 : 1;
+
+    auto column = [&p, end](const uint8_t*& colEnd) -> const uint8_t* {
+      uint64_t len = getVarint(p, end);
+      if (len > static_cast<uint64_t>(end - p)) {
+        std::cerr << "ERROR!! Truncated PAM v2 block.\n";
+        std::exit(1);
+      }
+      const uint8_t* col = p;
+      p += len;
+      colEnd = p;
+      return col;
+    };
+    const uint8_t* colEnd{nullptr};
+
+    const uint8_t* c = column(colEnd);
+    nameOffsets.assign(1, 0);
+    for (uint32_t i = 0; i < numReads; ++i) {
+      nameOffsets.push_back(nameOffsets.back() + static_cast<uint32_t>(getVarint(c, colEnd)));
+    }
+    c = column(colEnd);
+    names.assign(reinterpret_cast<const char*>(c), static_cast<size_t>(colEnd - c));
+    if (nameOffsets.back() != names.size()) { corruptBlock("name lengths don't match the names"); }
+
+    c = column(colEnd);
+    decodeColumn(c, colEnd, numReads, mappingCounts);
+    uint64_t totalMappings{0};
+    for (auto cnt : mappingCounts) { totalMappings += cnt; }
+    if (totalMappings != numMappings) { corruptBlock("mapping counts don't add up to the header's"); }
+    c = column(colEnd);
+    decodeColumn(c, colEnd, numReads * ends, readLens);
+
+    c = column(colEnd);
+    refIds.clear();
+    for (uint32_t i = 0; i < numReads; ++i) {
+      int64_t prev{0};
+      for (uint32_t j = 0; j < mappingCounts[i]; ++j) {
+        prev += unzigzag(getVarint(c, colEnd));
+        refIds.push_back(static_cast<uint32_t>(prev));
+      }
+    }
+
+    c = column(colEnd);
+    decodeColumn(c, colEnd, numMappings * ends, intervalCounts);
+    size_t numEnds{0};
+    for (auto cnt : intervalCounts) { numEnds += (cnt > 0); }
+
+    c = column(colEnd);
+    scores.clear();
+    for (size_t i = 0; i < numEnds; ++i) {
+      if (flags & integralScores) {
+        scores.push_back(static_cast<double>(unzigzag(getVarint(c, colEnd))));
+      } else {
+        if (static_cast<size_t>(colEnd - c) < sizeof(double)) { corruptBlock("score column is short"); }
+        scores.push_back(getFixed<double>(c));
+        c += sizeof(double);
+      }
+    }
+
+    c = column(colEnd);
+    positions.clear();
+    fw.clear();
+    for (size_t i = 0; i < numEnds; ++i) {
+      uint64_t v = getVarint(c, colEnd);
+      positions.push_back(static_cast<uint32_t>(v >> 1));
+      fw.push_back(static_cast<uint8_t>(v & 1));
+    }
+
+    intervals = column(colEnd);
+    intervalsSize = static_cast<size_t>(colEnd - intervals);
+  }
+
+private:
+  static void decodeColumn(const uint8_t* c, const uint8_t* colEnd, size_t n, std::vector<uint32_t>& out) {
+    out.clear();
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++i) { out.push_back(static_cast<uint32_t>(getVarint(c, colEnd))); }
+  }
+};
+
+/**
+ * Writes the v2 header, then blocks from any number of threads, recording
+ * where each one lands so close() can append the block index.
+ **/
+class PAMWriter {
+public:
+  template <typename NameVecT, typename LenVecT>
+  PAMWriter(std::ostream& out, bool isPaired, bool hasIntervals,
+            const NameVecT& refNames, const LenVecT& refLengths)
+      : out_(out) {
+    std::vector<uint8_t> hd;
+    hd.insert(hd.end(), fileMagic, fileMagic + 4);
+    putFixed(hd, static_cast<uint8_t>(isPaired));
+    putFixed(hd, static_cast<uint8_t>(hasIntervals));
+    putFixed(hd, static_cast<uint16_t>(0));
+    putVarint(hd, refNames.size());
+    for (size_t i = 0; i < refNames.size(); ++i) {
+      putVarint(hd, refNames[i].size());
+      hd.insert(hd.end(), refNames[i].begin(), refNames[i].end());
+      putVarint(hd, refLengths[i]);
+    }
+    write(hd);
+  }
+
+  ~PAMWriter() { close(); }
+
+  // serialize the builder's block and write it; the builder is left empty
+  void writeBlock(PAMBlockBuilder& builder, std::vector<uint8_t>& scratch) {
+    if (builder.empty()) { return; }
+    uint32_t numReads = builder.numReads();
+    scratch.clear();
+    builder.finish(scratch);
+    std::lock_guard<std::mutex> l(mutex_);
+    index_.push_back({offset_, numReads});
+    write(scratch);
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> l(mutex_);
+    if (closed_) { return; }
+    closed_ = true;
+    std::vector<uint8_t> idx;
+    uint64_t indexOffset = offset_;
+    putFixed(idx, indexMagic);
+    putFixed(idx, static_cast<uint64_t>(index_.size()));
+    for (auto& e : index_) {
+      putFixed(idx, e.offset);
+      putFixed(idx, e.numReads);
+    }
+    putFixed(idx, indexOffset);
+    idx.insert(idx.end(), trailerMagic, trailerMagic + 8);
+    write(idx);
+    out_.flush();
+  }
+
+private:
+  struct IndexEntry {
+    uint64_t offset;
+    uint32_t numReads;
+  };
+
+  void write(const std::vector<uint8_t>& bytes) {
+    out_.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    offset_ += bytes.size();
+  }
+
+  std::ostream& out_;
+  std::mutex mutex_;
+  uint64_t offset_{0};
+  std::vector<IndexEntry> index_;
+  bool closed_{false};
+};
+
+} // namespace pam
+
+#endif // __PAM_FORMAT_HPP__
@@ -0,0 +1,343 @@
+#ifndef __PAIRED_READ_MAPPER_HPP__
+#define __PAIRED_READ_MAPPER_HPP__
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "parallel_hashmap/phmap.h"
+
+#include "MappingWorkspace.hpp"
+#include "ProgOpts.hpp"
+#include "PuffAligner.hpp"
+#include "ReadPairCache.hpp"
+#include "SelectiveAlignmentUtils.hpp"
+#include "Util.hpp"
+
+/**
+ * Everything one thread needs to map read pairs: MEM collection, chaining,
+ * joining the mates, orphan recovery, alignment and the reference filters
+ * of the command line (--filterGenomics and friends).  One instance per
+ * thread; it keeps its buffers from pair to pair.
+ *
+ * After map() returns true, jointHits() holds the surviving hits and
+ * jointAlignments() the corresponding QuasiAlignment records; they stay
+ * valid until the next call.
+ *
+ * With --readCacheSize, a pair with the same sequences as one mapped
+ * recently gets that pair's alignments back instead of being mapped again;
+ * jointHits() is empty then, so the cache is only for callers that just
+ * use jointAlignments().
+ **/
+template <typename PufferfishIndexT>
+class PairedReadMapper {
+public:
+  PairedReadMapper(PufferfishIndexT* pfi, const pufferfish::AlignmentOpts* mopts,
+                   const phmap::flat_hash_set<std::string>& geneNames,
+                   const phmap::flat_hash_set<std::string>& rrnaNames)
+      : pfi_(pfi), mopts_(mopts), geneNames_(geneNames), rrnaNames_(rrnaNames), ws_(pfi, mopts) {
+    cache_.setCapacity(mopts->readCacheSize);
+  }
+
+  PairedReadMapper(const PairedReadMapper&) = delete;
+  PairedReadMapper& operator=(const PairedReadMapper&) = delete;
+
+  // Maps the pair (left, right).  Returns false if one of the reference
+  // filters drops the pair, in which case it must not be reported at all.
+  // The mates are seeded where the parser left them and only copied once
+  // orphan recovery or alignment needs them.
+  bool map(stx::string_view left, stx::string_view right, pufferfish::util::HitCounters& hctr) {
+    if (cache_.enabled()) {
+      if (auto cached = cache_.find(left, right)) {
+        ++hctr.readCacheHits;
+        jointHits_.clear();
+        jointAlignments_.clear();
+        // QuasiAlignment can only be copy-constructed from a const one
+        for (auto& aln : cached->alignments) { jointAlignments_.emplace_back(aln); }
+        cached->tally.addTo(hctr);
+        return !cached->filtered;
+      }
+      ++hctr.readCacheMisses;
+    }
+    tally_ = PairTally();
+    bool kept = mapPair(left, right, hctr);
+    tally_.addTo(hctr);
+    if (cache_.enabled()) {
+      auto& entry = cache_.insert(left, right);
+      entry.filtered = !kept;
+      entry.tally = tally_;
+      entry.alignments.clear();
+      for (auto& aln : jointAlignments_) { entry.alignments.emplace_back(aln); }
+    }
+    return kept;
+  }
+
+  std::vector<pufferfish::util::JointMems>& jointHits() { return jointHits_; }
+  std::vector<pufferfish::util::QuasiAlignment>& jointAlignments() { return jointAlignments_; }
+
+  // The counters of this mapper's buffers, added once it is done with its reads
+  void addWorkspaceStats(pufferfish::util::HitCounters& hctr) { ws_.addStats(hctr); }
+
+private:
+  // map() without the read cache; the summary counters go to tally_
+  bool mapPair(stx::string_view left, stx::string_view right, pufferfish::util::HitCounters& hctr);
+
+  PufferfishIndexT* pfi_;
+  const pufferfish::AlignmentOpts* mopts_;
+  const phmap::flat_hash_set<std::string>& geneNames_;
+  const phmap::flat_hash_set<std::string>& rrnaNames_;
+
+  MappingWorkspace<PufferfishIndexT> ws_;
+
+  pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>> leftHits_;
+  pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>> rightHits_;
+  std::vector<pufferfish::util::MemCluster> recoveredHits_;
+  std::vector<pufferfish::util::JointMems> jointHits_;
+  std::vector<pufferfish::util::QuasiAlignment> jointAlignments_;
+  std::vector<int32_t> scores_;
+  phmap::flat_hash_map<uint32_t, std::pair<int32_t, int32_t>> bestScorePerTranscript_;
+  ReadPairCache cache_;
+  PairTally tally_;
+  // the mates, once orphan recovery or alignment needs them as strings
+  std::string left_;
+  std::string right_;
+};
+
+template <typename PufferfishIndexT>
+bool PairedReadMapper<PufferfishIndexT>::mapPair(stx::string_view left, stx::string_view right,
+                                                 pufferfish::util::HitCounters& hctr) {
+  using pufferfish::util::BestHitReferenceType;
+  using pufferfish::util::MateStatus;
+  constexpr const int32_t invalidScore = std::numeric_limits<int32_t>::min();
+  const pufferfish::AlignmentOpts* mopts = mopts_;
+  bool verbose = mopts->verbose;
+
+  // don't think we should have these, they should
+  // be baked into the index I think.
+  bool filterGenomics = mopts->filterGenomics;
+  bool filterMicrobiom = mopts->filterMicrobiom;
+  bool filterBestScoreMicrobiom = mopts->filterMicrobiomBestScore;
+
+  bool loaded{false};
+  auto load = [&]() {
+    if (loaded) { return; }
+    left_.assign(left.data(), left.size());
+    right_.assign(right.data(), right.size());
+    loaded = true;
+  };
+
+  uint32_t readLen = static_cast<uint32_t>(left.length());
+  uint32_t mateLen = static_cast<uint32_t>(right.length());
+  uint32_t totLen = readLen + mateLen;
+
+  jointHits_.clear();
+  leftHits_.clear();
+  rightHits_.clear();
+  recoveredHits_.clear();
+  ws_.memCollector.clear();
+  jointAlignments_.clear();
+
+  bool lh = ws_.memCollector(left, ws_.qc,
+                             true, // isLeft
+                             verbose);
+  bool rh = ws_.memCollector(right, ws_.qc,
+                             false, // isLeft
+                             verbose);
+  ws_.memCollector.findChains(left, leftHits_, mopts->maxSpliceGap, MateStatus::PAIRED_END_LEFT,
+                              mopts->heuristicChaining,
+                              true, // isLeft
+                              verbose);
+  ws_.memCollector.findChains(right, rightHits_, mopts->maxSpliceGap, MateStatus::PAIRED_END_RIGHT,
+                              mopts->heuristicChaining,
+                              false, // isLeft
+                              verbose);
+
+  tally_.anyKmer = (leftHits_.size() > 0 || rightHits_.size() > 0);
+
+  // We also handle orphans inside this function
+  auto mergeRes = pufferfish::util::joinReadsAndFilter(leftHits_, rightHits_, jointHits_,
+                                                       mopts->maxFragmentLength,
+                                                       totLen,
+                                                       mopts->scoreRatio,
+                                                       pfi_->firstDecoyIndex(),
+                                                       ws_.mpol, hctr);
+
+  bool mergeStatusOR = (mergeRes == pufferfish::util::MergeResult::HAD_EMPTY_INTERSECTION or
+                        mergeRes == pufferfish::util::MergeResult::HAD_ONLY_LEFT or
+                        mergeRes == pufferfish::util::MergeResult::HAD_ONLY_RIGHT);
+
+  if (mopts->recoverOrphans and mergeStatusOR) {
+    // TODO NOTE : do futher testing
+    load();
+    bool recoveredAny = selective_alignment::utils::recoverOrphans(left_, right_, recoveredHits_, jointHits_, ws_.puffaligner, verbose);
+    (void)recoveredAny;
+  }
+
+  tally_.peHits = static_cast<uint32_t>(jointHits_.size());
+
+  if (!mopts->justMap) {
+    if (!jointHits_.empty()) { load(); }
+    ws_.puffaligner.clear();
+    int32_t bestScore = invalidScore;
+    scores_.assign(jointHits_.size(), bestScore);
+    size_t idx{0};
+
+    if (!mopts->genomicReads) { bestScorePerTranscript_.clear(); }
+    BestHitReferenceType bestHitRefType = BestHitReferenceType::UNKNOWN;
+    BestHitReferenceType hitRefType = BestHitReferenceType::UNKNOWN;
+    bool isMultimapping = (jointHits_.size() > 1);
+    ws_.puffaligner.batchScoreCandidates(left_, right_, jointHits_, hctr);
+    for (auto&& jointHit : jointHits_) {
+      auto hitScore = ws_.puffaligner.calculateAlignments(left_, right_, jointHit, hctr, isMultimapping, false);
+      scores_[idx] = hitScore;
+      const std::string& ref_name = pfi_->refName(jointHit.tid);
+      if (filterMicrobiom and hitScore != invalidScore and hitRefType != BestHitReferenceType::FILTERED) {
+        bool inFilteredList = (rrnaNames_.find(ref_name) != rrnaNames_.end());
+        if (inFilteredList) {
+          hitRefType = BestHitReferenceType::FILTERED;
+        }
+      }
+      if (filterGenomics or filterBestScoreMicrobiom) {
+        bool inFilteredList = (geneNames_.find(ref_name) != geneNames_.end());
+        if (inFilteredList) {
+          scores_[idx] = invalidScore;
+          if (hitScore > bestScore) {
+            bestHitRefType = BestHitReferenceType::FILTERED;
+          } else if (hitScore == bestScore) {
+            bestHitRefType = (bestHitRefType == BestHitReferenceType::NON_FILTERED or
+                              bestHitRefType == BestHitReferenceType::BOTH) ?
+                             BestHitReferenceType::BOTH : BestHitReferenceType::FILTERED;
+          }
+        } else { // the current hit was not in the list of references to filter
+          if (hitScore > bestScore) {
+            bestHitRefType = BestHitReferenceType::NON_FILTERED;
+          } else if (hitScore == bestScore) {
+            bestHitRefType = (bestHitRefType == BestHitReferenceType::FILTERED or
+                              bestHitRefType == BestHitReferenceType::BOTH) ?
+                             BestHitReferenceType::BOTH : BestHitReferenceType::NON_FILTERED;
+          }
+        }
+      }
+
+      bestScore = (hitScore > bestScore) ? hitScore : bestScore;
+
+      // use ALIGNMENT SCORE, not COVERAGE
+      // We should have valid alignment scores at this point as we are inside !justMap if and passed calculating alignment score
+      if (!mopts->genomicReads) {
+        // removing dupplicate hits from a read to the same transcript
+        auto it = bestScorePerTranscript_.find(jointHit.tid);
+        if (it == bestScorePerTranscript_.end()) {
+          // if we didn't have any alignment for this transcript yet, then
+          // this is the current best
+          bestScorePerTranscript_[jointHit.tid].first = jointHit.alignmentScore + jointHit.mateAlignmentScore;
+          bestScorePerTranscript_[jointHit.tid].second = idx;
+        } else if (jointHit.coverage() > it->second.first) {
+          // otherwise, if we had an alignment for this transcript and it's
+          // better than the current best, then set the best score to this
+          // alignment's score, and invalidate the previous alignment
+          it->second.first = jointHit.alignmentScore + jointHit.mateAlignmentScore;
+          scores_[it->second.second] = invalidScore;
+          it->second.second = idx;
+        } else {
+          // otherwise, there is already a better mapping for this transcript.
+          scores_[idx] = invalidScore;
+        }
+      }
+      ++idx;
+    }
+
+    if (filterGenomics and (bestHitRefType == BestHitReferenceType::FILTERED)) {
+      // This read is likely come from decoy sequence and should be discarded from reference alignments
+      return false;
+    }
+    if (filterBestScoreMicrobiom and (bestHitRefType != BestHitReferenceType::NON_FILTERED)) {
+      return false;
+    }
+    if (filterMicrobiom and (hitRefType == BestHitReferenceType::FILTERED)) {
+      return false;
+    }
+    // Filter out these alignments with low scores
+    uint32_t ctr{0};
+    if (bestScore > invalidScore) {
+      bool filterBestStrata = mopts->bestStrata;
+      auto& scores = scores_;
+      jointHits_.erase(
+          std::remove_if(jointHits_.begin(), jointHits_.end(),
+                         [&ctr, &scores, filterBestStrata, bestScore](pufferfish::util::JointMems&) -> bool {
+                           bool rem = filterBestStrata ? (scores[ctr] < bestScore) : (scores[ctr] == invalidScore);
+                           ++ctr;
+                           return rem;
+                         }),
+          jointHits_.end());
+
+      if (mopts->primaryAlignment and !jointHits_.empty()) {
+        jointHits_.resize(1);
+      }
+    } else {
+      // There is no alignment with high quality for this read, so we skip this reads' alignments
+      jointHits_.clear();
+    }
+  }
+
+  if (jointHits_.size() > mopts->maxNumHits) {
+    std::sort(jointHits_.begin(), jointHits_.end(),
+              [](const pufferfish::util::JointMems& lhs, const pufferfish::util::JointMems& rhs) {
+                return lhs.alignmentScore < rhs.alignmentScore;
+              });
+    jointHits_.erase(jointHits_.begin() + mopts->maxNumHits, jointHits_.end());
+  }
+
+  tally_.pairedHit = !jointHits_.empty() && !jointHits_.back().isOrphan();
+  tally_.mapped = !jointHits_.empty();
+  if (mopts->noOrphan) {
+    tally_.orphan = jointHits_.empty() && (lh || rh);
+  } else {
+    tally_.orphan = !jointHits_.empty() && (jointHits_.back().isOrphan());
+  }
+  tally_.numHits = static_cast<uint32_t>(jointHits_.size());
+
+  for (auto&& jointHit : jointHits_) {
+    if (jointHit.isOrphan()) {
+      readLen = jointHit.isLeftAvailable() ? readLen : mateLen;
+      jointAlignments_.emplace_back(jointHit.tid,                                 // reference id
+                                    jointHit.orphanClust()->getTrFirstHitPos(),   // reference pos
+                                    jointHit.orphanClust()->isFw,                 // fwd direction
+                                    readLen,                                      // read length
+                                    jointHit.orphanClust()->cigar,                // cigar string
+                                    jointHit.fragmentLen,                         // fragment length
+                                    false);
+      auto& qaln = jointAlignments_.back();
+      // NOTE : score should not be filled in from a double
+      qaln.score = mopts->justMap ? static_cast<int32_t>(jointHit.orphanClust()->coverage) : jointHit.alignmentScore;
+      // NOTE : wth is numHits?
+      qaln.numHits = static_cast<uint32_t>(jointHits_.size());
+      qaln.mateStatus = jointHit.mateStatus;
+    } else {
+      jointAlignments_.emplace_back(jointHit.tid,                                 // reference id
+                                    jointHit.leftClust->getTrFirstHitPos(),       // reference pos
+                                    jointHit.leftClust->isFw,                     // fwd direction
+                                    readLen,                                      // read length
+                                    jointHit.leftClust->cigar,                    // cigar string
+                                    jointHit.fragmentLen,                         // fragment length
+                                    true);                                        // properly paired
+      // Fill in the mate info
+      auto& qaln = jointAlignments_.back();
+      qaln.mateLen = mateLen;
+      qaln.mateCigar = jointHit.rightClust->cigar;
+      qaln.matePos = static_cast<int32_t>(jointHit.rightClust->getTrFirstHitPos());
+      qaln.mateIsFwd = jointHit.rightClust->isFw;
+      qaln.mateStatus = MateStatus::PAIRED_END_PAIRED;
+      // NOTE : wth is numHits?
+      qaln.numHits = static_cast<uint32_t>(jointHits_.size());
+      // NOTE : score should not be filled in from a double
+      qaln.score = mopts->justMap ? static_cast<int32_t>(jointHit.leftClust->coverage) : jointHit.alignmentScore;
+      qaln.mateScore = mopts->justMap ? static_cast<int32_t>(jointHit.rightClust->coverage) : jointHit.mateAlignmentScore;
+    }
+  }
+
+  tally_.numAlignments = static_cast<uint32_t>(jointAlignments_.size());
+  return true;
+}
+
+#endif // __PAIRED_READ_MAPPER_HPP__
@@ -1,6 +1,7 @@
 #ifndef __PUFFERFISH_PROG_OPTS_HPP__
 #define __PUFFERFISH_PROG_OPTS_HPP__
 #include <cstdint>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -74,6 +75,25 @@ public:
   bool noDiscordant{false};
   bool noOrphan{false};
   bool compressedOutput{false};
+  bool orderedOutput{false};
+  bool bamOutput{false};
+  bool pamV2{false};
+  bool eqClassOutput{false};
+  // only sort the reads into those that align well enough somewhere and the rest
+  bool screen{false};
+  // with --screen, the score an alignment must reach on top of minScoreFraction
+  int32_t screenMinScore{std::numeric_limits<int32_t>::min()};
+  // with --screen, only alignments to decoy references count
+  bool screenDecoys{false};
+  // BGZF compression threads for --bam and --compressedOutput; 0 picks one from numThreads
+  uint32_t compressionThreads{0};
+  // threads inflating each read file; 0 picks one from numThreads
+  uint32_t decompressionThreads{0};
+  // spread the index over all NUMA nodes, or keep one copy of it per node
+  bool numaInterleave{false};
+  bool numaReplicate{false};
+  // back the index lookup structures with transparent huge pages
+  bool hugePages{false};
   bool verbose{false};
   bool validateMappings{true};
   bool bestStrata{false};
@@ -85,6 +105,12 @@ public:
   double minScoreFraction{0.65};
   bool fullAlignment{false};
   bool heuristicChaining{true};
+  uint32_t maxChainLookback{64};
+  uint32_t crossReadCacheSize{0};
+  // read pairs each thread remembers with their alignments; 0 turns this off
+  uint32_t readCacheSize{0};
+  bool noScoreBoundFilter{false};
+  bool batchAlignment{false};
   bool genomicReads{false};
   std::string genesNamesFile{""};
   std::string rrnaFile{""};
@@ -99,6 +125,19 @@ public:
   bool mimicBt2Default{false};
   bool mimicBt2Strict{false};
   bool allowOverhangSoftclip{false};
+  // run the job on the `pufferfish serve` listening on this socket
+  std::string serverSocket;
+};
+
+class ServeOptions {
+public:
+  std::string indexDir;
+  std::string socketPath;
+  // the mapping threads every job runs on
+  uint32_t numThreads{8};
+  bool numaInterleave{false};
+  bool numaReplicate{false};
+  bool hugePages{false};
 };
 }
 
@@ -12,6 +12,8 @@
 
 #include "parallel_hashmap/phmap.h"
 
+#include <limits>
+
 struct PassthroughHash {
 	std::size_t operator()(uint64_t const& u) const { return u; }
 };
@@ -26,15 +28,107 @@ using HitCounters = pufferfish::util::HitCounters;
 using AlignmentResult = pufferfish::util::AlignmentResult;
 using AlnCacheMap = phmap::flat_hash_map<uint64_t, AlignmentResult, PassthroughHash>;
 
+/**
+ * A bounded map from alignment keys to alignment results that evicts the
+ * least recently used entry when full.  Unlike the per-read AlnCacheMap, it
+ * persists across reads, so that duplicated reads can skip alignment.
+ * Entries live in a fixed pool of slots threaded onto an intrusive list, so
+ * a full cache recycles slots (and their CIGAR storage) rather than allocating.
+ **/
+class AlignmentLRUCache {
+public:
+  void setCapacity(uint32_t capacity) {
+    capacity_ = capacity;
+    clear();
+    entries_.reserve(capacity_);
+    index_.reserve(capacity_);
+  }
+
+  bool enabled() const { return capacity_ > 0; }
+
+  void clear() {
+    entries_.clear();
+    index_.clear();
+    head_ = tail_ = nil;
+  }
+
+  // returns nullptr on a miss; a hit becomes the most recently used entry
+  const AlignmentResult* find(uint64_t key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) { return nullptr; }
+    uint32_t i = it->second;
+    if (i != head_) { unlink(i); pushFront(i); }
+    return &entries_[i].aln;
+  }
+
+  void insert(uint64_t key, int32_t score, const std::string& cigar, uint32_t openGapLen) {
+    if (!enabled()) { return; }
+    uint32_t i;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      i = it->second;
+      unlink(i);
+    } else if (entries_.size() < capacity_) {
+      i = static_cast<uint32_t>(entries_.size());
+      entries_.emplace_back();
+      index_[key] = i;
+    } else {
+      i = tail_;
+      unlink(i);
+      index_.erase(entries_[i].key);
+      index_[key] = i;
+    }
+    auto& e = entries_[i];
+    e.key = key;
+    e.aln.score = score;
+    e.aln.cigar.assign(cigar);
+    e.aln.openGapLen = openGapLen;
+    pushFront(i);
+  }
+
+private:
+  static constexpr uint32_t nil = std::numeric_limits<uint32_t>::max();
+  struct Entry {
+    uint64_t key{0};
+    AlignmentResult aln;
+    uint32_t prev{nil};
+    uint32_t next{nil};
+  };
+
+  void unlink(uint32_t i) {
+    auto& e = entries_[i];
+    if (e.prev != nil) { entries_[e.prev].next = e.next; } else { head_ = e.next; }
+    if (e.next != nil) { entries_[e.next].prev = e.prev; } else { tail_ = e.prev; }
+    e.prev = e.next = nil;
+  }
+
+  void pushFront(uint32_t i) {
+    auto& e = entries_[i];
+    e.prev = nil;
+    e.next = head_;
+    if (head_ != nil) { entries_[head_].prev = i; }
+    head_ = i;
+    if (tail_ == nil) { tail_ = i; }
+  }
+
+  uint32_t capacity_{0};
+  uint32_t head_{nil};
+  uint32_t tail_{nil};
+  std::vector<Entry> entries_;
+  phmap::flat_hash_map<uint64_t, uint32_t, PassthroughHash> index_;
+};
+
 class PuffAligner {
 public:
   PuffAligner(compact::vector<uint64_t, 2>& ar, std::vector<uint64_t>& ral, uint32_t k_, 
               pufferfish::util::AlignmentConfig& m, ksw2pp::KSW2Aligner& a) : 
     allRefSeq(ar), refAccumLengths(ral), k(k_), 
     mopts(m), aligner(a) {
-    ksw_reset_extz(&ez);
+    aligner.initExtz(&ez);
 		alnCacheLeft.reserve(32);
 		alnCacheRight.reserve(32);
+    crossReadCache_.setCapacity(mopts.crossReadCacheSize);
+    crossReadCacheSeed_ = scoringParamsHash();
   }
 
 /*
@@ -58,6 +152,12 @@ public:
 
   bool alignRead(std::string& read, std::string& read_rc, const std::vector<pufferfish::util::MemInfo>& mems, bool perfectChain, bool isFw, size_t tid, AlnCacheMap& alnCache, HitCounters& hctr, AlignmentResult& arOut, bool verbose);
 
+  // Score the windows of all candidates of a multi-mapping read with the inter-sequence kernel
+  // and put the ones that fail minScoreFraction into the alignment caches, so that only the
+  // remaining candidates are aligned (and traced back) by calculateAlignments.
+  void batchScoreCandidates(std::string& read_left, std::string& read_right, std::vector<pufferfish::util::JointMems>& jointHits, HitCounters& hctr);
+  void batchScoreCandidates(std::string& read, std::vector<pufferfish::util::JointMems>& jointHits, HitCounters& hctr);
+
   bool recoverSingleOrphan(std::string& rl, std::string& rr, pufferfish::util::MemCluster& clust, std::vector<pufferfish::util::MemCluster> &recoveredMemClusters, uint32_t tid, bool anchorIsLeft, bool verbose);
 
   void clearAlnCaches() {alnCacheLeft.clear(); alnCacheRight.clear();}
@@ -65,6 +165,37 @@ public:
 
   std::vector<pufferfish::util::UniMemInfo> orphanRecoveryMemCollection;
 private:
+  // a reference interval [start, end) and its ksw2 codes
+  struct RefWindow {
+    int64_t start{0};
+    int64_t end{0};
+    const uint8_t* seq{nullptr};
+  };
+
+  // a full-alignment window scored by batchScoreCandidates
+  struct BatchCandidate {
+    uint64_t hashKey{0};
+    bool isFw{true};
+    size_t refOffset{0};
+    int32_t refLen{0};
+  };
+
+  uint64_t scoringParamsHash() const;
+  bool batchScoringEnabled(size_t numHits) const;
+  void addBatchCandidate(const std::string& read, const pufferfish::util::MemCluster& clust, size_t tid,
+                         std::vector<BatchCandidate>& cands);
+  void scoreBatch(std::string& read, std::string& read_rc, std::vector<BatchCandidate>& cands,
+                  AlnCacheMap& alnCache, HitCounters& hctr);
+  RefWindow alignmentRefWindow(const std::vector<pufferfish::util::MemInfo>& mems, bool isFw, bool doFullAlignment,
+                               int64_t readLen, uint64_t refAccPos, int64_t refTotalLength,
+                               uint32_t refStart, int32_t keyLen);
+  uint64_t crossReadCacheKey(const std::string& read, const std::vector<pufferfish::util::MemInfo>& mems,
+                             bool isFw, bool doFullAlignment, const RefWindow& win,
+                             uint32_t refStart, uint32_t readStart);
+  int32_t lcsLength(const uint8_t* q, int32_t qlen, const uint8_t* t, int32_t tlen);
+  bool cannotReachMinScore(const std::vector<uint8_t>& readCodes, const std::vector<pufferfish::util::MemInfo>& mems,
+                           bool isFw, bool doFullAlignment, const RefWindow& win);
+
   compact::vector<uint64_t, 2>& allRefSeq;
   std::vector<uint64_t>& refAccumLengths;
   uint32_t k;
@@ -77,13 +208,38 @@ private:
   std::string rc2_;
   std::string read_left_rc_;
   std::string read_right_rc_;
-  std::string refSeqBuffer_;
+  // reference windows (and the read) as ksw2 codes rather than characters
+  std::vector<uint8_t> refSeqBuffer_;
+  // scratch space reused across calls to alignRead
+  std::vector<uint8_t> tseqBuffer_;
+  std::vector<uint8_t> readWindowBuffer_;
+  std::vector<uint8_t> readCodeBuffer_;
+  std::vector<uint8_t> refWindowBuffer_;
+  // bit-parallel LCS state used by the score bound
+  std::vector<uint64_t> lcsPeq_;
+  std::vector<uint64_t> lcsV_;
+  std::string cigarBuffer_;
+  // state of batchScoreCandidates
+  std::vector<BatchCandidate> batchLeft_;
+  std::vector<BatchCandidate> batchRight_;
+  std::vector<uint8_t> batchRefCodes_;
+  phmap::flat_hash_set<uint64_t, PassthroughHash> batchSeen_;
+  std::vector<const uint8_t*> batchTargets_;
+  std::vector<int> batchTargetLens_;
+  std::vector<int> batchScores_;
+  std::vector<size_t> batchMembers_;
+  // the character window searched by edlib in recoverSingleOrphan
+  std::string orphanWindowBuffer_;
   AlignmentResult ar_left;
   AlignmentResult ar_right;
 
   bool isMultimapping_;
   AlnCacheMap alnCacheLeft;
   AlnCacheMap alnCacheRight;
+  // survives clear(), so hits can come from earlier reads on this thread
+  AlignmentLRUCache crossReadCache_;
+  uint64_t crossReadCacheSeed_{0};
+
 };
 
 
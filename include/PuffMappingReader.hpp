@@ -4,10 +4,12 @@
 #define __MAPPINGS_H__
 
 #include "spdlog/spdlog.h"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <mutex>
 #include "Taxa.h"
+#include "PAMFormat.hpp"
 
 class Chunk {
 public:
@@ -37,6 +39,8 @@ public:
 
     bool hasNext() { return currByte_ < chunkSize_; }
 
+    uint64_t size() const { return chunkSize_; }
+
     template<class T>
     inline void fill(T &val) {
         memcpy(&val, chunk_.data() + currByte_, sizeof(val));
@@ -76,6 +80,13 @@ public:
         }
     }
     bool readHeader() {
+        char magic[4] = {0, 0, 0, 0};
+        inFile.read(magic, sizeof(magic));
+        if (inFile and std::equal(magic, magic + 4, pam::fileMagic)) {
+            return readHeaderV2();
+        }
+        inFile.clear();
+        inFile.seekg(0);
         size_t refCount;
         inFile.read(reinterpret_cast<char *>(&isPaired), sizeof(bool));
         inFile.read(reinterpret_cast<char *>(&refCount), sizeof(size_t));
@@ -98,8 +109,89 @@ public:
         return true;
     }
 
+    /**
+     * v2 header, followed by the block index from the end of the file.
+     * Blocks are then read in file order up to the index.
+     **/
+    bool readHeaderV2() {
+        version = 2;
+        uint8_t flags[4];
+        inFile.read(reinterpret_cast<char *>(flags), sizeof(flags));
+        isPaired = flags[0] != 0;
+        hasIntervals = flags[1] != 0;
+        uint64_t refCount = readVarint();
+        logger->info("Total # of References: {}", refCount);
+        refLengths.resize(refCount);
+        refNames.resize(refCount);
+        for (size_t i = 0; i < refCount; i++) {
+            refNames[i].resize(readVarint());
+            inFile.read(&refNames[i][0], refNames[i].size());
+            refLengths[i] = static_cast<refLenType>(readVarint());
+        }
+        if (!inFile) { return false; }
+        auto firstBlock = inFile.tellg();
+
+        // the trailer points at the index; without it (a truncated file) just read blocks until EOF
+        char trailer[pam::trailerSize];
+        inFile.seekg(0, std::ios::end);
+        auto fileSize = static_cast<uint64_t>(inFile.tellg());
+        dataEnd = fileSize;
+        if (fileSize >= pam::trailerSize + static_cast<uint64_t>(firstBlock)) {
+            inFile.seekg(fileSize - pam::trailerSize);
+            inFile.read(trailer, sizeof(trailer));
+            if (std::equal(trailer + 8, trailer + 16, pam::trailerMagic)) {
+                dataEnd = pam::getFixed<uint64_t>(reinterpret_cast<uint8_t *>(trailer));
+                inFile.seekg(dataEnd);
+                uint32_t magic{0};
+                uint64_t numBlocks{0};
+                inFile.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+                inFile.read(reinterpret_cast<char *>(&numBlocks), sizeof(numBlocks));
+                if (magic != pam::indexMagic) { return false; }
+                blockOffsets.resize(numBlocks);
+                blockReads.resize(numBlocks);
+                for (size_t i = 0; i < numBlocks; ++i) {
+                    inFile.read(reinterpret_cast<char *>(&blockOffsets[i]), sizeof(uint64_t));
+                    inFile.read(reinterpret_cast<char *>(&blockReads[i]), sizeof(uint32_t));
+                }
+                logger->info("Mapping file has {} blocks", numBlocks);
+            }
+        }
+        inFile.clear();
+        inFile.seekg(firstBlock);
+        return static_cast<bool>(inFile);
+    }
+
+    // read the v2 block starting at `offset` (header and payload) into `chunk`
+    bool readBlockAt(uint64_t offset, Chunk &chunk) {
+        if (offset + pam::blockHeaderSize > dataEnd) { return false; }
+        inFile.seekg(offset);
+        uint8_t header[pam::blockHeaderSize];
+        inFile.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!inFile or pam::getFixed<uint32_t>(header) != pam::blockMagic) {
+            logger->error("Corrupt block in mapping file at offset {}.", offset);
+            std::exit(1);
+        }
+        uint64_t payload = pam::getFixed<uint64_t>(header + 16);
+        chunk.allocate(pam::blockHeaderSize + payload);
+        std::copy(header, header + pam::blockHeaderSize, chunk.chunk_.begin());
+        inFile.read(chunk.chunk_.data() + pam::blockHeaderSize, payload);
+        nextBlock = offset + pam::blockHeaderSize + payload;
+        return static_cast<bool>(inFile);
+    }
+
+    // random access through the index, e.g. to decode blocks in parallel
+    bool readBlock(size_t i, Chunk &chunk, std::mutex& iomutex) {
+        std::lock_guard<std::mutex> l(iomutex);
+        if (i >= blockOffsets.size()) { return false; }
+        return readBlockAt(blockOffsets[i], chunk);
+    }
+
     bool readChunk(Chunk &chunk, std::mutex& iomutex) {
         std::lock_guard<std::mutex> l(iomutex);
+        if (version == 2) {
+            if (nextBlock == 0) { nextBlock = static_cast<uint64_t>(inFile.tellg()); }
+            return readBlockAt(nextBlock, chunk);
+        }
         if (hasNext()) {
             uint64_t chunksize;
             inFile.read(reinterpret_cast<char *>(&chunksize), sizeof(chunksize));
@@ -115,8 +207,26 @@ public:
     bool hasNext() { return inFile.is_open() && inFile.good(); }
 
 
+    uint64_t readVarint() {
+        uint64_t v{0};
+        for (uint32_t shift = 0; shift < 64; shift += 7) {
+            int b = inFile.get();
+            if (b == std::char_traits<char>::eof()) { break; }
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) { break; }
+        }
+        return v;
+    }
+
     std::ifstream inFile;
+    uint32_t version{1};
     bool isPaired = true;
+    bool hasIntervals = false;
+    // v2 only: where each block starts, how many reads it holds, and where the blocks end
+    std::vector<uint64_t> blockOffsets;
+    std::vector<uint32_t> blockReads;
+    uint64_t dataEnd{0};
+    uint64_t nextBlock{0};
     std::vector<refLenType> refLengths;
     std::vector<std::string> refNames;
     std::shared_ptr<spdlog::logger> logger;
@@ -161,7 +271,53 @@ public:
         return readsLeft > 0;
     }
 
+    // the next read of the current v2 block; the block is decoded outside the lock
+    bool nextReadV2(ReadInfo &rinf, std::mutex& iomutex, bool needReadName) {
+        if (blockRead >= block.numReads) {
+            do {
+                if (!pamReader->readChunk(chunk, iomutex))
+                    return false;
+                block.decode(reinterpret_cast<const uint8_t *>(chunk.chunk_.data()), chunk.size(),
+                             pamReader->isPaired);
+            } while (block.numReads == 0);
+            blockRead = blockMapping = blockEnd = 0;
+        }
+        rinf.mappings.clear();
+        if (needReadName) {
+            auto b = block.nameOffsets[blockRead];
+            rinf.rid = block.names.substr(b, block.nameOffsets[blockRead + 1] - b);
+        }
+        uint32_t ends = pamReader->isPaired ? 2 : 1;
+        rinf.cnt = block.mappingCounts[blockRead];
+        rinf.len = block.readLens[blockRead * ends];
+        if (pamReader->isPaired) { rinf.len += block.readLens[blockRead * ends + 1]; }
+        rinf.mappings.reserve(rinf.cnt);
+        for (size_t mappingCntr = 0; mappingCntr < rinf.cnt; mappingCntr++, blockMapping++) {
+            rinf.mappings.emplace_back(block.refIds[blockMapping]);
+            TaxaNode *taxaPtr = &rinf.mappings.back();
+            double score{0.0};
+            // as in v1, an orphan's mapped end is always reported as the LEFT one
+            ReadEnd currRe = ReadEnd::LEFT;
+            for (uint32_t e = 0; e < ends; ++e) {
+                if (block.intervalCounts[blockMapping * ends + e] == 0) { continue; }
+                score += block.scores[blockEnd];
+                taxaPtr->setFw(block.fw[blockEnd], currRe);
+                taxaPtr->setPos(block.positions[blockEnd], currRe);
+                currRe = ReadEnd::RIGHT;
+                ++blockEnd;
+            }
+            taxaPtr->cleanIntervals(ReadEnd::LEFT);
+            taxaPtr->cleanIntervals(ReadEnd::RIGHT);
+            taxaPtr->setScore(score);
+        }
+        ++blockRead;
+        return true;
+    }
+
     bool nextRead(ReadInfo &rinf, std::mutex& iomutex, bool needReadName = false) {
+        if (pamReader->version == 2) {
+            return nextReadV2(rinf, iomutex, needReadName);
+        }
         if (!chunk.hasNext()) {// try to read a new chunk from file
             if (!pamReader->readChunk(chunk, iomutex)) // if nothing left to process return false
                 return false;
@@ -263,6 +419,11 @@ public:
 private:
 
     Chunk chunk;
+    // v2: the decoded block and the read, mapping and mapped end to continue from
+    pam::PAMBlock block;
+    size_t blockRead{0};
+    size_t blockMapping{0};
+    size_t blockEnd{0};
     PAMReader* pamReader;
     std::shared_ptr<spdlog::logger> logger;
     static constexpr const refLenType HighBitMask = 1u << (sizeof(refLenType) * 8 - 1);
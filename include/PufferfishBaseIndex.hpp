@@ -14,6 +14,12 @@
 #include "Util.hpp"
 #include "PufferfishTypes.hpp"
 
+namespace pufferfish {
+namespace hugepages {
+class Advisor;
+}
+}
+
 template <typename T>
 class PufferfishBaseIndex {
     private:
@@ -30,6 +36,10 @@ protected:
       return core::range<std::vector<pufferfish::util::Position>::iterator>(startIt, endIt);
     }
 
+  // For --hugePages: backs the arrays the index lists in listLookupArrays()
+  // with 2MB pages, and reports on the console how much of them got some
+  void adviseHugePages();
+
   using pos_vector_t = compact::vector<uint64_t>;
   using seq_vector_t = compact::vector<uint64_t, 2>;
   using edge_vector_t = compact::vector<uint64_t, 8>;
@@ -55,6 +55,9 @@ private:
   uint64_t numDecoys_{0};
   uint64_t firstDecoyIndex_{0};
 
+  // The arrays a k-mer lookup and the alignment of its hits touch at random
+  void listLookupArrays(pufferfish::hugepages::Advisor& advisor) const;
+
 public:
   PufferfishIndex();
   PufferfishIndex(const std::string& indexPath, pufferfish::util::IndexLoadingOpts opts = pufferfish::util::IndexLoadingOpts());
@@ -58,6 +58,9 @@ private:
   std::unique_ptr<boophf_t> hash_{nullptr};
   boophf_t* hash_raw_{nullptr};
 
+  // The arrays a k-mer lookup and the alignment of its hits touch at random
+  void listLookupArrays(pufferfish::hugepages::Advisor& advisor) const;
+
 public:
   compact::vector<uint64_t, 2> refseq_;
   std::vector<uint64_t> refAccumLengths_;
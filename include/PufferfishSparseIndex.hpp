@@ -90,6 +90,9 @@ private:
   auto getRefPosHelper_(CanonicalKmer& mer, uint64_t pos, bool didWalk = false) -> pufferfish::util::ProjectedHits;
   auto getRefPosHelper_(CanonicalKmer& mer, uint64_t pos, pufferfish::util::QueryCache& qc, bool didWalk = false) -> pufferfish::util::ProjectedHits;
 
+  // The arrays a k-mer lookup and the alignment of its hits touch at random
+  void listLookupArrays(pufferfish::hugepages::Advisor& advisor) const;
+
 };
 
 #endif // _PUFFERFISH_INDEX_HPP_
@@ -0,0 +1,122 @@
+#ifndef __READ_BATCH_MAPPER_HPP__
+#define __READ_BATCH_MAPPER_HPP__
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parallel_hashmap/phmap.h"
+
+#include "FastxParser.hpp"
+#include "PairedReadMapper.hpp"
+#include "ProgOpts.hpp"
+#include "Util.hpp"
+
+namespace pufferfish {
+
+// The mappings of one read pair
+struct MappedPair {
+  // as `pufferfish align` would report them; empty if the pair did not map
+  std::vector<util::QuasiAlignment> alignments;
+  // true if one of the reference filters (--filterGenomics and friends)
+  // dropped the pair; align would not report it at all
+  bool filtered{false};
+};
+
+/**
+ * Maps read pairs held in memory against a loaded index: no command line,
+ * read files or SAM text in between.  The results are the QuasiAlignment
+ * records the SAM / BAM writers are fed with.
+ *
+ * mapBatch() may be called from any number of threads at once; each call
+ * borrows a mapping workspace (MEM collector, chainer, aligner) and gives
+ * it back when the batch is done, so batches of a few hundred pairs or more
+ * keep the per-call overhead negligible.
+ *
+ *   PufferfishIndex index(indexDir);
+ *   pufferfish::AlignmentOpts opts;   // the defaults of `pufferfish align`
+ *   pufferfish::ReadBatchMapper<PufferfishIndex> mapper(index, opts);
+ *   auto mapped = mapper.mapBatch(pairs);
+ **/
+template <typename PufferfishIndexT>
+class ReadBatchMapper {
+public:
+  // Only the mapping parameters of `opts` are used; inputs, outputs and
+  // threads are up to the caller.  The name lists of the filter options are
+  // read here; throws std::runtime_error if one can't be.
+  ReadBatchMapper(PufferfishIndexT& index, const AlignmentOpts& opts) : index_(index), opts_(opts) {
+    if (opts_.filterGenomics or opts_.filterMicrobiomBestScore) { readNames(opts_.genesNamesFile, geneNames_); }
+    if (opts_.filterMicrobiom) { readNames(opts_.rrnaFile, rrnaNames_); }
+  }
+
+  ReadBatchMapper(const ReadBatchMapper&) = delete;
+  ReadBatchMapper& operator=(const ReadBatchMapper&) = delete;
+
+  // The mappings of reads[0 .. numReads), in the same order
+  std::vector<MappedPair> mapBatch(const fastx_parser::ReadPair* reads, size_t numReads) {
+    std::vector<MappedPair> res(numReads);
+    auto mapper = acquire();
+    for (size_t i = 0; i < numReads; ++i) {
+      ++counters_.numReads;
+      if (mapper->map(reads[i].first.seq, reads[i].second.seq, counters_)) {
+        // the mapper clears its list before the next pair
+        res[i].alignments.swap(mapper->jointAlignments());
+      } else {
+        res[i].filtered = true;
+      }
+    }
+    release(std::move(mapper));
+    return res;
+  }
+
+  std::vector<MappedPair> mapBatch(const std::vector<fastx_parser::ReadPair>& reads) {
+    return mapBatch(reads.data(), reads.size());
+  }
+
+  // Totals over every batch mapped so far
+  const util::HitCounters& counters() const { return counters_; }
+  PufferfishIndexT& index() { return index_; }
+
+private:
+  using Workspace = PairedReadMapper<PufferfishIndexT>;
+
+  static void readNames(const std::string& file, phmap::flat_hash_set<std::string>& names) {
+    std::ifstream in(file);
+    if (!in) { throw std::runtime_error("could not read the reference names in " + file); }
+    std::string name;
+    while (in >> name) { names.insert(name.substr(0, name.find_first_of(" \t"))); }
+  }
+
+  std::unique_ptr<Workspace> acquire() {
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      if (!free_.empty()) {
+        auto w = std::move(free_.back());
+        free_.pop_back();
+        return w;
+      }
+    }
+    return std::unique_ptr<Workspace>(new Workspace(&index_, &opts_, geneNames_, rrnaNames_));
+  }
+
+  void release(std::unique_ptr<Workspace> w) {
+    std::lock_guard<std::mutex> l(mutex_);
+    free_.push_back(std::move(w));
+  }
+
+  PufferfishIndexT& index_;
+  const AlignmentOpts opts_;
+  phmap::flat_hash_set<std::string> geneNames_;
+  phmap::flat_hash_set<std::string> rrnaNames_;
+  util::HitCounters counters_;
+  std::mutex mutex_;
+  // workspaces not lent to a mapBatch call at the moment
+  std::vector<std::unique_ptr<Workspace>> free_;
+};
+
+} // namespace pufferfish
+
+#endif // __READ_BATCH_MAPPER_HPP__
@@ -0,0 +1,149 @@
+#ifndef __READ_PAIR_CACHE_HPP__
+#define __READ_PAIR_CACHE_HPP__
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "metro/metrohash64.h"
+#include "parallel_hashmap/phmap.h"
+
+#include "Util.hpp"
+
+// What mapping one read pair adds to the mapping summary, kept so that a
+// pair answered from the ReadPairCache counts just like a mapped one
+struct PairTally {
+  bool anyKmer{false};
+  bool pairedHit{false};
+  bool mapped{false};
+  bool orphan{false};
+  uint32_t peHits{0};
+  uint32_t numHits{0};
+  uint32_t numAlignments{0};
+
+  void addTo(pufferfish::util::HitCounters& hctr) const {
+    hctr.numMappedAtLeastAKmer += anyKmer ? 1 : 0;
+    hctr.peHits += peHits;
+    hctr.totHits += pairedHit ? 1 : 0;
+    hctr.numMapped += mapped ? 1 : 0;
+    hctr.numOfOrphans += orphan ? 1 : 0;
+    if (numHits > hctr.maxMultimapping) { hctr.maxMultimapping = numHits; }
+    hctr.totAlignment += numAlignments;
+  }
+};
+
+/**
+ * Remembers what mapping recently seen read pairs gave, so that exact
+ * duplicates (PCR duplicates, mostly) are not mapped again.  Entries are
+ * found by a hash of both sequences but keep the sequences themselves, and
+ * only a pair with the very same sequences is a hit: the alignments handed
+ * back are the ones mapping the pair again would give.  The names are not
+ * part of an entry; the caller writes the records under the current one.
+ *
+ * A fixed number of slots, recycled least recently used first, bounds the
+ * memory, as in AlignmentLRUCache; a recycled slot keeps its buffers.
+ **/
+class ReadPairCache {
+  static constexpr uint32_t nil = std::numeric_limits<uint32_t>::max();
+
+public:
+  struct Entry {
+    uint64_t key{0};
+    std::string left;
+    std::string right;
+    // one of the reference filters dropped the pair
+    bool filtered{false};
+    PairTally tally;
+    std::vector<pufferfish::util::QuasiAlignment> alignments;
+    uint32_t prev{nil};
+    uint32_t next{nil};
+  };
+
+  void setCapacity(uint32_t capacity) {
+    capacity_ = capacity;
+    entries_.clear();
+    index_.clear();
+    head_ = tail_ = nil;
+    entries_.reserve(capacity_);
+    index_.reserve(capacity_);
+  }
+
+  bool enabled() const { return capacity_ > 0; }
+
+  // returns nullptr on a miss; a hit becomes the most recently used entry
+  const Entry* find(stx::string_view left, stx::string_view right) {
+    auto it = index_.find(keyOf(left, right));
+    if (it == index_.end()) { return nullptr; }
+    uint32_t i = it->second;
+    auto& e = entries_[i];
+    if (stx::string_view(e.left) != left or stx::string_view(e.right) != right) { return nullptr; }
+    if (i != head_) { unlink(i); pushFront(i); }
+    return &e;
+  }
+
+  // The slot for (left, right), for the caller to fill in the rest of; the
+  // least recently used entry makes room if the cache is full
+  Entry& insert(stx::string_view left, stx::string_view right) {
+    uint64_t key = keyOf(left, right);
+    uint32_t i;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      // the same pair, or one whose hash collides with it
+      i = it->second;
+      unlink(i);
+    } else if (entries_.size() < capacity_) {
+      i = static_cast<uint32_t>(entries_.size());
+      entries_.emplace_back();
+      index_[key] = i;
+    } else {
+      i = tail_;
+      unlink(i);
+      index_.erase(entries_[i].key);
+      index_[key] = i;
+    }
+    auto& e = entries_[i];
+    e.key = key;
+    e.left.assign(left.data(), left.size());
+    e.right.assign(right.data(), right.size());
+    pushFront(i);
+    return e;
+  }
+
+private:
+  static uint64_t keyOf(stx::string_view left, stx::string_view right) {
+    MetroHash64 hasher;
+    hasher.Initialize(0);
+    // the length keeps the split between the mates part of the key
+    uint64_t leftLen = left.length();
+    hasher.Update(reinterpret_cast<const uint8_t*>(&leftLen), sizeof(leftLen));
+    hasher.Update(reinterpret_cast<const uint8_t*>(left.data()), left.length());
+    hasher.Update(reinterpret_cast<const uint8_t*>(right.data()), right.length());
+    uint64_t key{0};
+    hasher.Finalize(reinterpret_cast<uint8_t*>(&key));
+    return key;
+  }
+
+  void unlink(uint32_t i) {
+    auto& e = entries_[i];
+    if (e.prev != nil) { entries_[e.prev].next = e.next; } else { head_ = e.next; }
+    if (e.next != nil) { entries_[e.next].prev = e.prev; } else { tail_ = e.prev; }
+    e.prev = e.next = nil;
+  }
+
+  void pushFront(uint32_t i) {
+    auto& e = entries_[i];
+    e.prev = nil;
+    e.next = head_;
+    if (head_ != nil) { entries_[head_].prev = i; }
+    head_ = i;
+    if (tail_ == nil) { tail_ = i; }
+  }
+
+  uint32_t capacity_{0};
+  uint32_t head_{nil};
+  uint32_t tail_{nil};
+  std::vector<Entry> entries_;
+  phmap::flat_hash_map<uint64_t, uint32_t> index_;
+};
+
+#endif // __READ_PAIR_CACHE_HPP__
@@ -0,0 +1,172 @@
+#ifndef __READ_SCREENER_HPP__
+#define __READ_SCREENER_HPP__
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MappingWorkspace.hpp"
+#include "ProgOpts.hpp"
+#include "PuffAligner.hpp"
+#include "SelectiveAlignmentUtils.hpp"
+#include "Util.hpp"
+
+/**
+ * The mapping behind --screen: it only has to tell whether a read (pair)
+ * aligns well enough to some reference, not where or how well it aligns
+ * best.  The candidates left after chaining and joining the mates are
+ * aligned best chain first, scores only, and the first one that reaches
+ * the threshold ends the search; no CIGAR or record is ever built.
+ *
+ * A read is classified if one candidate scores at least --screenMinScore
+ * on top of passing --minScoreFraction; with --screenDecoys only the
+ * candidates on decoy references count.  One instance per thread.
+ **/
+template <typename PufferfishIndexT>
+class ReadScreener {
+public:
+  ReadScreener(PufferfishIndexT* pfi, const pufferfish::AlignmentOpts* mopts)
+      : pfi_(pfi), mopts_(mopts), ws_(pfi, mopts, screenConfig(mopts)) {}
+
+  ReadScreener(const ReadScreener&) = delete;
+  ReadScreener& operator=(const ReadScreener&) = delete;
+
+  // Does the pair (left, right) align well enough somewhere?  The mates may
+  // be views into the parser's buffers; they are only copied once orphan
+  // recovery or alignment needs them, so pairs without chains never are.
+  bool pairMatches(stx::string_view left, stx::string_view right, pufferfish::util::HitCounters& hctr) {
+    using pufferfish::util::MateStatus;
+    bool loaded{false};
+    auto load = [&]() {
+      if (loaded) { return; }
+      left_.assign(left.data(), left.size());
+      right_.assign(right.data(), right.size());
+      loaded = true;
+    };
+    jointHits_.clear();
+    leftHits_.clear();
+    rightHits_.clear();
+    recoveredHits_.clear();
+    ws_.memCollector.clear();
+
+    ws_.memCollector(left, ws_.qc, true, false);
+    ws_.memCollector(right, ws_.qc, false, false);
+    ws_.memCollector.findChains(left, leftHits_, mopts_->maxSpliceGap, MateStatus::PAIRED_END_LEFT,
+                                mopts_->heuristicChaining, true, false);
+    ws_.memCollector.findChains(right, rightHits_, mopts_->maxSpliceGap, MateStatus::PAIRED_END_RIGHT,
+                                mopts_->heuristicChaining, false, false);
+    hctr.numMappedAtLeastAKmer += (leftHits_.size() > 0 || rightHits_.size() > 0) ? 1 : 0;
+
+    uint32_t totLen = static_cast<uint32_t>(left.length() + right.length());
+    auto mergeRes = pufferfish::util::joinReadsAndFilter(leftHits_, rightHits_, jointHits_,
+                                                         mopts_->maxFragmentLength, totLen,
+                                                         mopts_->scoreRatio, pfi_->firstDecoyIndex(),
+                                                         ws_.mpol, hctr);
+    bool mergeStatusOR = (mergeRes == pufferfish::util::MergeResult::HAD_EMPTY_INTERSECTION or
+                          mergeRes == pufferfish::util::MergeResult::HAD_ONLY_LEFT or
+                          mergeRes == pufferfish::util::MergeResult::HAD_ONLY_RIGHT);
+    if (mopts_->recoverOrphans and mergeStatusOR) {
+      load();
+      selective_alignment::utils::recoverOrphans(left_, right_, recoveredHits_, jointHits_, ws_.puffaligner, false);
+    }
+    hctr.peHits += jointHits_.size();
+
+    bool isMultimapping = (jointHits_.size() > 1);
+    return firstGoodHit(hctr, [&](pufferfish::util::JointMems& jointHit) {
+      load();
+      return ws_.puffaligner.calculateAlignments(left_, right_, jointHit, hctr, isMultimapping, false);
+    });
+  }
+
+  // Does the single-end read align well enough somewhere?  As for pairs, the
+  // read is only copied once a candidate is aligned.
+  bool readMatches(stx::string_view read, pufferfish::util::HitCounters& hctr) {
+    using pufferfish::util::MateStatus;
+    bool loaded{false};
+    jointHits_.clear();
+    leftHits_.clear();
+    ws_.memCollector.clear();
+
+    ws_.memCollector(read, ws_.qc, true, false);
+    ws_.memCollector.findChains(read, leftHits_, mopts_->maxSpliceGap, MateStatus::SINGLE_END,
+                                mopts_->heuristicChaining, true, false);
+    hctr.numMappedAtLeastAKmer += leftHits_.size() > 0 ? 1 : 0;
+    pufferfish::util::joinReadsAndFilterSingle(leftHits_, jointHits_, static_cast<uint32_t>(read.length()),
+                                               mopts_->scoreRatio);
+    hctr.seHits += jointHits_.size();
+
+    bool isMultimapping = (jointHits_.size() > 1);
+    return firstGoodHit(hctr, [&](pufferfish::util::JointMems& jointHit) {
+      if (!loaded) {
+        left_.assign(read.data(), read.size());
+        loaded = true;
+      }
+      return ws_.puffaligner.calculateAlignments(left_, jointHit, hctr, isMultimapping, false);
+    });
+  }
+
+  // The counters of this screener's buffers, added once it is done with its reads
+  void addWorkspaceStats(pufferfish::util::HitCounters& hctr) { ws_.addStats(hctr); }
+
+private:
+  static pufferfish::util::AlignmentConfig screenConfig(const pufferfish::AlignmentOpts* mopts) {
+    auto config = MappingWorkspace<PufferfishIndexT>::alignmentConfig(mopts);
+    // candidates are aligned one at a time so that the search can stop early
+    config.batchAlignment = false;
+    return config;
+  }
+
+  // Aligns the candidates in jointHits_, best chain first, until one of them
+  // reaches the screening threshold
+  template <typename AlignFun>
+  bool firstGoodHit(pufferfish::util::HitCounters& hctr, AlignFun align) {
+    constexpr const int32_t invalidScore = std::numeric_limits<int32_t>::min();
+    if (mopts_->screenDecoys) {
+      auto pfi = pfi_;
+      jointHits_.erase(std::remove_if(jointHits_.begin(), jointHits_.end(),
+                                      [pfi](const pufferfish::util::JointMems& h) { return !pfi->isDecoy(h.tid); }),
+                       jointHits_.end());
+    }
+    if (jointHits_.empty()) { return false; }
+    if (mopts_->justMap) {
+      // a chain is all --just-mapping asks for
+      ++hctr.numMapped;
+      return true;
+    }
+
+    // best chain first; ties keep the order the chainer produced them in
+    order_.clear();
+    for (size_t i = 0; i < jointHits_.size(); ++i) { order_.emplace_back(-jointHits_[i].coverage(), i); }
+    std::sort(order_.begin(), order_.end());
+    ws_.puffaligner.clear();
+    for (size_t i = 0; i < order_.size(); ++i) {
+      int32_t score = align(jointHits_[order_[i].second]);
+      if (score != invalidScore and score >= mopts_->screenMinScore) {
+        ++hctr.numMapped;
+        hctr.screenSkippedCandidates += order_.size() - i - 1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  PufferfishIndexT* pfi_;
+  const pufferfish::AlignmentOpts* mopts_;
+
+  MappingWorkspace<PufferfishIndexT> ws_;
+  // the reads being screened, for the code that needs std::string; they keep
+  // their capacity from read to read
+  std::string left_;
+  std::string right_;
+
+  pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>> leftHits_;
+  pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>> rightHits_;
+  std::vector<pufferfish::util::MemCluster> recoveredHits_;
+  std::vector<pufferfish::util::JointMems> jointHits_;
+  // (-coverage, index into jointHits_) of each candidate
+  std::vector<std::pair<double, size_t>> order_;
+};
+
+#endif // __READ_SCREENER_HPP__
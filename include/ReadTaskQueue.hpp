@@ -0,0 +1,163 @@
+#ifndef __READ_TASK_QUEUE_HPP__
+#define __READ_TASK_QUEUE_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "FastxParser.hpp"
+
+/**
+ * Hands the mapping threads reads in tasks much smaller than the parser's
+ * chunks.  A chunk is split lazily: each refill claims the next run of reads
+ * from the chunk at the head, sized so that it is about `targetTaskTime` of
+ * work at the recent cost per read.  A run of repetitive, expensive reads
+ * therefore gets spread over all the threads instead of keeping one thread
+ * busy long after the others ran out of input.  A chunk goes back to the
+ * parser once every task taken from it is done.
+ *
+ * It stands in for the parser in the mapping threads (getReadGroup / refill,
+ * and OutputRing::nextChunk); tasks are handed out in input order, so
+ * ordered output keeps working.
+ **/
+template <typename T>
+class ReadTaskQueue {
+  struct Slot {
+    explicit Slot(fastx_parser::ReadGroup<T>&& g) : rg(std::move(g)) {}
+    fastx_parser::ReadGroup<T> rg;
+    // reads [0, next) have been handed out
+    size_t next{0};
+    // tasks handed out and not done yet
+    size_t pending{0};
+  };
+
+public:
+  using clock = std::chrono::steady_clock;
+  using iterator = typename std::vector<T>::iterator;
+  static constexpr std::chrono::milliseconds targetTaskTime{5};
+  static constexpr size_t minTaskSize{8};
+
+  // The reads of one task
+  class TaskGroup {
+  public:
+    iterator begin() { return slot_->rg.begin() + begin_; }
+    iterator end() { return slot_->rg.begin() + end_; }
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return slot_ == nullptr; }
+
+  private:
+    friend class ReadTaskQueue;
+    Slot* slot_{nullptr};
+    size_t begin_{0};
+    size_t end_{0};
+    clock::time_point claimedAt_;
+  };
+
+  // numWorkers: the most tasks that can be held at once
+  ReadTaskQueue(fastx_parser::FastxParser<T>* parser, uint32_t numWorkers) : parser_(parser) {
+    // a chunk is in flight only while some worker holds one of its tasks,
+    // plus the one being split; so there is always a free slot to refill
+    for (uint32_t i = 0; i < numWorkers + 1; ++i) {
+      slots_.emplace_back(new Slot(parser_->getReadGroup()));
+      free_.push_back(slots_.back().get());
+    }
+  }
+
+  TaskGroup getReadGroup() { return TaskGroup(); }
+
+  bool refill(TaskGroup& g) {
+    finishedWithGroup(g);
+    auto waitStart = clock::now();
+    clock::duration inParser{0};
+    bool got{false};
+    while (true) {
+      {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (claim(g)) {
+          got = true;
+          break;
+        }
+        if (parserDone_) { break; }
+      }
+      // only one thread at a time takes a new chunk; the rest wait for it
+      std::lock_guard<std::mutex> rl(refillMutex_);
+      Slot* s{nullptr};
+      {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (parserDone_ or (head_ and head_->next < head_->rg.size())) { continue; }
+        s = free_.back();
+        free_.pop_back();
+      }
+      auto parserStart = clock::now();
+      bool more = parser_->refill(s->rg);
+      inParser += clock::now() - parserStart;
+      std::lock_guard<std::mutex> l(mutex_);
+      if (more) {
+        s->next = 0;
+        head_ = s;
+      } else {
+        parserDone_ = true;
+        free_.push_back(s);
+      }
+    }
+    // the parser has counted its own share of the wait
+    parser_->monitor().consumerWaited(clock::now() - waitStart - inParser);
+    return got;
+  }
+
+  void finishedWithGroup(TaskGroup& g) {
+    if (g.empty()) { return; }
+    parser_->monitor().chunkConsumed(g.size(), clock::now() - g.claimedAt_);
+    std::lock_guard<std::mutex> l(mutex_);
+    Slot* s = g.slot_;
+    g.slot_ = nullptr;
+    if (--s->pending == 0 and s->next == s->rg.size()) { release(s); }
+  }
+
+private:
+  // the next task from the head chunk, if it has reads left; called with mutex_ held
+  bool claim(TaskGroup& g) {
+    if (head_ == nullptr or head_->next == head_->rg.size()) { return false; }
+    size_t n = taskSize();
+    g.slot_ = head_;
+    g.begin_ = head_->next;
+    g.end_ = std::min(head_->next + n, head_->rg.size());
+    g.claimedAt_ = clock::now();
+    head_->next = g.end_;
+    ++head_->pending;
+    return true;
+  }
+
+  size_t taskSize() const {
+    double perRead = parser_->monitor().timePerReadNs();
+    if (perRead <= 0) { return minTaskSize; }
+    double target = std::chrono::duration<double, std::nano>(targetTaskTime).count();
+    return std::max(static_cast<size_t>(target / perRead), minTaskSize);
+  }
+
+  // give a finished chunk back to the parser; called with mutex_ held
+  void release(Slot* s) {
+    if (s == head_) { head_ = nullptr; }
+    parser_->finishedWithGroup(s->rg);
+    free_.push_back(s);
+  }
+
+  fastx_parser::FastxParser<T>* parser_;
+  std::vector<std::unique_ptr<Slot>> slots_;
+  std::vector<Slot*> free_;
+  // the chunk tasks are being split from
+  Slot* head_{nullptr};
+  bool parserDone_{false};
+  std::mutex mutex_;
+  std::mutex refillMutex_;
+};
+
+template <typename T>
+constexpr std::chrono::milliseconds ReadTaskQueue<T>::targetTaskTime;
+template <typename T>
+constexpr size_t ReadTaskQueue<T>::minTaskSize;
+
+#endif // __READ_TASK_QUEUE_HPP__
@@ -7,6 +7,7 @@
 #include "PufferfishSparseIndex.hpp"
 #include "Util.hpp"
 #include "BinWriter.hpp"
+#include "PAMFormat.hpp"
 #include "parallel_hashmap/phmap.h"
 #include "nonstd/string_view.hpp"
 
@@ -145,11 +146,10 @@ inline void writeSAMHeader(IndexT& pfi, std::ostream& outStream) {
 }
 
 template <typename IndexT>
-inline void writeSAMHeader(IndexT& pfi, std::shared_ptr<spdlog::logger> out,
+inline void formatSAMHeader(IndexT& pfi, fmt::MemoryWriter& hd,
         bool filterGenomics,
-        phmap::flat_hash_set<std::string> gene_names,
-        phmap::flat_hash_set<std::string> rrna_names) {
-  fmt::MemoryWriter hd;
+        const phmap::flat_hash_set<std::string>& gene_names,
+        const phmap::flat_hash_set<std::string>& rrna_names) {
   hd.write("@HD\tVN:1.0\tSO:unknown\n");
 
   auto& txpNames = pfi.getFullRefNames();
@@ -169,8 +169,16 @@ inline void writeSAMHeader(IndexT& pfi, std::shared_ptr<spdlog::logger> out,
   // Eventually output a @PG line
   // some other version number for now,
   // will think about it later
-  std::string version = "1.0.0";
   hd.write("@PG\tID:pufferfish\tPN:pufferfish\tVN:{}\n", pufferfish::version);
+}
+
+template <typename IndexT>
+inline void writeSAMHeader(IndexT& pfi, std::shared_ptr<spdlog::logger> out,
+        bool filterGenomics,
+        const phmap::flat_hash_set<std::string>& gene_names,
+        const phmap::flat_hash_set<std::string>& rrna_names) {
+  fmt::MemoryWriter hd;
+  formatSAMHeader(pfi, hd, filterGenomics, gene_names, rrna_names);
   std::string headerStr(hd.str());
   // Don't include the last '\n', since the logger will do it for us.
   headerStr.pop_back();
@@ -372,102 +380,184 @@ inline uint32_t writeAlignmentsToKrakenDump(ReadT& r,
 
 }
 
+
+/**
+ * The fields of one SAM line, as the alignment writers below fill them in.
+ * emitSAMRecord turns a record into text; BAMWriter.hpp provides an overload
+ * that encodes the same record as BAM, so both formats come from one place.
+ **/
+struct SAMRecord {
+  fmt::StringRef qname{""};
+  uint16_t flag{0};
+  // nullptr for '*'; otherwise an entry of the index's full reference names
+  const std::string* refName{nullptr};
+  // 0-based; -1 when there is none
+  int32_t pos{-1};
+  uint8_t mapq{255};
+  fmt::StringRef cigar{"*"};
+  // RNEXT is '=' when set, '*' otherwise
+  bool mateOnSameRef{false};
+  int32_t matePos{-1};
+  int32_t tlen{0};
+  const std::string* seq{nullptr};
+  size_t numHits{0};
+  size_t hitIndex{0};
+  int32_t score{0};
+};
+
+inline void emitSAMRecord(fmt::MemoryWriter& sstream, const SAMRecord& rec) {
+  sstream << rec.qname << '\t'                                  // QNAME
+          << rec.flag << '\t';                                  // FLAGS
+  if (rec.refName) {
+    sstream << *rec.refName << '\t';                            // RNAME
+  } else {
+    sstream << "*\t";
+  }
+  sstream << rec.pos + 1 << '\t'                                // POS (1-based)
+          << static_cast<uint32_t>(rec.mapq) << '\t'            // MAPQ
+          << rec.cigar << '\t'                                  // CIGAR
+          << (rec.mateOnSameRef ? '=' : '*') << '\t'            // RNEXT
+          << rec.matePos + 1 << '\t'                            // PNEXT
+          << rec.tlen << '\t'                                   // TLEN
+          << *rec.seq << '\t'                                   // SEQ
+          << "*\t"                                              // QUAL
+          << "NH:i:" << rec.numHits << '\t'
+          << "HI:i:" << rec.hitIndex << '\t'
+          << "AS:i:" << rec.score << '\n';
+}
+
+// The first whitespace-delimited word of a read name, without a trailing /1 or /2
+inline fmt::StringRef pairedReadName(const std::string& name) {
+  nonstd::string_view readNameView(name);
+  // If the read name contains multiple space-separated parts,
+  // print only the first
+  size_t splitPos = readNameView.find(' ');
+  if (splitPos < readNameView.length()) {
+    readNameView.remove_suffix(readNameView.length() - splitPos);
+  } else {
+    splitPos = readNameView.length();
+  }
+
+  // trim /1 from the pe read
+  if (splitPos > 2 and readNameView[splitPos - 2] == '/') {
+    readNameView.remove_suffix(2);
+  }
+  return fmt::StringRef(readNameView.data(), readNameView.size());
+}
+
+// The first whitespace-delimited word of a read name
+inline fmt::StringRef singleReadName(const std::string& name) {
+  nonstd::string_view readNameViewSV(name);
+  // If the read name contains multiple space-separated parts, print
+  // only the first
+  size_t splitPos = readNameViewSV.find(' ');
+  if (splitPos < readNameViewSV.length()) {
+    readNameViewSV.remove_suffix(readNameViewSV.size() - splitPos);
+  }
+  return fmt::StringRef(readNameViewSV.data(), readNameViewSV.size());
+}
+
+// The name v1 dumps record: the first word, without a trailing /1 or /2
+inline stx::string_view dumpReadName(const std::string& name) {
+  auto n = pairedReadName(name);
+  return stx::string_view(n.data(), n.size());
+}
+
+// The same mappings as writeAlignmentsToKrakenDump (paired end), added to a v2 block
+template <typename ReadT , typename IndexT >
+inline uint32_t addAlignmentsToPAMBlock(ReadT& r,
+                                   PairedAlignmentFormatter<IndexT>& formatter,
+                                   std::vector<pufferfish::util::JointMems>& validJointHits,
+                                   pam::PAMBlockBuilder& block,
+                                   bool justMap) {
+  if (validJointHits.empty()) return 0;
+  block.beginRead(dumpReadName(r.first.name), static_cast<uint32_t>(validJointHits.size()),
+                  r.first.seq.length(), r.second.seq.length());
+  for (auto& qa : validJointHits) {
+    pam::MappedEnd left, right;
+    auto& clustLeft = qa.leftClust;
+    auto& clustRight = qa.rightClust;
+    if (qa.isLeftAvailable()) {
+      left.available = true;
+      left.numIntervals = static_cast<uint32_t>(clustLeft->mems.size());
+      left.score = justMap ? qa.alignmentScore : clustLeft->coverage;
+      left.pos = clustLeft->getTrFirstHitPos() < 0 ? 0 : clustLeft->getTrFirstHitPos();
+      left.fw = clustLeft->isFw;
+    }
+    if (qa.isRightAvailable()) {
+      right.available = true;
+      right.numIntervals = static_cast<uint32_t>(clustRight->mems.size());
+      right.score = justMap ? qa.mateAlignmentScore : clustRight->coverage;
+      right.pos = clustRight->getTrFirstHitPos() < 0 ? 0 : clustRight->getTrFirstHitPos();
+      right.fw = clustRight->isFw;
+    }
+    block.addMapping(static_cast<uint32_t>(formatter.index->getRefId(qa.tid)), left, right);
+    if (qa.isLeftAvailable()) {
+      for (auto& mem : clustLeft->mems) { block.addInterval(mem.rpos, mem.extendedlen); }
+    }
+    if (qa.isRightAvailable()) {
+      for (auto& mem : clustRight->mems) { block.addInterval(mem.rpos, mem.extendedlen); }
+    }
+  }
+  return 0;
+}
+
+// The same mappings as writeAlignmentsToKrakenDump (single end), added to a v2 block
+template <typename ReadT , typename IndexT >
+inline uint32_t addAlignmentsToPAMBlock(ReadT& r,
+                                   PairedAlignmentFormatter<IndexT>& formatter,
+                                   std::vector<std::pair<uint32_t, std::vector<pufferfish::util::MemCluster>::iterator>>& validHits,
+                                   pam::PAMBlockBuilder& block) {
+  if (validHits.empty()) return 0;
+  block.beginRead(dumpReadName(r.name), static_cast<uint32_t>(validHits.size()), r.seq.length());
+  for (auto& qa : validHits) {
+    auto& clust = qa.second;
+    pam::MappedEnd end;
+    end.available = true;
+    end.numIntervals = static_cast<uint32_t>(clust->mems.size());
+    end.score = clust->coverage;
+    end.pos = clust->getTrFirstHitPos() < 0 ? 0 : clust->getTrFirstHitPos();
+    end.fw = clust->isFw;
+    block.addMapping(static_cast<uint32_t>(formatter.index->getRefId(qa.first)), end);
+    for (auto& mem : clust->mems) { block.addInterval(mem.rpos, mem.extendedlen); }
+  }
+  return 0;
+}
+
+template <typename OutT>
 inline uint32_t writeUnalignedPairToStream(fastx_parser::ReadPair& r,
-                                          fmt::MemoryWriter& sstream) {
+                                          OutT& sstream) {
         constexpr uint16_t flags1 = 0x1 | 0x4 | 0x8 | 0x40;
         constexpr uint16_t flags2 = 0x1 | 0x4 | 0x8 | 0x80;
 
-        auto processReadName = [](const std::string& name) -> fmt::StringRef {
-                                 nonstd::string_view readNameView(name);
-                                 // If the read name contains multiple space-separated parts,
-                                 // print only the first
-                                 size_t splitPos = readNameView.find(' ');
-                                 if (splitPos < readNameView.length()) {
-                                   readNameView.remove_suffix(readNameView.length() - splitPos);
-                                 } else {
-                                   splitPos = readNameView.length();
-                                 }
-
-                                 // trim /1 from the pe read
-                                 if (splitPos > 2 and readNameView[splitPos - 2] == '/') {
-                                   readNameView.remove_suffix(2);
-                                   //readName[splitPos - 2] = '\0';
-                                 }
-                                 return fmt::StringRef(readNameView.data(), readNameView.size());
-                               };
-
-        auto readNameView = processReadName(r.first.name);
-        auto mateNameView = processReadName(r.second.name);
-        std::string* readSeq1 = &(r.first.seq);
-        std::string* readSeq2 = &(r.second.seq);
-
-        sstream << readNameView << '\t' // QNAME
-                << flags1 << '\t'       // FLAGS
-                << "*\t"                // RNAME
-                << "0\t"                // POS (1-based)
-                << "255\t"              // MAPQ
-                << "*\t"                // CIGAR
-                << "*\t"                // RNEXT
-                << "0\t"                // PNEXT
-                << "0\t"                // TLEN
-                << *readSeq1 << '\t'    // SEQ
-                << "*\t"                // QUAL
-                << "NH:i:0\t"
-                << "HI:i:0\t"
-                << "AS:i:0\n";
-
-        sstream << mateNameView << '\t' // QNAME
-                << flags2 << '\t'       // FLAGS
-                << "*\t"                // RNAME
-                << "0\t"                // POS (1-based)
-                << "255\t"              // MAPQ
-                << "*\t"                // CIGAR
-                << "*\t"                // RNEXT
-                << "0\t"                // PNEXT
-                << "0\t"                // TLEN
-                << *readSeq2 << '\t'    // SEQ
-                << "*\t"                // QUAL
-                << "NH:i:0\t"
-                << "HI:i:0\t"
-                << "AS:i:0\n";
+        SAMRecord rec;
+        rec.qname = pairedReadName(r.first.name);
+        rec.flag = flags1;
+        rec.seq = &(r.first.seq);
+        emitSAMRecord(sstream, rec);
+
+        rec.qname = pairedReadName(r.second.name);
+        rec.flag = flags2;
+        rec.seq = &(r.second.seq);
+        emitSAMRecord(sstream, rec);
         return 0;
       }
 
+template <typename OutT>
 inline uint32_t writeUnalignedSingleToStream(fastx_parser::ReadSeq& r,
-                                            fmt::MemoryWriter& sstream) {
-        constexpr uint16_t flags = 0x4;
-
-        nonstd::string_view readNameViewSV(r.name);
-        // If the read name contains multiple space-separated parts, print
-        // only the first
-        size_t splitPos = readNameViewSV.find(' ');
-        if (splitPos < readNameViewSV.length()) {
-          readNameViewSV.remove_suffix(readNameViewSV.size() - splitPos);
-        }
-        fmt::StringRef readNameView(readNameViewSV.data(), readNameViewSV.size());
-        std::string* readSeq = &(r.seq);
-
-        sstream << readNameView << '\t' // QNAME
-                << flags << '\t'    // FLAGS
-                << "*\t"            // RNAME
-                << 0 << '\t'        // POS (1-based)
-                << 255 << '\t'      // MAPQ
-                << "*\t"            // CIGAR
-                << "*\t"            // MATE NAME
-                << "0\t"            // MATE POS
-                << "0\t"            // TLEN
-                << *readSeq << '\t' // SEQ
-                << "*\t"            // QSTR
-                << "NH:i:0\t"
-                << "HI:i:0\t"
-                << "AS:i:0\n";
+                                            OutT& sstream) {
+        SAMRecord rec;
+        rec.qname = singleReadName(r.name);
+        rec.flag = 0x4;
+        rec.seq = &(r.seq);
+        emitSAMRecord(sstream, rec);
         return 0;
       }
 
-template <typename ReadT, typename IndexT>
+template <typename ReadT, typename IndexT, typename OutT>
 inline uint32_t writeAlignmentsToStreamSingle(
     ReadT& r, PairedAlignmentFormatter<IndexT>& formatter,
-    std::vector<pufferfish::util::QuasiAlignment>& jointHits, fmt::MemoryWriter& sstream, bool writeOrphans, 
+    std::vector<pufferfish::util::QuasiAlignment>& jointHits, OutT& sstream, bool writeOrphans,
     bool tidsAlreadyDecoded = false) {
   (void) writeOrphans;
 
@@ -477,17 +567,9 @@ inline uint32_t writeAlignmentsToStreamSingle(
 
   uint16_t flags;
 
-  nonstd::string_view readNameViewSV(r.name);
-
-  // If the read name contains multiple space-separated parts, print
-  // only the first
-  size_t splitPos = readNameViewSV.find(' ');
-  if (splitPos < readNameViewSV.length()) {
-    readNameViewSV.remove_suffix(readNameViewSV.size() - splitPos);
-  }
-  fmt::StringRef readNameView(readNameViewSV.data(), readNameViewSV.size());
-
-  std::string numHitFlag = fmt::format("NH:i:{}", jointHits.size());
+  SAMRecord rec;
+  rec.qname = singleReadName(r.name);
+  rec.numHits = jointHits.size();
   uint32_t alnCtr{0};
   bool haveRev{false};
   size_t i{0};
@@ -518,29 +600,25 @@ inline uint32_t writeAlignmentsToStreamSingle(
 
       adjustOverhang(qa.pos, qa.readLen, txpLen, cigarStr);
 
-      sstream << readNameView << '\t' // QNAME
-              << flags << '\t' // FLAGS
-              << refName << '\t' // RNAME
-              << qa.pos + 1 << '\t' // POS (1-based)
-              << 255 << '\t' // MAPQ
-              << (qa.cigar.empty() ? cigarStr.c_str() : qa.cigar) << '\t' // CIGAR
-              << '*' << '\t' // MATE NAME
-              << 0 << '\t' // MATE POS
-              << qa.fragLen << '\t' // TLEN
-              << *readSeq << '\t' // SEQ
-              << "*\t" // QSTR
-              << numHitFlag << '\t'
-              << "HI:i:" << i << '\t'
-              << "AS:i:" << qa.score << '\n';
+      rec.flag = flags;
+      rec.refName = &refName;
+      rec.pos = qa.pos;
+      rec.mapq = 255;
+      rec.cigar = qa.cigar.empty() ? fmt::StringRef(cigarStr.c_str()) : fmt::StringRef(qa.cigar);
+      rec.tlen = static_cast<int32_t>(qa.fragLen);
+      rec.seq = readSeq;
+      rec.hitIndex = i;
+      rec.score = qa.score;
+      emitSAMRecord(sstream, rec);
     ++alnCtr;
   }
   return 0;
 }
 
-template <typename ReadPairT, typename IndexT>
+template <typename ReadPairT, typename IndexT, typename OutT>
 inline uint32_t writeAlignmentsToStream(
     ReadPairT& r, PairedAlignmentFormatter<IndexT>& formatter,
-    std::vector<pufferfish::util::QuasiAlignment>& jointHits, fmt::MemoryWriter& sstream,
+    std::vector<pufferfish::util::QuasiAlignment>& jointHits, OutT& sstream,
     bool writeOrphans,
     bool tidsAlreadyDecoded = false) {
 
@@ -551,34 +629,17 @@ inline uint32_t writeAlignmentsToStream(
 
   uint16_t flags1, flags2;
 
-  auto processReadName = [](const std::string& name) -> fmt::StringRef {
-                           nonstd::string_view readNameView(name);
-                           // If the read name contains multiple space-separated parts,
-                           // print only the first
-                           size_t splitPos = readNameView.find(' ');
-                           if (splitPos < readNameView.length()) {
-                             readNameView.remove_suffix(readNameView.length() - splitPos);
-                           } else {
-                             splitPos = readNameView.length();
-                           }
-
-                           // trim /1 from the pe read
-                           if (splitPos > 2 and readNameView[splitPos - 2] == '/') {
-                             readNameView.remove_suffix(2);
-                             //readName[splitPos - 2] = '\0';
-                           }
-                           return fmt::StringRef(readNameView.data(), readNameView.size());
-                         };
-
-  auto readNameView = processReadName(r.first.name);
-  auto mateNameView = processReadName(r.second.name);
+  auto readNameView = pairedReadName(r.first.name);
+  auto mateNameView = pairedReadName(r.second.name);
 
   cigarStr1.clear();
   cigarStr2.clear();
   cigarStr1.write("{}M", r.first.seq.length());
   cigarStr2.write("{}M", r.second.seq.length());
 
-  std::string numHitFlag = fmt::format("NH:i:{}", jointHits.size());
+  SAMRecord rec;
+  rec.numHits = jointHits.size();
+  rec.mateOnSameRef = true;
   uint32_t alnCtr{0};
   // uint32_t trueHitCtr{0};
   // pufferfish::util::QuasiAlignment* firstTrueHit{nullptr};
@@ -594,6 +655,8 @@ inline uint32_t writeAlignmentsToStream(
     ++i;
     auto& refName = tidsAlreadyDecoded ? (*fullRefNames)[qa.tid] : formatter.index->refName(qa.tid);
     uint32_t txpLen = tidsAlreadyDecoded ? (*fullRefLengths)[qa.tid] : formatter.index->refLength(qa.tid);
+    rec.refName = &refName;
+    rec.hitIndex = i;
     // === SAM
     if (qa.isPaired) {
       getSamFlags(qa, true, flags1, flags2);
@@ -638,43 +701,26 @@ inline uint32_t writeAlignmentsToStream(
       // get the fragment length as a signed int
       const int32_t fragLen = static_cast<int32_t>(qa.fragLen);
 
-      std::stringstream ss;
-
-      sstream << readNameView << '\t'                    // QNAME
-              //<< qa.numHits << '\t'
-              << flags1 << '\t'                              // FLAGS
-              << refName << '\t'                             // RNAME
-              << qa.pos + 1 << '\t'                          // POS (1-based)
-              << 1 << '\t'                                   // MAPQ
-              << (qa.cigar.empty() ? cigarStr1.c_str() : qa.cigar) << '\t'                   // CIGAR
-              //<< "100M" << '\t'
-              //<< qa.cigar << '\t'                   // CIGAR
-              << '=' << '\t'                                 // RNEXT
-              << qa.matePos + 1 << '\t'                      // PNEXT
-              << ((read1First) ? fragLen : -fragLen) << '\t' // TLEN
-              << *readSeq1 << '\t'                           // SEQ
-              << "*\t"                                       // QUAL
-              << numHitFlag << '\t'
-              << "HI:i:" << i << '\t'
-              << "AS:i:" << qa.score << '\n';
-
-      sstream << mateNameView << '\t'                    // QNAME
-              //<< qa.numHits << '\t'
-              << flags2 << '\t'                              // FLAGS
-              << refName << '\t'                             // RNAME
-              << qa.matePos + 1 << '\t'                      // POS (1-based)
-              << 1 << '\t'                                   // MAPQ
-              << (qa.mateCigar.empty() ? cigarStr2.c_str() : qa.mateCigar) << '\t'                   // CIGAR
-              //<< "100M" << '\t'
-              //<< qa.mateCigar << '\t'                   // CIGAR
-              << '=' << '\t'                                 // RNEXT
-              << qa.pos + 1 << '\t'                          // PNEXT
-              << ((read1First) ? -fragLen : fragLen) << '\t' // TLEN
-              << *readSeq2 << '\t'                           // SEQ
-              << "*\t"                                       // QUAL
-              << numHitFlag << '\t'
-              << "HI:i:" << i << '\t'
-              << "AS:i:" << qa.mateScore << '\n';
+      rec.qname = readNameView;
+      rec.flag = flags1;
+      rec.pos = qa.pos;
+      rec.mapq = 1;
+      rec.cigar = qa.cigar.empty() ? fmt::StringRef(cigarStr1.c_str()) : fmt::StringRef(qa.cigar);
+      rec.matePos = qa.matePos;
+      rec.tlen = read1First ? fragLen : -fragLen;
+      rec.seq = readSeq1;
+      rec.score = qa.score;
+      emitSAMRecord(sstream, rec);
+
+      rec.qname = mateNameView;
+      rec.flag = flags2;
+      rec.pos = qa.matePos;
+      rec.cigar = qa.mateCigar.empty() ? fmt::StringRef(cigarStr2.c_str()) : fmt::StringRef(qa.mateCigar);
+      rec.matePos = qa.pos;
+      rec.tlen = read1First ? -fragLen : fragLen;
+      rec.seq = readSeq2;
+      rec.score = qa.mateScore;
+      emitSAMRecord(sstream, rec);
     } else if(writeOrphans) {
 		//added orphan support
 	  //std::cerr<<"orphans here";
@@ -747,37 +793,25 @@ inline uint32_t writeAlignmentsToStream(
       // If the fragment overhangs the right end of the reference
       // adjust fragLen (overhanging the left end is already handled).
 
-      sstream << *(alignedName) << '\t'                    // QNAME
-              << flags << '\t'                              // FLAGS
-              << refName << '\t'                             // RNAME
-              << qa.pos + 1 << '\t'                          // POS (1-based)
-              << 1 << '\t'                                   // MAPQ
-              << (qa.cigar.empty() ? (*cigarStr).c_str() : qa.cigar) << '\t'                   // CIGAR
-              //<< "100M" << '\t' 
-              << '=' << '\t'                                 // RNEXT
-              << /* qa.matePos */ qa.pos + 1 << '\t'                      // PNEXT
-              << 0 << '\t'                                     // TLEN
-              << *readSeq << '\t'                           // SEQ
-              << "*\t"                                       // QUAL
-              << numHitFlag << '\t'
-              << "HI:i:" << i << '\t'
-              << "AS:i:" << qa.score << '\n';
-
-
-      sstream << *(unalignedName) << '\t'                    // QNAME
-              << unalignedFlags << '\t'                              // FLAGS
-              << refName << '\t'                             // RNAME
-              << qa.pos + 1 << '\t'                      // POS (1-based)
-              << 0 << '\t'                                   // MAPQ
-              << "*\t"                   // CIGAR
-              << '=' << '\t'                                 // RNEXT
-              << qa.pos + 1 << '\t'                          // PNEXT
-              << 0 << '\t'                                   // TLEN
-              << *unalignedSeq << '\t'                           // SEQ
-              << "*\t"                                       // QUAL
-              << numHitFlag << '\t'
-              << "HI:i:" << i << '\t'
-              << "AS:i:" << qa.mateScore << '\n';
+      rec.qname = *alignedName;
+      rec.flag = static_cast<uint16_t>(flags);
+      rec.pos = qa.pos;
+      rec.mapq = 1;
+      rec.cigar = qa.cigar.empty() ? fmt::StringRef(cigarStr->c_str()) : fmt::StringRef(qa.cigar);
+      rec.matePos = /* qa.matePos */ qa.pos;
+      rec.tlen = 0;
+      rec.seq = readSeq;
+      rec.score = qa.score;
+      emitSAMRecord(sstream, rec);
+
+      // the unaligned mate is placed at its partner's position
+      rec.qname = *unalignedName;
+      rec.flag = static_cast<uint16_t>(unalignedFlags);
+      rec.mapq = 0;
+      rec.cigar = "*";
+      rec.seq = unalignedSeq;
+      rec.score = qa.mateScore;
+      emitSAMRecord(sstream, rec);
 
     }
     ++alnCtr;
@@ -0,0 +1,33 @@
+#ifndef __SCORE_BOUND__
+#define __SCORE_BOUND__
+
+#include <algorithm>
+#include <cstdint>
+
+namespace score_bound {
+
+/**
+ *  Upper bound on the global alignment score of a read piece of m bases, ns of them N,
+ *  against n reference bases, when at most lcs bases of the piece can be matched.
+ *  a is the match score, b the mismatch penalty, q and e the gap open and extend
+ *  penalties (all positive); N aligned to a base scores 0, as in KSW2Aligner.
+ *
+ *  The unmatched m - lcs read bases and n - lcs reference bases are paired as x
+ *  mismatches, and the rest are inserted or deleted.  The cost of that is linear in x
+ *  on either side of x = ns, the number of pairs an N can absorb, so its minimum is
+ *  at x = 0, x = ns or the largest x.
+ **/
+inline int64_t globalScoreBound(int64_t a, int64_t b, int64_t q, int64_t e,
+                                int64_t m, int64_t n, int64_t lcs, int64_t ns) {
+  int64_t ur = m - lcs, uf = n - lcs;
+  auto cost = [&](int64_t x) -> int64_t {
+    int64_t ins = ur - x, del = uf - x;
+    return (a + b) * x - b * std::min(ns, x) + (a + e) * ins + e * del + ((ins + del > 0) ? q : 0);
+  };
+  int64_t maxPairs = std::min(ur, uf);
+  return a * m - std::min({cost(0), cost(std::min(ns, maxPairs)), cost(maxPairs)});
+}
+
+} // namespace score_bound
+
+#endif // __SCORE_BOUND__
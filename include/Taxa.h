@@ -239,4 +239,12 @@ struct TaxaInfo {
     }
 };
 
+// a read and its mappings, as the mapping readers hand them out
+struct ReadInfo {
+    std::string rid;
+    uint32_t cnt = 0;
+    uint32_t len = 0;
+    std::vector<TaxaNode> mappings;
+};
+
 #endif
@@ -88,6 +88,8 @@ namespace pufferfish {
         bool try_loading_eqclasses{false};
         bool try_loading_edges{false};
         bool try_loading_ref_seqs{true};
+        // ask for transparent huge pages on the structures lookups hit at random
+        bool huge_pages{false};
       };
 
         enum ReadEnd : uint8_t {
@@ -146,6 +148,12 @@ namespace pufferfish {
           }
         }
 
+        // returns nullptr, rather than inserting, if k is absent
+        V* find_value(const K& k) {
+          auto it = index_map_.find(k);
+          return (it == index_map_.end()) ? nullptr : &cache_[it->second];
+        }
+
         V& cache_index(uint32_t ci) {
           return cache_[ci];
         }
@@ -383,13 +391,19 @@ Compile-time selection between list-like and map-like printing.
         }
 
         std::string get_cigar(uint32_t readLen, bool &cigar_fixed) {
+          std::string cigar;
+          get_cigar(readLen, cigar_fixed, cigar);
+          return cigar;
+        }
+
+        // Same as above, but writes into `cigar` so a caller-owned buffer
+        // can be reused from one alignment to the next.
+        void get_cigar(uint32_t readLen, bool &cigar_fixed, std::string& cigar) {
           cigar_fixed = false;
-          std::string cigar = "";
+          cigar.clear();
           if (cigar_counts.size() != cigar_types.size() or cigar_counts.size() == 0) {
-            return "!";
-          }
-          if (cigar_counts.size() == 0) {
-            return cigar;
+            cigar = "!";
+            return;
           }
 
           uint32_t cigar_length = 0;
@@ -402,7 +416,7 @@ Compile-time selection between list-like and map-like printing.
             }
             cigar += std::to_string(count);
             cigar += cigar_types[0];
-            return cigar;
+            return;
           }
 
           char type = cigar_types[0];
@@ -435,7 +449,6 @@ Compile-time selection between list-like and map-like printing.
               }
             }
           }
-          return cigar;
         }
       };
 
@@ -532,6 +545,104 @@ Compile-time selection between list-like and map-like printing.
             }
         };
 
+        // Per-thread free list for the storage owned by MemCluster objects.
+        // Clusters are built and torn down for every read, so instead of
+        // handing their MemInfo / CIGAR buffers back to the heap, a dying
+        // cluster parks them here and the next cluster constructed on the
+        // same thread picks them up with their capacity intact.  Once a
+        // mapping thread has warmed up, misses() stops growing.
+        //
+        // A cluster's buffers go to the pool of the thread that destroys it,
+        // which need not be the one that made it; pools are never shared
+        // between threads.  A cluster that outlives its thread's pool (one
+        // held by a static or global object, or destroyed during thread exit)
+        // frees its buffers the ordinary way.  hits() and misses() count the
+        // MEM lists only; CIGAR strings are recycled but not counted.
+        class MemClusterBufferPool {
+        public:
+          static constexpr size_t maxPooled = 1 << 14;
+
+          static MemClusterBufferPool& local() {
+            static thread_local MemClusterBufferPool pool;
+            return pool;
+          }
+
+          // This thread's pool, or nullptr once it has been destroyed
+          static MemClusterBufferPool* localIfAlive() {
+            return state() == State::Dead ? nullptr : &local();
+          }
+
+          static std::vector<MemInfo> newMems() {
+            auto pool = localIfAlive();
+            return pool ? pool->acquireMems() : std::vector<MemInfo>();
+          }
+
+          static std::string newString() {
+            auto pool = localIfAlive();
+            return pool ? pool->acquireString() : std::string();
+          }
+
+          // Parks the buffers of a dying cluster, if this thread's pool is
+          // (still) there; otherwise they are freed with the cluster
+          static void recycle(std::vector<MemInfo>& mems, std::string& cigar) {
+            if (state() != State::Alive) { return; }
+            auto& pool = local();
+            pool.release(mems);
+            pool.release(cigar);
+          }
+
+          std::vector<MemInfo> acquireMems() {
+            if (memBufs_.empty()) { ++misses_; return std::vector<MemInfo>(); }
+            ++hits_;
+            std::vector<MemInfo> v(std::move(memBufs_.back()));
+            memBufs_.pop_back();
+            return v;
+          }
+
+          std::string acquireString() {
+            if (strBufs_.empty()) { return std::string(); }
+            std::string s(std::move(strBufs_.back()));
+            strBufs_.pop_back();
+            return s;
+          }
+
+          void release(std::vector<MemInfo>& v) {
+            if (v.capacity() == 0 or memBufs_.size() >= maxPooled) { return; }
+            v.clear();
+            memBufs_.push_back(std::move(v));
+          }
+
+          void release(std::string& s) {
+            // strings that still fit in the small buffer own no heap memory
+            if (s.capacity() <= minStringCapacity_ or strBufs_.size() >= maxPooled) { return; }
+            s.clear();
+            strBufs_.push_back(std::move(s));
+          }
+
+          uint64_t hits() const { return hits_; }
+          uint64_t misses() const { return misses_; }
+
+          MemClusterBufferPool(const MemClusterBufferPool&) = delete;
+          MemClusterBufferPool& operator=(const MemClusterBufferPool&) = delete;
+
+        private:
+          enum class State : uint8_t { Unborn, Alive, Dead };
+          // trivially destructible, so it can still be read once the pool is gone
+          static State& state() {
+            static thread_local State s{State::Unborn};
+            return s;
+          }
+
+          MemClusterBufferPool() { state() = State::Alive; }
+          ~MemClusterBufferPool() { state() = State::Dead; }
+
+          std::vector<std::vector<MemInfo>> memBufs_;
+          std::vector<std::string> strBufs_;
+          size_t minStringCapacity_{std::string().capacity()};
+          uint64_t hits_{0};
+          uint64_t misses_{0};
+        };
+
         struct MemCluster {
             // second element is the transcript position
             std::vector<MemInfo> mems;
@@ -546,17 +657,38 @@ Compile-time selection between list-like and map-like printing.
             uint32_t openGapLen{0};
 
             //bool isValid = true;
-            MemCluster(bool isFwIn, uint32_t readLenIn) : isFw(isFwIn), readLen(readLenIn) {}
+            MemCluster(bool isFwIn, uint32_t readLenIn) :
+                    mems(MemClusterBufferPool::newMems()), isFw(isFwIn),
+                    cigar(MemClusterBufferPool::newString()), readLen(readLenIn) {}
             /*MemCluster(bool isFwIn, MemInfo memIn): isFw(isFwIn) {
               mems.push_back(memIn);
               }*/
             /*MemCluster() {
               mems.push_back(std::make_pair(memInfoPtr, tposIn));
               }*/
-            MemCluster(const MemCluster &other) = default;
+            MemCluster(const MemCluster &other) : MemCluster() { *this = other; }
+
+            MemCluster(MemCluster &&other) noexcept = default;
 
             MemCluster &operator=(const MemCluster &other) = default;
 
+            // swap rather than steal so that our old buffers go back to the
+            // pool when `other` is destroyed.
+            MemCluster &operator=(MemCluster &&other) noexcept {
+                mems.swap(other.mems);
+                isFw = other.isFw;
+                isVisited = other.isVisited;
+                coverage = other.coverage;
+                score = other.score;
+                cigar.swap(other.cigar);
+                perfectChain = other.perfectChain;
+                readLen = other.readLen;
+                openGapLen = other.openGapLen;
+                return *this;
+            }
+
+            ~MemCluster() { MemClusterBufferPool::recycle(mems, cigar); }
+
             bool operator==(const MemCluster& mc) {
                 if (!(isFw == mc.isFw and score == mc.score and coverage == mc.coverage
                 and cigar == mc.cigar and perfectChain == mc.perfectChain
@@ -572,7 +704,9 @@ Compile-time selection between list-like and map-like printing.
                 return !((*this) == mc);
             }
 
-            MemCluster() {}
+            MemCluster() :
+                    mems(MemClusterBufferPool::newMems()),
+                    cigar(MemClusterBufferPool::newString()) {}
 
             // Add the new mem to the list and update the coverage, designed for clustered Mems
             void addMem(std::vector<UniMemInfo>::iterator uniMemInfo, size_t tpos, uint32_t extendedlen, uint32_t rpos,
@@ -809,12 +943,19 @@ Compile-time selection between list-like and map-like printing.
         int32_t refExtendLength{20};
         bool fullAlignment{false};
         int16_t matchScore;
+        int16_t missMatchScore{-4};
         int16_t gapExtendPenalty;
         int16_t gapOpenPenalty;
         double minScoreFraction{0.0};
         bool mimicBT2{false};
         bool mimicBT2Strict{false};
         bool allowOverhangSoftclip{false};
+        // skip the DP for candidates whose score provably cannot exceed minScoreFraction
+        bool scoreBoundFilter{true};
+        // entries in the per-thread alignment cache kept across reads (0 = disabled)
+        uint32_t crossReadCacheSize{0};
+        // with fullAlignment, reject a multi-mapping read's candidates with the inter-sequence kernel
+        bool batchAlignment{false};
       };
 
         struct QuasiAlignment {
@@ -1085,8 +1226,37 @@ Compile-time selection between list-like and map-like printing.
 
             std::atomic<uint64_t> skippedAlignments_byCache{0};
             std::atomic<uint64_t> skippedAlignments_byCov{0};
+            std::atomic<uint64_t> skippedAlignments_byScoreBound{0};
+            std::atomic<uint64_t> batchScoredAlignments{0};
+            std::atomic<uint64_t> batchRejectedAlignments{0};
             std::atomic<uint64_t> totalAlignmentAttempts{0};
             std::atomic<uint64_t> cigar_fixed_count{0};
+            // lookups in the alignment cache that persists across reads
+            std::atomic<uint64_t> crossReadCacheHits{0};
+            std::atomic<uint64_t> crossReadCacheMisses{0};
+
+            // MemCluster MEM lists handed out from the per-thread pool
+            // (reuses) vs. freshly created because the pool was empty (misses)
+            std::atomic<uint64_t> clusterBufferReuses{0};
+            std::atomic<uint64_t> clusterBufferMisses{0};
+
+            // (reference, orientation) pairs whose chain was copied from another
+            // reference with an identical MEM layout instead of being recomputed
+            std::atomic<uint64_t> chainsReplayed{0};
+
+            // size of the ksw2 DP workspaces summed over threads, and how often
+            // they had to grow past their first block
+            std::atomic<uint64_t> ksw2WorkspaceBytes{0};
+            std::atomic<uint64_t> ksw2WorkspaceGrowths{0};
+
+            // with --screen, candidates left unaligned because an earlier one
+            // of the same read already classified it
+            std::atomic<uint64_t> screenSkippedCandidates{0};
+
+            // read pairs answered from the read cache (--readCacheSize) vs.
+            // mapped because it did not hold them
+            std::atomic<uint64_t> readCacheHits{0};
+            std::atomic<uint64_t> readCacheMisses{0};
         };
 
         struct ContigBlock {
@@ -22,7 +22,7 @@ public:
   void operator()(void* p) { km_destroy(p); }
 };
 
-enum class KSW2AlignmentType : uint8_t { GLOBAL = 1, EXTENSION = 2 };
+enum class KSW2AlignmentType : uint8_t { GLOBAL = 1, EXTENSION = 2, BATCH_EXTENSION = 3 };
 
 // Just like Int2Type from
 // https://en.wikibooks.org/wiki/More_C%2B%2B_Idioms/Int-To-Type
@@ -42,6 +42,21 @@ struct KSW2Config {
   KSW2AlignmentType atype = KSW2AlignmentType::GLOBAL;
 };
 
+/**
+ * Capacity of an aligner's DP workspace: the kalloc arena that holds the
+ * score and backtrack matrices of every call, and the CIGAR ops of the
+ * `ksw_extz_t`s set up with `initExtz`.  The arena only grows; `numGrowths`
+ * counts how often it had to after its first block, so a constant value
+ * across a run means alignment stopped touching the heap.
+ */
+struct KSW2WorkspaceStats {
+  size_t capacity{0};    // bytes obtained from the system
+  size_t available{0};   // bytes currently free in the arena
+  size_t largestFree{0}; // largest contiguous free block
+  size_t numCores{0};    // number of blocks obtained from the system
+  size_t numGrowths{0};  // of those, the ones beyond the first
+};
+
 class KSW2Aligner {
 
 public:
@@ -76,6 +91,17 @@ public:
                  const uint8_t* const targetOriginal, const int targetLength,
                  ksw_extz_t* ez, EnumToType<KSW2AlignmentType::EXTENSION>);
 
+  /**
+   * Inter-sequence extension of one query against `numTargets` targets at
+   * once (score only).  Fills `mqe` with, for each target, the best score
+   * reaching the end of the query; returns false if the scores do not fit
+   * the 16-bit lanes of the kernel, in which case `mqe` is not filled.
+   */
+  bool operator()(const uint8_t* const query, const int queryLength,
+                  const uint8_t* const* targets, const int* targetLengths,
+                  const int numTargets, int* mqe,
+                  EnumToType<KSW2AlignmentType::BATCH_EXTENSION>);
+
   /**
    * Variants of the operator that do not require an output
    * `ksw_extz_t*` variable.  They will store the result in this object's
@@ -113,10 +139,23 @@ public:
 
   KSW2Config& config() { return config_; }
   const ksw_extz_t& result() { return result_; }
+
+  /**
+   * Prepare a caller-owned `ksw_extz_t` for use with this aligner.  Its CIGAR
+   * buffer lives in this aligner's workspace and is kept (and only ever
+   * grown) across calls, since `ksw_reset_extz` leaves it alone; release it
+   * with `freeCIGAR`.
+   */
+  void initExtz(ksw_extz_t* ez, int cigarCapacity = 0);
+
+  KSW2WorkspaceStats workspaceStats() const;
+
   void freeCIGAR(ksw_extz_t* ez) {
     if (ez->cigar and kalloc_allocator_) {
       kfree(kalloc_allocator_.get(), ez->cigar);
     }
+    ez->cigar = nullptr;
+    ez->m_cigar = ez->n_cigar = 0;
   }
 
 private:
@@ -127,6 +166,7 @@ private:
                                                          KallocDeleter()};
   std::vector<int8_t> mat_;
   KSW2Config config_;
+  bool haveAVX2{false};
   bool haveSSE41{false};
   bool haveSSE2{false};
 };
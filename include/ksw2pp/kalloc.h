@@ -17,7 +17,12 @@ void kfree(void *km, void *ptr);
 void *km_init(void);
 void km_destroy(void *km);
 
-void km_stat(const void *km); // TODO: return numbers instead of print to stderr
+typedef struct {
+	size_t capacity, available, n_blocks, n_cores, largest;
+} km_stat_t;
+
+void km_stat(const void *km); // print km_getstat() to stderr
+void km_getstat(const void *km, km_stat_t *s);
 
 #ifdef __cplusplus
 }
@@ -63,6 +63,29 @@ void ksw_extz2_sse2(/*unsigned int simd, */void *km, int qlen, const uint8_t *qu
            int8_t q, int8_t e, int w, int zdrop, int end_bonus, int flag, ksw_extz_t *ez);
 
 
+/**
+ * Inter-sequence extension (score only): one query against many targets
+ *
+ * Same scoring as ksw_extz2_sse() without end bonus or Z-drop, computed with
+ * the plain banded recurrence over |t-i| <= w for several targets at once
+ * (8 per vector with SSE, 16 with AVX2).
+ *
+ * @param n_tgt     number of targets
+ * @param tlens     target lengths
+ * @param targets   target sequences with 0 <= target[i] < m
+ * @param mqe       (out) for each target, max score reaching the end of query
+ *
+ * @return          0, or -1 if the scores may not fit in 16 bits (mqe[] not filled)
+ */
+int ksw_extz2_batch_sse(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat,
+                        int8_t q, int8_t e, int w, int *mqe);
+int ksw_extz2_batch_sse41(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat,
+                          int8_t q, int8_t e, int w, int *mqe);
+int ksw_extz2_batch_sse2(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat,
+                         int8_t q, int8_t e, int w, int *mqe);
+int ksw_extz2_batch_avx2(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat,
+                         int8_t q, int8_t e, int w, int *mqe);
+
 void ksw_extd(void *km, int qlen, const uint8_t *query, int tlen, const uint8_t *target, int8_t m, const int8_t *mat,
 			  int8_t gapo, int8_t gape, int8_t gapo2, int8_t gape2, int w, int zdrop, int flag, ksw_extz_t *ez);
 
@@ -44,6 +44,11 @@ public:
 	// Just for analysis purposes
 	void print_counts();
 	uint64_t bit_count();
+	// calls f(pointer, bytes) for the rank counts
+	template <typename F>
+	void visitBuffers(F f) const {
+		f(counts, (num_counts + 1) * sizeof(uint64_t));
+	}
 };
 
 #endif
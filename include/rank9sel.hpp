@@ -49,6 +49,13 @@ public:
 	// Just for analysis purposes
 	void print_counts();
 	uint64_t bit_count();
+	// calls f(pointer, bytes) for the rank counts and select inventories
+	template <typename F>
+	void visitBuffers(F f) const {
+		f(counts, (num_counts + 1) * sizeof(uint64_t));
+		f(inventory, (inventory_size + 1) * sizeof(uint64_t));
+		f(subinventory, ((num_words + 3) / 4) * sizeof(uint64_t));
+	}
 };
 
 #endif
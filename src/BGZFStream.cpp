@@ -0,0 +1,171 @@
+#include "BGZFStream.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include "zlib.h"
+
+namespace {
+constexpr size_t bgzfHeaderSize = 18;
+constexpr size_t bgzfFooterSize = 8;
+constexpr size_t bgzfMaxBlockSize = 0x10000;
+
+// the empty block htslib expects at the end of a BGZF file
+const char bgzfEOF[28] = {'\x1f', '\x8b', '\x08', '\x04', 0, 0, 0, 0, 0, '\xff', '\x06', 0, 'B', 'C',
+                          '\x02', 0, '\x1b', 0, '\x03', 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+inline void putLE16(char* p, uint16_t v) {
+  p[0] = static_cast<char>(v & 0xff);
+  p[1] = static_cast<char>(v >> 8);
+}
+
+inline void putLE32(char* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i) { p[i] = static_cast<char>((v >> (8 * i)) & 0xff); }
+}
+
+// compress `in` into a complete BGZF block in `out`; returns its size
+size_t compressBlock(z_stream& zs, const char* in, size_t inLen, char* out) {
+  deflateReset(&zs);
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+  zs.avail_in = static_cast<uInt>(inLen);
+  zs.next_out = reinterpret_cast<Bytef*>(out + bgzfHeaderSize);
+  zs.avail_out = static_cast<uInt>(bgzfMaxBlockSize - bgzfHeaderSize - bgzfFooterSize);
+  if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+    std::cerr << "BGZF: could not compress a " << inLen << " byte block into 64KB\n";
+    std::exit(1);
+  }
+  size_t blockLen = bgzfHeaderSize + zs.total_out + bgzfFooterSize;
+  const char header[bgzfHeaderSize] = {'\x1f', '\x8b', '\x08', '\x04', 0, 0, 0, 0, 0, '\xff',
+                                       '\x06', 0, 'B', 'C', '\x02', 0, 0, 0};
+  std::memcpy(out, header, bgzfHeaderSize);
+  putLE16(out + 16, static_cast<uint16_t>(blockLen - 1));
+  uint32_t crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(in), static_cast<uInt>(inLen));
+  putLE32(out + blockLen - 8, crc);
+  putLE32(out + blockLen - 4, static_cast<uint32_t>(inLen));
+  return blockLen;
+}
+} // namespace
+
+BGZFStreamBuf::BGZFStreamBuf(std::streambuf* sink, uint32_t numThreads, int level)
+    : sink_(sink), level_(level) {
+  if (numThreads == 0) { numThreads = 1; }
+  // enough blocks to keep every worker busy while finished ones wait to be written
+  blocks_.resize(4 * numThreads + 2);
+  for (auto& b : blocks_) {
+    b.in.resize(blockInputSize);
+    b.out.resize(bgzfMaxBlockSize);
+  }
+  setp(current().in.data(), current().in.data() + blockInputSize);
+  for (uint32_t i = 0; i < numThreads; ++i) {
+    workers_.emplace_back(&BGZFStreamBuf::compressLoop, this);
+  }
+}
+
+BGZFStreamBuf::~BGZFStreamBuf() { close(); }
+
+void BGZFStreamBuf::compressLoop() {
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, level_, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    std::cerr << "BGZF: could not initialize zlib\n";
+    std::exit(1);
+  }
+  while (true) {
+    Block* b{nullptr};
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      jobCV_.wait(l, [this]() { return !jobs_.empty() or stopping_; });
+      if (jobs_.empty()) { break; }
+      b = jobs_.front();
+      jobs_.pop_front();
+    }
+    b->outLen = compressBlock(zs, b->in.data(), b->inLen, b->out.data());
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      b->done = true;
+    }
+    doneCV_.notify_all();
+  }
+  deflateEnd(&zs);
+}
+
+void BGZFStreamBuf::submitCurrent() {
+  Block& b = current();
+  b.inLen = static_cast<size_t>(pptr() - pbase());
+  if (b.inLen == 0) { return; }
+  b.done = false;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    jobs_.push_back(&b);
+  }
+  jobCV_.notify_one();
+  ++tail_;
+  // the next block may still hold output that has not been written yet
+  if (tail_ - head_ == blocks_.size()) { writeFinished(false); }
+  setp(current().in.data(), current().in.data() + blockInputSize);
+}
+
+void BGZFStreamBuf::writeFinished(bool all) {
+  while (head_ < tail_) {
+    Block& b = blocks_[head_ % blocks_.size()];
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      bool mustWait = all or (tail_ - head_ == blocks_.size());
+      if (!b.done and !mustWait) { return; }
+      doneCV_.wait(l, [&b]() { return b.done; });
+    }
+    sink_->sputn(b.out.data(), static_cast<std::streamsize>(b.outLen));
+    ++head_;
+  }
+}
+
+BGZFStreamBuf::int_type BGZFStreamBuf::overflow(int_type c) {
+  if (closed_) { return traits_type::eof(); }
+  submitCurrent();
+  writeFinished(false);
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize BGZFStreamBuf::xsputn(const char* s, std::streamsize n) {
+  if (closed_) { return 0; }
+  std::streamsize written{0};
+  while (written < n) {
+    std::streamsize room = epptr() - pptr();
+    if (room == 0) {
+      submitCurrent();
+      writeFinished(false);
+      continue;
+    }
+    std::streamsize len = std::min(room, n - written);
+    std::memcpy(pptr(), s + written, static_cast<size_t>(len));
+    pbump(static_cast<int>(len));
+    written += len;
+  }
+  return written;
+}
+
+int BGZFStreamBuf::sync() {
+  if (closed_) { return 0; }
+  submitCurrent();
+  writeFinished(true);
+  return sink_->pubsync();
+}
+
+void BGZFStreamBuf::close() {
+  if (closed_) { return; }
+  sync();
+  sink_->sputn(bgzfEOF, sizeof(bgzfEOF));
+  sink_->pubsync();
+  closed_ = true;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    stopping_ = true;
+  }
+  jobCV_.notify_all();
+  for (auto& t : workers_) { t.join(); }
+  setp(nullptr, nullptr);
+}
@@ -0,0 +1,242 @@
+#include "FastxInputStream.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace fastx_parser {
+
+namespace {
+// gzip header: magic, CM, FLG, MTIME, XFL, OS, XLEN
+constexpr size_t gzipFixedHeader = 12;
+constexpr size_t gzipFooter = 8;
+constexpr size_t readAheadBufferSize = 4 * 1024 * 1024;
+constexpr size_t bgzfMaxBlockSize = 0x10000;
+
+inline uint16_t getLE16(const unsigned char* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t getLE32(const unsigned char* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// the BSIZE of a BGZF member from its extra field, or 0 if it has none
+size_t bgzfBlockSize(const unsigned char* extra, size_t xlen) {
+  size_t i{0};
+  while (i + 4 <= xlen) {
+    uint16_t slen = getLE16(extra + i + 2);
+    if (extra[i] == 'B' and extra[i + 1] == 'C' and slen == 2 and i + 6 <= xlen) {
+      return static_cast<size_t>(getLE16(extra + i + 4)) + 1;
+    }
+    i += 4 + slen;
+  }
+  return 0;
+}
+} // namespace
+
+InputStream::InputStream(const std::string& path, uint32_t numThreads) {
+  if (numThreads > 0) {
+    fp_ = fopen(path.c_str(), "rb");
+    if (fp_ and looksLikeBGZF(fp_)) {
+      mode_ = Mode::BGZF;
+    } else {
+      if (fp_) { fclose(fp_); }
+      fp_ = nullptr;
+      mode_ = Mode::ReadAhead;
+    }
+  }
+  if (mode_ != Mode::BGZF) {
+    gz_ = gzopen(path.c_str(), "r");
+    isOpen_ = gz_ != nullptr;
+  } else {
+    isOpen_ = true;
+  }
+  if (!isOpen_ or mode_ == Mode::Direct) { return; }
+
+  if (mode_ == Mode::ReadAhead) {
+    // one buffer being parsed, one being filled, one spare
+    slots_.resize(3);
+    for (auto& s : slots_) { s.out.resize(readAheadBufferSize); }
+  } else {
+    slots_.resize(4 * numThreads + 2);
+    for (auto& s : slots_) {
+      s.in.resize(bgzfMaxBlockSize);
+      s.out.resize(bgzfMaxBlockSize);
+    }
+    for (uint32_t i = 0; i < numThreads; ++i) {
+      workers_.emplace_back(&InputStream::inflateLoop, this);
+    }
+  }
+  producer_ = std::thread(&InputStream::produce, this);
+}
+
+InputStream::~InputStream() {
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    stopping_ = true;
+  }
+  slotCV_.notify_all();
+  jobCV_.notify_all();
+  if (producer_.joinable()) { producer_.join(); }
+  for (auto& t : workers_) { t.join(); }
+  if (gz_) { gzclose(gz_); }
+  if (fp_) { fclose(fp_); }
+}
+
+bool InputStream::looksLikeBGZF(FILE* fp) {
+  unsigned char hd[gzipFixedHeader + 6];
+  size_t n = fread(hd, 1, sizeof(hd), fp);
+  rewind(fp);
+  if (n < sizeof(hd)) { return false; }
+  // gzip, deflate, FEXTRA set
+  if (hd[0] != 0x1f or hd[1] != 0x8b or hd[2] != 8 or !(hd[3] & 4)) { return false; }
+  size_t xlen = getLE16(hd + 10);
+  return xlen >= 6 and bgzfBlockSize(hd + gzipFixedHeader, std::min<size_t>(xlen, 6)) > 0;
+}
+
+bool InputStream::readBGZFBlock(Slot& s) {
+  unsigned char* hd = s.in.data();
+  size_t n = fread(hd, 1, gzipFixedHeader, fp_);
+  if (n == 0 and feof(fp_)) {
+    s.last = true;
+    return true;
+  }
+  if (n != gzipFixedHeader or hd[0] != 0x1f or hd[1] != 0x8b or !(hd[3] & 4)) { return false; }
+  size_t xlen = getLE16(hd + 10);
+  if (gzipFixedHeader + xlen > s.in.size() or fread(hd + gzipFixedHeader, 1, xlen, fp_) != xlen) { return false; }
+  size_t bsize = bgzfBlockSize(hd + gzipFixedHeader, xlen);
+  size_t hdLen = gzipFixedHeader + xlen;
+  if (bsize < hdLen + gzipFooter or bsize > s.in.size()) { return false; }
+  if (fread(hd + hdLen, 1, bsize - hdLen, fp_) != bsize - hdLen) { return false; }
+  // the offset of the compressed data goes in outPos until the block is inflated
+  s.outLen = bsize;
+  s.outPos = hdLen;
+  return true;
+}
+
+void InputStream::produce() {
+  for (uint64_t seq = 0;; ++seq) {
+    Slot& s = slots_[seq % slots_.size()];
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      slotCV_.wait(l, [this, &s]() { return s.state == SlotState::Free or stopping_; });
+      if (stopping_) { return; }
+    }
+    s.last = s.error = false;
+    s.outPos = s.outLen = 0;
+
+    bool ok{true};
+    bool handOff{false};
+    if (mode_ == Mode::ReadAhead) {
+      int n = gzread(gz_, s.out.data(), static_cast<unsigned>(s.out.size()));
+      if (n < 0) {
+        ok = false;
+      } else {
+        s.outLen = static_cast<size_t>(n);
+        s.last = (n == 0);
+      }
+    } else {
+      ok = readBGZFBlock(s);
+      handOff = ok and !s.last;
+    }
+    if (!ok) {
+      s.error = s.last = true;
+    }
+
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      if (handOff) {
+        s.state = SlotState::Filled;
+        jobs_.push_back(&s);
+      } else {
+        s.state = SlotState::Done;
+      }
+    }
+    if (handOff) {
+      jobCV_.notify_one();
+    } else {
+      slotCV_.notify_all();
+    }
+    if (s.last) { return; }
+  }
+}
+
+void InputStream::inflateLoop() {
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, -15) != Z_OK) {
+    std::cerr << "could not initialize zlib for BGZF input\n";
+    std::exit(1);
+  }
+  while (true) {
+    Slot* s{nullptr};
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      jobCV_.wait(l, [this]() { return !jobs_.empty() or stopping_; });
+      if (stopping_) { break; }
+      s = jobs_.front();
+      jobs_.pop_front();
+    }
+    const unsigned char* block = s->in.data();
+    size_t bsize = s->outLen;
+    size_t dataStart = s->outPos;
+    uint32_t crc = getLE32(block + bsize - 8);
+    uint32_t isize = getLE32(block + bsize - 4);
+    bool ok = isize <= s->out.size();
+    if (ok) {
+      inflateReset(&zs);
+      zs.next_in = const_cast<Bytef*>(block + dataStart);
+      zs.avail_in = static_cast<uInt>(bsize - dataStart - gzipFooter);
+      zs.next_out = s->out.data();
+      zs.avail_out = static_cast<uInt>(s->out.size());
+      ok = inflate(&zs, Z_FINISH) == Z_STREAM_END and zs.total_out == isize and
+           crc32(crc32(0L, Z_NULL, 0), s->out.data(), isize) == crc;
+    }
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      s->outLen = ok ? isize : 0;
+      s->outPos = 0;
+      s->error = !ok;
+      s->state = SlotState::Done;
+    }
+    slotCV_.notify_all();
+  }
+  inflateEnd(&zs);
+}
+
+int InputStream::read(void* buf, unsigned len) {
+  if (!isOpen_) { return -1; }
+  if (mode_ == Mode::Direct) { return gzread(gz_, buf, len); }
+
+  unsigned char* dst = static_cast<unsigned char*>(buf);
+  unsigned copied{0};
+  while (copied < len) {
+    Slot& s = slots_[readSeq_ % slots_.size()];
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      slotCV_.wait(l, [&s]() { return s.state == SlotState::Done; });
+    }
+    if (s.error) {
+      std::cerr << "Error decompressing the FASTA/Q input\n";
+      return -1;
+    }
+    if (s.last) { break; }
+    size_t n = std::min<size_t>(len - copied, s.outLen - s.outPos);
+    std::memcpy(dst + copied, s.out.data() + s.outPos, n);
+    s.outPos += n;
+    copied += static_cast<unsigned>(n);
+    if (s.outPos == s.outLen) {
+      {
+        std::lock_guard<std::mutex> l(mutex_);
+        s.state = SlotState::Free;
+      }
+      slotCV_.notify_all();
+      ++readSeq_;
+    }
+  }
+  return static_cast<int>(copied);
+}
+
+} // namespace fastx_parser
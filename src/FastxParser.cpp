@@ -1,12 +1,16 @@
 #include "FastxParser.hpp"
 #include "FastxParserThreadUtils.hpp"
+#include "FastxInputStream.hpp"
 
 #include "fcntl.h"
 #include "unistd.h"
 #include <sstream>
+#include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 #include <poll.h>
@@ -15,9 +19,93 @@
 #include <zlib.h>
 
 // STEP 1: declare the type of file handler and the read() function
-KSEQ_INIT(gzFile, gzread)
+static inline int readInput(fastx_parser::InputStream* in, void* buf, unsigned len) {
+  return in->read(buf, len);
+}
+KSEQ_INIT(fastx_parser::InputStream*, readInput)
 
 namespace fastx_parser {
+constexpr std::chrono::milliseconds QueueMonitor::targetChunkTime;
+
+// A parsing thread returns this when it can't open one of its inputs, with the
+// reason left in openError for stop() to report.
+constexpr int inputOpenError = -4;
+
+inline bool inputIsOpen(const InputStream& in, const std::string& path, std::string& openError) {
+  if (!in.isOpen()) {
+    openError = "Could not open the read file " + path + ". Make sure it exists and is readable.";
+  }
+  return in.isOpen();
+}
+
+QueueMonitor::QueueMonitor(size_t chunkSize)
+    : chunkSize_(chunkSize), minSize_(chunkSize), maxSize_(chunkSize),
+      minSeen_(chunkSize), maxSeen_(chunkSize) {}
+
+void QueueMonitor::setChunkSizeRange(size_t minSize, size_t maxSize) {
+  minSize_ = std::max(minSize, static_cast<size_t>(1));
+  maxSize_ = std::max(maxSize, minSize_);
+  size_t cur = std::min(std::max(chunkSize(), minSize_), maxSize_);
+  chunkSize_ = cur;
+  minSeen_ = cur;
+  maxSeen_ = cur;
+}
+
+void QueueMonitor::parserWaited(clock::duration d) {
+  parserWaitNs_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void QueueMonitor::consumerWaited(clock::duration d) {
+  consumerWaitNs_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void QueueMonitor::chunkFilled(size_t numReads) {
+  ++chunks_;
+  reads_ += numReads;
+}
+
+void QueueMonitor::sampleDepth(size_t depth) {
+  depthSum_ += depth;
+  ++depthSamples_;
+  uint64_t prev = maxDepth_.load(std::memory_order_relaxed);
+  while (depth > prev and !maxDepth_.compare_exchange_weak(prev, depth)) {}
+}
+
+void QueueMonitor::chunkConsumed(size_t numReads, clock::duration d) {
+  if (numReads == 0) { return; }
+  auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+  uint64_t sample = std::max<uint64_t>(16 * ns / numReads, 1);
+  // racy, but a lost update only costs one sample of the average
+  uint64_t prev = timePerRead_.load(std::memory_order_relaxed);
+  uint64_t avg = prev == 0 ? sample : (7 * prev + sample) / 8;
+  timePerRead_.store(avg, std::memory_order_relaxed);
+  if (minSize_ == maxSize_) { return; }
+
+  auto targetNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(targetChunkTime).count());
+  size_t want = static_cast<size_t>(16 * targetNs / avg);
+  want = std::min(std::max(want, minSize_), maxSize_);
+  chunkSize_.store(want, std::memory_order_relaxed);
+
+  size_t seen = minSeen_.load(std::memory_order_relaxed);
+  while (want < seen and !minSeen_.compare_exchange_weak(seen, want)) {}
+  seen = maxSeen_.load(std::memory_order_relaxed);
+  while (want > seen and !maxSeen_.compare_exchange_weak(seen, want)) {}
+}
+
+QueueStats QueueMonitor::stats() const {
+  QueueStats st;
+  st.chunks = chunks_;
+  st.reads = reads_;
+  st.elapsedSec = std::chrono::duration<double>(stop_ - start_).count();
+  st.parserWaitSec = parserWaitNs_ / 1e9;
+  st.consumerWaitSec = consumerWaitNs_ / 1e9;
+  st.meanDepth = depthSamples_ > 0 ? static_cast<double>(depthSum_) / depthSamples_ : 0.0;
+  st.maxDepth = maxDepth_;
+  st.minChunkSize = minSeen_;
+  st.maxChunkSize = maxSeen_;
+  return st;
+}
+
 template <typename T>
 FastxParser<T>::FastxParser(std::vector<std::string> files,
                             uint32_t numConsumers, uint32_t numParsers,
@@ -30,7 +118,7 @@ FastxParser<T>::FastxParser(std::vector<std::string> files,
                             uint32_t numConsumers, uint32_t numParsers,
                             uint32_t chunkSize)
     : inputStreams_(files), inputStreams2_(files2), numParsing_(0),
-      blockSize_(chunkSize) {
+      blockSize_(chunkSize), monitor_(chunkSize) {
 
   if (numParsers > files.size()) {
     std::cerr << "Can't make user of more parsing threads than file (pairs); "
@@ -88,6 +176,11 @@ moodycamel::ConsumerToken FastxParser<T>::getConsumerToken_() {
   return moodycamel::ConsumerToken(readQueue_);
 }
 
+template <typename T> size_t FastxParser<T>::chunkBufferSize_() const {
+  // room for a full chunk of short reads; longer reads just fill it sooner
+  return std::max(monitor_.maxChunkSize() * 256, static_cast<size_t>(1) << 16);
+}
+
 template <typename T> FastxParser<T>::~FastxParser() {
   if (isActive_ or numParsing_ > 0) {
     // Think about if this is too noisy --- but the user really shouldn't do this.
@@ -112,9 +205,13 @@ template <typename T> FastxParser<T>::~FastxParser() {
       for (auto& t : parsingThreads_) {
         t->join();
       }
+      monitor_.stopped();
       isActive_ = false;
-      for (auto& res : threadResults_) {
-        if (res == -3) {
+      for (size_t i = 0; i < threadResults_.size(); ++i) {
+        int res = threadResults_[i];
+        if (res == inputOpenError) {
+          throw std::invalid_argument(threadErrors_[i]);
+        } else if (res == -3) {
           throw std::range_error("Error reading from the FASTA/Q stream. Make sure the file is valid.");
         } else if (res < -1) {
           std::stringstream ss;
@@ -146,10 +243,220 @@ inline void copyRecord(kseq_t* seq, ReadQual* s) {
     s->qual.assign(seq->qual.s, seq->qual.l);
 }
 
+/**
+ * Scans FASTA/Q records in place in a chunk's buffer, reading more of the
+ * input into the buffer as it runs out.  What counts as a record, and the
+ * codes returned, follow kseq_read; but instead of copying a record out, a
+ * multi-line sequence (or quality string) is compacted in place and the
+ * record's views point straight into the buffer.
+ **/
+class InPlaceScanner {
+public:
+  enum Status { Record = 0, NeedSpace = 1, End = -1, Truncated = -2, ReadError = -3 };
+
+  explicit InPlaceScanner(InputStream& in) : in_(in) {}
+
+  // Scan into buf from now on; it starts with whatever the previous buffer
+  // had left after its last record.
+  void attach(std::vector<char>& buf, size_t minSize) {
+    if (buf.size() < std::max(minSize, carry_.size())) {
+      buf.resize(std::max(minSize, carry_.size()));
+    }
+    buf_ = &buf;
+    std::memcpy(buf.data(), carry_.data(), carry_.size());
+    pos_ = 0;
+    end_ = carry_.size();
+    carry_.clear();
+  }
+
+  // Keep the bytes past the last record for the next buffer.
+  void detach() {
+    carry_.assign(buf_->data() + pos_, buf_->data() + end_);
+    buf_ = nullptr;
+  }
+
+  size_t mark() const { return pos_; }
+  // Go back to a mark; the records scanned since then can be scanned again.
+  void rewind(size_t m) { pos_ = m; }
+
+  // Make room for a record longer than the buffer.  Only valid while no
+  // record views point into the buffer.
+  void grow() {
+    char* b = buf_->data();
+    std::memmove(b, b + pos_, end_ - pos_);
+    end_ -= pos_;
+    pos_ = 0;
+    buf_->resize(2 * buf_->size());
+  }
+
+  // The next record, or NeedSpace if the buffer is full before it ends.
+  int next(ReadSeqView& r) {
+    while (true) {
+      int st = scan(r);
+      if (st != NeedSpace) { return st; }
+      if (end_ == buf_->size()) { return NeedSpace; }
+      int n = in_.read(buf_->data() + end_, static_cast<unsigned>(buf_->size() - end_));
+      if (n < 0) { return ReadError; }
+      if (n == 0) {
+        eof_ = true;
+      } else {
+        end_ += static_cast<size_t>(n);
+      }
+    }
+  }
+
+private:
+  using Segment = std::pair<size_t, size_t>;
+
+  // the end of the line starting at p: its '\n', or the end of the data at
+  // the end of the input; false if the line isn't all in the buffer yet
+  bool lineEnd(size_t p, size_t& e) const {
+    const char* b = buf_->data();
+    const void* nl = std::memchr(b + p, '\n', end_ - p);
+    if (nl != nullptr) {
+      e = static_cast<size_t>(static_cast<const char*>(nl) - b);
+      return true;
+    }
+    e = end_;
+    return eof_;
+  }
+
+  // Move the segments together to the start of the first one, padding what
+  // they freed with newlines so that the record still scans the same (kseq
+  // skips empty lines); returns where the joined string starts.
+  size_t join(const std::vector<Segment>& segs, size_t emptyAt) {
+    if (segs.empty()) { return emptyAt; }
+    char* b = buf_->data();
+    size_t start = segs.front().first;
+    size_t w = start + segs.front().second;
+    for (size_t i = 1; i < segs.size(); ++i) {
+      std::memmove(b + w, b + segs[i].first, segs[i].second);
+      w += segs[i].second;
+    }
+    size_t last = segs.back().first + segs.back().second;
+    std::memset(b + w, '\n', last - w);
+    return start;
+  }
+
+  // Scan one record from pos_; NeedSpace here means it isn't all read yet.
+  int scan(ReadSeqView& r) {
+    const char* b = buf_->data();
+    size_t p = pos_;
+    while (p < end_ and b[p] != '>' and b[p] != '@') { ++p; }
+    if (p == end_) {
+      if (!eof_) { return NeedSpace; }
+      pos_ = end_;
+      return End;
+    }
+
+    size_t e{0};
+    if (!lineEnd(p, e)) { return NeedSpace; }
+    size_t nameStart = p + 1;
+    size_t nameEnd = nameStart;
+    while (nameEnd < e and !std::isspace(static_cast<unsigned char>(b[nameEnd]))) { ++nameEnd; }
+    p = std::min(e + 1, end_);
+
+    // sequence lines, up to the next header or the '+' line
+    seqSegs_.clear();
+    size_t seqLen{0};
+    while (p < end_ and b[p] != '>' and b[p] != '+' and b[p] != '@') {
+      if (!lineEnd(p, e)) { return NeedSpace; }
+      size_t len = e - p;
+      if (len > 0 and b[e - 1] == '\r') { --len; }
+      if (len > 0) {
+        seqSegs_.emplace_back(p, len);
+        seqLen += len;
+      }
+      p = std::min(e + 1, end_);
+    }
+    if (p == end_ and !eof_) { return NeedSpace; }
+
+    qualSegs_.clear();
+    size_t qualLen{0};
+    bool isFastq = p < end_ and b[p] == '+';
+    if (isFastq) {
+      if (!lineEnd(p, e)) { return NeedSpace; }
+      // no quality string
+      if (e == end_) { return Truncated; }
+      p = e + 1;
+      do {
+        if (p == end_) {
+          if (!eof_) { return NeedSpace; }
+          break;
+        }
+        if (!lineEnd(p, e)) { return NeedSpace; }
+        size_t len = e - p;
+        if (len > 0 and b[e - 1] == '\r') { --len; }
+        qualSegs_.emplace_back(p, len);
+        qualLen += len;
+        p = std::min(e + 1, end_);
+      } while (qualLen < seqLen);
+      if (qualLen != seqLen) { return Truncated; }
+    }
+
+    size_t seqStart = join(seqSegs_, nameEnd);
+    size_t qualStart = join(qualSegs_, nameEnd);
+    b = buf_->data();
+    r.name = stx::string_view(b + nameStart, nameEnd - nameStart);
+    r.seq = stx::string_view(b + seqStart, seqLen);
+    r.qual = stx::string_view(b + qualStart, qualLen);
+    pos_ = p;
+    return Record;
+  }
+
+  InputStream& in_;
+  std::vector<char>* buf_{nullptr};
+  size_t pos_{0};
+  size_t end_{0};
+  bool eof_{false};
+  std::string carry_;
+  std::vector<Segment> seqSegs_;
+  std::vector<Segment> qualSegs_;
+};
+
+
+// Take an empty chunk from the pool, sized for the current target; time spent
+// waiting for the consumers to hand one back is recorded in the monitor.
+template <typename T>
+inline void getEmptyChunk(
+    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& seqContainerQueue_,
+    moodycamel::ConsumerToken* cCont, std::unique_ptr<ReadChunk<T>>& local,
+    QueueMonitor& monitor) {
+  if (!seqContainerQueue_.try_dequeue(*cCont, local)) {
+    auto waitStart = QueueMonitor::clock::now();
+    size_t curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+    do {
+      fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+    } while (!seqContainerQueue_.try_dequeue(*cCont, local));
+    monitor.parserWaited(QueueMonitor::clock::now() - waitStart);
+  }
+  local->setWant(monitor.chunkSize());
+}
+
+// Hand a chunk holding numReads reads to the consumers.  Every chunk of a
+// parsing thread goes through its own producer token: the queue is only FIFO
+// per producer, and ordered output relies on chunks arriving in input order.
+template <typename T>
+inline void putFilledChunk(
+    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& readQueue_,
+    moodycamel::ProducerToken* pRead, std::unique_ptr<ReadChunk<T>>& local,
+    size_t numReads, QueueMonitor& monitor) {
+  local->have(numReads);
+  monitor.chunkFilled(numReads);
+  if (!readQueue_.try_enqueue(*pRead, std::move(local))) {
+    auto waitStart = QueueMonitor::clock::now();
+    size_t curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+    do {
+      fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+    } while (!readQueue_.try_enqueue(*pRead, std::move(local)));
+    monitor.parserWaited(QueueMonitor::clock::now() - waitStart);
+  }
+}
 
 template <typename T>
 int parseReads(
-    std::vector<std::string>& inputStreams, std::atomic<uint32_t>& numParsing,
+    std::vector<std::string>& inputStreams, uint32_t decompressionThreads, QueueMonitor& monitor,
+    std::atomic<uint32_t>& numParsing, std::string& openError,
     moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
     moodycamel::ConcurrentQueue<uint32_t>& workQueue,
     moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
@@ -163,20 +470,20 @@ int parseReads(
   uint32_t fn{0};
   while (workQueue.try_dequeue(fn)) {
     auto file = inputStreams[fn];
-    std::unique_ptr<ReadChunk<T>> local;
-    while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-      fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-      // Think of a way to do this that wouldn't be loud (or would allow a user-definable logging mechanism)
-      // std::cerr << "couldn't dequeue read chunk\n";
+    // open the file and init the parser
+    InputStream fp(file, decompressionThreads);
+    if (!inputIsOpen(fp, file, openError)) {
+      --numParsing;
+      return inputOpenError;
     }
+    std::unique_ptr<ReadChunk<T>> local;
+    getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
     size_t numObtained{local->size()};
-    // open the file and init the parser
-    auto fp = gzopen(file.c_str(), "r");
 
     // The number of reads we have in the local vector
     size_t numWaiting{0};
 
-    seq = kseq_init(fp);
+    seq = kseq_init(&fp);
     int ksv = kseq_read(seq);
 
     while (ksv >= 0) {
@@ -186,17 +493,11 @@ int parseReads(
 
       // If we've filled the local vector, then dump to the concurrent queue
       if (numWaiting == numObtained) {
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!readQueue_.try_enqueue(std::move(local))) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
+        putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
         numWaiting = 0;
         numObtained = 0;
         // And get more empty reads
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
+        getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
         numObtained = local->size();
       }
       ksv = kseq_read(seq);
@@ -213,11 +514,7 @@ int parseReads(
     // If we hit the end of the file and have any reads in our local buffer
     // then dump them here.
     if (numWaiting > 0) {
-      local->have(numWaiting);
-      curMaxDelay = MIN_BACKOFF_ITERS;
-      while (!readQueue_.try_enqueue(*pRead, std::move(local))) {
-        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-      }
+      putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
       numWaiting = 0;
     } else if (numObtained > 0){
       curMaxDelay = MIN_BACKOFF_ITERS;
@@ -225,9 +522,8 @@ int parseReads(
         fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
       }
     }
-    // destroy the parser and close the file
+    // destroy the parser (the file is closed with fp)
     kseq_destroy(seq);
-    gzclose(fp);
   }
 
   --numParsing;
@@ -237,7 +533,8 @@ int parseReads(
 template <typename T>
 int parseReadPair(
     std::vector<std::string>& inputStreams,
-    std::vector<std::string>& inputStreams2, std::atomic<uint32_t>& numParsing,
+    std::vector<std::string>& inputStreams2, uint32_t decompressionThreads, QueueMonitor& monitor,
+    std::atomic<uint32_t>& numParsing, std::string& openError,
     moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
     moodycamel::ConcurrentQueue<uint32_t>& workQueue,
     moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
@@ -256,22 +553,22 @@ int parseReadPair(
     auto& file = inputStreams[fn];
     auto& file2 = inputStreams2[fn];
 
-    std::unique_ptr<ReadChunk<T>> local;
-    while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-      fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-      // Think of a way to do this that wouldn't be loud (or would allow a user-definable logging mechanism)
-      // std::cerr << "couldn't dequeue read chunk\n";
+    // open the files and init the parsers
+    InputStream fp(file, decompressionThreads);
+    InputStream fp2(file2, decompressionThreads);
+    if (!inputIsOpen(fp, file, openError) or !inputIsOpen(fp2, file2, openError)) {
+      --numParsing;
+      return inputOpenError;
     }
+    std::unique_ptr<ReadChunk<T>> local;
+    getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
     size_t numObtained{local->size()};
-    // open the file and init the parser
-    auto fp = gzopen(file.c_str(), "r");
-    auto fp2 = gzopen(file2.c_str(), "r");
 
     // The number of reads we have in the local vector
     size_t numWaiting{0};
 
-    seq = kseq_init(fp);
-    seq2 = kseq_init(fp2);
+    seq = kseq_init(&fp);
+    seq2 = kseq_init(&fp2);
 
     int ksv = kseq_read(seq);
     int ksv2 = kseq_read(seq2);
@@ -283,17 +580,11 @@ int parseReadPair(
 
       // If we've filled the local vector, then dump to the concurrent queue
       if (numWaiting == numObtained) {
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!readQueue_.try_enqueue(std::move(local))) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
+        putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
         numWaiting = 0;
         numObtained = 0;
         // And get more empty reads
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
+        getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
         numObtained = local->size();
       }
       ksv = kseq_read(seq);
@@ -311,11 +602,7 @@ int parseReadPair(
     // If we hit the end of the file and have any reads in our local buffer
     // then dump them here.
     if (numWaiting > 0) {
-      local->have(numWaiting);
-      curMaxDelay = MIN_BACKOFF_ITERS;
-      while (!readQueue_.try_enqueue(*pRead, std::move(local))) {
-        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-      }
+      putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
       numWaiting = 0;
     } else if (numObtained > 0){
       curMaxDelay = MIN_BACKOFF_ITERS;
@@ -323,26 +610,252 @@ int parseReadPair(
         fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
       }
     }
-    // destroy the parser and close the file
+    // destroy the parsers (the files are closed with fp and fp2)
     kseq_destroy(seq);
-    gzclose(fp);
     kseq_destroy(seq2);
-    gzclose(fp2);
   }
 
   --numParsing;
   return 0;
 }
 
+template <typename T>
+int parseReadViews(
+    std::vector<std::string>& inputStreams, uint32_t decompressionThreads, QueueMonitor& monitor,
+    size_t bufferSize, std::atomic<uint32_t>& numParsing, std::string& openError,
+    moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
+    moodycamel::ConcurrentQueue<uint32_t>& workQueue,
+    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
+        seqContainerQueue_,
+    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& readQueue_) {
+
+  using fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+  auto curMaxDelay = MIN_BACKOFF_ITERS;
+  uint32_t fn{0};
+  while (workQueue.try_dequeue(fn)) {
+    auto file = inputStreams[fn];
+    InputStream fp(file, decompressionThreads);
+    if (!inputIsOpen(fp, file, openError)) {
+      --numParsing;
+      return inputOpenError;
+    }
+    std::unique_ptr<ReadChunk<T>> local;
+    getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
+    InPlaceScanner scanner(fp);
+    scanner.attach(local->buffer(0), bufferSize);
+
+    // The number of reads we have in the local chunk
+    size_t numWaiting{0};
+    int status{InPlaceScanner::End};
+    while (true) {
+      status = scanner.next((*local)[numWaiting]);
+      if (status == InPlaceScanner::Record) {
+        ++numWaiting;
+      } else if (status == InPlaceScanner::NeedSpace and numWaiting == 0) {
+        scanner.grow();
+        continue;
+      } else if (status != InPlaceScanner::NeedSpace) {
+        break;
+      }
+
+      // If we've filled the chunk (or its buffer), then dump to the concurrent queue
+      if (numWaiting == local->want() or status == InPlaceScanner::NeedSpace) {
+        scanner.detach();
+        putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
+        numWaiting = 0;
+        // And get more empty reads
+        getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
+        scanner.attach(local->buffer(0), bufferSize);
+      }
+    }
+
+    if (status < InPlaceScanner::End) {
+      --numParsing;
+      return status;
+    }
+
+    // If we hit the end of the file and have any reads in our local chunk
+    // then dump them here.
+    if (numWaiting > 0) {
+      putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
+    } else {
+      curMaxDelay = MIN_BACKOFF_ITERS;
+      while (!seqContainerQueue_.try_enqueue(std::move(local))) {
+        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+      }
+    }
+  }
+
+  --numParsing;
+  return 0;
+}
+
+template <typename T>
+int parseReadViewPair(
+    std::vector<std::string>& inputStreams,
+    std::vector<std::string>& inputStreams2, uint32_t decompressionThreads, QueueMonitor& monitor,
+    size_t bufferSize, std::atomic<uint32_t>& numParsing, std::string& openError,
+    moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
+    moodycamel::ConcurrentQueue<uint32_t>& workQueue,
+    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
+        seqContainerQueue_,
+    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& readQueue_) {
+
+  using fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+  size_t curMaxDelay = MIN_BACKOFF_ITERS;
+  uint32_t fn{0};
+  while (workQueue.try_dequeue(fn)) {
+    auto& file = inputStreams[fn];
+    auto& file2 = inputStreams2[fn];
+
+    InputStream fp(file, decompressionThreads);
+    InputStream fp2(file2, decompressionThreads);
+    if (!inputIsOpen(fp, file, openError) or !inputIsOpen(fp2, file2, openError)) {
+      --numParsing;
+      return inputOpenError;
+    }
+    std::unique_ptr<ReadChunk<T>> local;
+    getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
+    InPlaceScanner scanner(fp);
+    InPlaceScanner scanner2(fp2);
+    scanner.attach(local->buffer(0), bufferSize);
+    scanner2.attach(local->buffer(1), bufferSize);
+
+    // The number of read pairs we have in the local chunk
+    size_t numWaiting{0};
+    int status{InPlaceScanner::End};
+    int status2{InPlaceScanner::End};
+    while (true) {
+      auto& s = (*local)[numWaiting];
+      size_t mark = scanner.mark();
+      status = scanner.next(s.first);
+      status2 = (status == InPlaceScanner::Record) ? scanner2.next(s.second) : InPlaceScanner::End;
+      bool needSpace = status == InPlaceScanner::NeedSpace or status2 == InPlaceScanner::NeedSpace;
+      if (status == InPlaceScanner::Record and status2 == InPlaceScanner::Record) {
+        ++numWaiting;
+      } else if (needSpace) {
+        // the left read is scanned again along with its mate
+        scanner.rewind(mark);
+        if (numWaiting == 0) {
+          if (status == InPlaceScanner::NeedSpace) {
+            scanner.grow();
+          } else {
+            scanner2.grow();
+          }
+          continue;
+        }
+      } else {
+        break;
+      }
+
+      // If we've filled the chunk (or a buffer), then dump to the concurrent queue
+      if (numWaiting == local->want() or needSpace) {
+        scanner.detach();
+        scanner2.detach();
+        putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
+        numWaiting = 0;
+        // And get more empty reads
+        getEmptyChunk(seqContainerQueue_, cCont, local, monitor);
+        scanner.attach(local->buffer(0), bufferSize);
+        scanner2.attach(local->buffer(1), bufferSize);
+      }
+    }
+
+    if (status == InPlaceScanner::ReadError or status2 == InPlaceScanner::ReadError) {
+      --numParsing;
+      return InPlaceScanner::ReadError;
+    } else if (status < InPlaceScanner::End or status2 < InPlaceScanner::End) {
+      --numParsing;
+      return std::min(status, status2);
+    }
+
+    // If we hit the end of the file and have any reads in our local chunk
+    // then dump them here.
+    if (numWaiting > 0) {
+      putFilledChunk(readQueue_, pRead, local, numWaiting, monitor);
+    } else {
+      curMaxDelay = MIN_BACKOFF_ITERS;
+      while (!seqContainerQueue_.try_enqueue(std::move(local))) {
+        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+      }
+    }
+  }
+
+  --numParsing;
+  return 0;
+}
+
+template <> bool FastxParser<ReadSeqView>::start() {
+  if (numParsing_ == 0) {
+    isActive_ = true;
+    monitor_.started();
+    threadResults_.resize(numParsers_);
+    std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    threadErrors_.assign(numParsers_, std::string());
+    for (size_t i = 0; i < numParsers_; ++i) {
+      ++numParsing_;
+      parsingThreads_.emplace_back(new std::thread([this, i]() {
+        this->threadResults_[i] = parseReadViews(this->inputStreams_, this->decompressionThreads_, this->monitor_,
+                   this->chunkBufferSize_(), this->numParsing_, this->threadErrors_[i],
+                   this->consumeContainers_[i].get(),
+                   this->produceReads_[i].get(), this->workQueue_,
+                   this->seqContainerQueue_, this->readQueue_);
+      }));
+    }
+    return true;
+  } else {
+    return false;
+  }
+}
+
+template <> bool FastxParser<ReadViewPair>::start() {
+  if (numParsing_ == 0) {
+    isActive_ = true;
+    monitor_.started();
+    // Some basic checking to ensure the read files look "sane".
+    if (inputStreams_.size() != inputStreams2_.size()) {
+      throw std::invalid_argument("There should be the same number "
+                                  "of files for the left and right reads");
+    }
+    for (size_t i = 0; i < inputStreams_.size(); ++i) {
+      auto& s1 = inputStreams_[i];
+      auto& s2 = inputStreams2_[i];
+      if (s1 == s2) {
+        throw std::invalid_argument("You provided the same file " + s1 +
+                                    " as both a left and right file");
+      }
+    }
+
+    threadResults_.resize(numParsers_);
+    std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    threadErrors_.assign(numParsers_, std::string());
+
+    for (size_t i = 0; i < numParsers_; ++i) {
+      ++numParsing_;
+      parsingThreads_.emplace_back(new std::thread([this, i]() {
+            this->threadResults_[i] = parseReadViewPair(this->inputStreams_, this->inputStreams2_, this->decompressionThreads_, this->monitor_,
+                      this->chunkBufferSize_(), this->numParsing_, this->threadErrors_[i], this->consumeContainers_[i].get(),
+                      this->produceReads_[i].get(), this->workQueue_,
+                      this->seqContainerQueue_, this->readQueue_);
+      }));
+    }
+    return true;
+  } else {
+    return false;
+  }
+}
+
 template <> bool FastxParser<ReadSeq>::start() {
   if (numParsing_ == 0) {
     isActive_ = true;
+    monitor_.started();
     threadResults_.resize(numParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    threadErrors_.assign(numParsers_, std::string());
     for (size_t i = 0; i < numParsers_; ++i) {
       ++numParsing_;
       parsingThreads_.emplace_back(new std::thread([this, i]() {
-        this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
+        this->threadResults_[i] = parseReads(this->inputStreams_, this->decompressionThreads_, this->monitor_, this->numParsing_, this->threadErrors_[i],
                    this->consumeContainers_[i].get(),
                    this->produceReads_[i].get(), this->workQueue_,
                    this->seqContainerQueue_, this->readQueue_);
@@ -357,6 +870,7 @@ template <> bool FastxParser<ReadSeq>::start() {
 template <> bool FastxParser<ReadPair>::start() {
   if (numParsing_ == 0) {
     isActive_ = true;
+    monitor_.started();
     // Some basic checking to ensure the read files look "sane".
     if (inputStreams_.size() != inputStreams2_.size()) {
       throw std::invalid_argument("There should be the same number "
@@ -373,12 +887,13 @@ template <> bool FastxParser<ReadPair>::start() {
 
     threadResults_.resize(numParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    threadErrors_.assign(numParsers_, std::string());
 
     for (size_t i = 0; i < numParsers_; ++i) {
       ++numParsing_;
       parsingThreads_.emplace_back(new std::thread([this, i]() {
-            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
-                      this->numParsing_, this->consumeContainers_[i].get(),
+            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_, this->decompressionThreads_, this->monitor_,
+                      this->numParsing_, this->threadErrors_[i], this->consumeContainers_[i].get(),
                       this->produceReads_[i].get(), this->workQueue_,
                       this->seqContainerQueue_, this->readQueue_);
       }));
@@ -392,12 +907,14 @@ template <> bool FastxParser<ReadPair>::start() {
 template <> bool FastxParser<ReadQual>::start() {
     if (numParsing_ == 0) {
     isActive_ = true;
+    monitor_.started();
     threadResults_.resize(numParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    threadErrors_.assign(numParsers_, std::string());
     for (size_t i = 0; i < numParsers_; ++i) {
       ++numParsing_;
       parsingThreads_.emplace_back(new std::thread([this, i]() {
-        this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
+        this->threadResults_[i] = parseReads(this->inputStreams_, this->decompressionThreads_, this->monitor_, this->numParsing_, this->threadErrors_[i],
                    this->consumeContainers_[i].get(),
                    this->produceReads_[i].get(), this->workQueue_,
                    this->seqContainerQueue_, this->readQueue_);
@@ -412,6 +929,7 @@ template <> bool FastxParser<ReadQual>::start() {
 template <> bool FastxParser<ReadQualPair>::start() {
   if (numParsing_ == 0) {
     isActive_ = true;
+    monitor_.started();
     // Some basic checking to ensure the read files look "sane".
     if (inputStreams_.size() != inputStreams2_.size()) {
       throw std::invalid_argument("There should be the same number "
@@ -428,12 +946,13 @@ template <> bool FastxParser<ReadQualPair>::start() {
 
     threadResults_.resize(numParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
+    threadErrors_.assign(numParsers_, std::string());
 
     for (size_t i = 0; i < numParsers_; ++i) {
       ++numParsing_;
       parsingThreads_.emplace_back(new std::thread([this, i]() {
-            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
-                      this->numParsing_, this->consumeContainers_[i].get(),
+            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_, this->decompressionThreads_, this->monitor_,
+                      this->numParsing_, this->threadErrors_[i], this->consumeContainers_[i].get(),
                       this->produceReads_[i].get(), this->workQueue_,
                       this->seqContainerQueue_, this->readQueue_);
       }));
@@ -446,15 +965,27 @@ template <> bool FastxParser<ReadQualPair>::start() {
 
 
 template <typename T> bool FastxParser<T>::refill(ReadGroup<T>& seqs) {
+  auto waitStart = QueueMonitor::clock::now();
+  if (!seqs.empty()) {
+    monitor_.chunkConsumed(seqs.size(), waitStart - seqs.refilledAt());
+  }
   finishedWithGroup(seqs);
+  monitor_.sampleDepth(readQueue_.size_approx());
   auto curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+  bool got{false};
   while (numParsing_ > 0) {
     if (readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr())) {
-      return true;
+      got = true;
+      break;
     }
     fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
   }
-  return readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr());
+  if (!got) {
+    got = readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr());
+  }
+  seqs.refilledAt() = QueueMonitor::clock::now();
+  monitor_.consumerWaited(seqs.refilledAt() - waitStart);
+  return got;
 }
 
 template <typename T> void FastxParser<T>::finishedWithGroup(ReadGroup<T>& s) {
@@ -469,4 +1000,6 @@ template class FastxParser<ReadSeq>;
 template class FastxParser<ReadPair>;
 template class FastxParser<ReadQual>;
 template class FastxParser<ReadQualPair>;
+template class FastxParser<ReadSeqView>;
+template class FastxParser<ReadViewPair>;
 }
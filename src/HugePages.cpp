@@ -0,0 +1,90 @@
+#include "HugePages.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <sys/mman.h>
+
+// from <linux/mman.h>; older C libraries don't have them
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+namespace pufferfish {
+namespace hugepages {
+
+void Advisor::advise(const void* data, size_t bytes) {
+  requestedBytes_ += bytes;
+  auto start = reinterpret_cast<uintptr_t>(data);
+  uintptr_t first = (start + hugePageSize - 1) & ~(uintptr_t(hugePageSize) - 1);
+  uintptr_t last = (start + bytes) & ~(uintptr_t(hugePageSize) - 1);
+  if (data == nullptr or last <= first) { return; }
+
+  void* p = reinterpret_cast<void*>(first);
+  size_t len = last - first;
+  // the advice has to be in place before a collapse is allowed to stick
+  if (madvise(p, len, MADV_HUGEPAGE) != 0) { return; }
+  if (madvise(p, len, MADV_COLLAPSE) != 0) {
+    // EINVAL: a kernel without MADV_COLLAPSE; anything else (EAGAIN, ENOMEM)
+    // leaves the rest of the range to khugepaged as well
+    collapsed_ = false;
+  }
+  ranges_.emplace_back(first, last);
+}
+
+Advisor::Summary Advisor::summary() const {
+  Summary s;
+  s.requestedBytes = requestedBytes_;
+  s.collapsed = collapsed_;
+  for (auto& r : ranges_) { s.advisedBytes += r.second - r.first; }
+  if (ranges_.empty()) { return s; }
+
+  // The advice splits the mappings at the range boundaries, so every mapping
+  // that overlaps a range lies inside it, and its AnonHugePages (or, when the
+  // array is a file mapping, FilePmdMapped) line counts that range alone.
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool inRange{false};
+  while (std::getline(smaps, line)) {
+    auto dash = line.find('-');
+    if (dash != std::string::npos and dash > 0 and
+        line.find_first_not_of("0123456789abcdef") == dash) {
+      uintptr_t lo = std::strtoull(line.c_str(), nullptr, 16);
+      uintptr_t hi = std::strtoull(line.c_str() + dash + 1, nullptr, 16);
+      inRange = std::any_of(ranges_.begin(), ranges_.end(),
+                            [lo, hi](const std::pair<uintptr_t, uintptr_t>& r) {
+                              return lo < r.second and r.first < hi;
+                            });
+    } else if (inRange and line.compare(0, 14, "AnonHugePages:") == 0) {
+      s.hugeBytes += std::strtoull(line.c_str() + 14, nullptr, 10) * 1024;
+    } else if (inRange and line.compare(0, 14, "FilePmdMapped:") == 0) {
+      // the read-only mmap'ed arrays, on kernels with THP for page cache
+      s.hugeBytes += std::strtoull(line.c_str() + 14, nullptr, 10) * 1024;
+    }
+  }
+  s.hugeBytes = std::min(s.hugeBytes, s.advisedBytes);
+  return s;
+}
+
+std::string Advisor::describe() const {
+  auto s = summary();
+  auto mb = [](size_t b) { return b / (1024 * 1024); };
+  std::stringstream ss;
+  ss << mb(s.hugeBytes) << " MB of " << mb(s.requestedBytes)
+     << " MB of index lookup structures on 2MB pages";
+  if (s.advisedBytes == 0) {
+    ss << " (the kernel refused transparent huge pages)";
+  } else if (!s.collapsed and s.hugeBytes < s.advisedBytes) {
+    ss << " (" << mb(s.advisedBytes - s.hugeBytes) << " MB more left to khugepaged)";
+  }
+  return ss.str();
+}
+
+} // namespace hugepages
+} // namespace pufferfish
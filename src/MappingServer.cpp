@@ -0,0 +1,197 @@
+#include "MappingServer.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace pufferfish {
+namespace server {
+
+namespace {
+// messages bigger than this are not ours
+constexpr uint32_t maxStrings = 1 << 16;
+constexpr uint32_t maxStringLength = 1 << 28;
+// jobs run one at a time, so a client that connects and goes quiet must not
+// hold the server for longer than this
+constexpr time_t clientTimeoutSec = 30;
+
+bool writeAll(int fd, const void* data, size_t len) {
+  auto p = static_cast<const char*>(data);
+  while (len > 0) {
+    // MSG_NOSIGNAL: a client that went away must not take the server with it
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 and errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool readAll(int fd, void* data, size_t len) {
+  auto p = static_cast<char*>(data);
+  while (len > 0) {
+    ssize_t n = recv(fd, p, len, 0);
+    if (n < 0 and errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool sendStrings(int fd, const std::vector<std::string>& strs) {
+  uint32_t count = static_cast<uint32_t>(strs.size());
+  if (!writeAll(fd, &count, sizeof(count))) { return false; }
+  for (auto& s : strs) {
+    uint32_t len = static_cast<uint32_t>(s.size());
+    if (!writeAll(fd, &len, sizeof(len)) or !writeAll(fd, s.data(), s.size())) { return false; }
+  }
+  return true;
+}
+
+bool recvStrings(int fd, std::vector<std::string>& strs) {
+  uint32_t count{0};
+  if (!readAll(fd, &count, sizeof(count)) or count > maxStrings) { return false; }
+  strs.resize(count);
+  for (auto& s : strs) {
+    uint32_t len{0};
+    if (!readAll(fd, &len, sizeof(len)) or len > maxStringLength) { return false; }
+    s.resize(len);
+    if (len > 0 and !readAll(fd, &s[0], len)) { return false; }
+  }
+  return true;
+}
+
+bool socketAddress(const std::string& path, sockaddr_un& addr, std::string& err) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() or path.size() >= sizeof(addr.sun_path)) {
+    err = "socket path must be 1 to " + std::to_string(sizeof(addr.sun_path) - 1) + " characters";
+    return false;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+int connectTo(const std::string& path, std::string& err) {
+  sockaddr_un addr;
+  if (!socketAddress(path, addr, err)) { return -1; }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    err = std::strerror(errno);
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    err = std::strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+} // namespace
+
+int listenOn(const std::string& path, std::string& err) {
+  sockaddr_un addr;
+  if (!socketAddress(path, addr, err)) { return -1; }
+  std::string ignored;
+  int live = connectTo(path, ignored);
+  if (live >= 0) {
+    close(live);
+    err = "another server is already listening on " + path;
+    return -1;
+  }
+  // only a socket is ours to replace; anything else at `path` is a mistake
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      err = path + " exists and is not a socket";
+      return -1;
+    }
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    err = std::strerror(errno);
+    return -1;
+  }
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 or listen(fd, 128) != 0) {
+    err = std::strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool acceptJob(int listenFd, Job& job, std::string& err) {
+  job = Job();
+  int fd = accept(listenFd, nullptr, nullptr);
+  if (fd < 0) {
+    err = std::strerror(errno);
+    return false;
+  }
+  timeval timeout{clientTimeoutSec, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  std::vector<std::string> msg;
+  errno = 0;
+  if (!recvStrings(fd, msg)) {
+    err = (errno == EAGAIN or errno == EWOULDBLOCK) ? "client sent no job in time" : "malformed job";
+    close(fd);
+    return false;
+  }
+  if (msg.size() < 2 or msg[0] != jobMagic) {
+    err = "malformed job";
+    close(fd);
+    return false;
+  }
+  job.fd = fd;
+  job.cwd = msg[1];
+  job.args.assign(msg.begin() + 2, msg.end());
+  return true;
+}
+
+bool finishJob(Job& job, int status, const std::string& log) {
+  bool sent = sendStrings(job.fd, {std::to_string(status), log});
+  close(job.fd);
+  job.fd = -1;
+  return sent;
+}
+
+int runOnServer(const std::string& path, const std::vector<std::string>& args) {
+  std::string err;
+  int fd = connectTo(path, err);
+  if (fd < 0) {
+    std::cerr << "Could not reach the pufferfish server at " << path << ": " << err << "\n";
+    return 1;
+  }
+  std::vector<char> cwd(4096);
+  if (getcwd(cwd.data(), cwd.size()) == nullptr) {
+    std::cerr << "Could not get the working directory: " << std::strerror(errno) << "\n";
+    close(fd);
+    return 1;
+  }
+  std::vector<std::string> msg{jobMagic, cwd.data()};
+  msg.insert(msg.end(), args.begin(), args.end());
+  std::vector<std::string> reply;
+  bool ok = sendStrings(fd, msg) and recvStrings(fd, reply) and reply.size() == 2;
+  close(fd);
+  if (!ok) {
+    std::cerr << "The pufferfish server at " << path << " dropped the job\n";
+    return 1;
+  }
+  std::cerr << reply[1];
+  return std::atoi(reply[0].c_str());
+}
+
+} // namespace server
+} // namespace pufferfish
@@ -33,6 +33,9 @@ static inline float fasterlog2(float x) {
   return y - 126.94269504f;
 }
 
+constexpr int32_t MemClusterer::chainScoreScale;
+constexpr int32_t MemClusterer::chainBlockSize;
+
 void MemClusterer::setConsensusFraction(double cf) { consensusFraction_ = cf; }
 double MemClusterer::getConsensusFraction() const { return consensusFraction_; }
 
@@ -44,6 +47,14 @@ pufferfish::util::HitFilterPolicy MemClusterer::getHitFilterPolicy() const {
   return hitFilterPolicy_;
 }
 
+void MemClusterer::setMaxChainLookback(uint32_t lookback) {
+  maxChainLookback_ = std::max(lookback, 1u);
+}
+
+uint32_t MemClusterer::getMaxChainLookback() const {
+  return maxChainLookback_;
+}
+
 void MemClusterer::setMaxAllowedRefsPerHit(uint32_t maxh){
   maxAllowedRefsPerHit_ = maxh;
 }
@@ -105,6 +116,82 @@ size_t MemClusterer::fillMemCollection(std::vector<std::pair<int, pufferfish::ut
   return maxNonDecoyHits;
 }
 
+uint64_t MemClusterer::layoutSignature(std::vector<pufferfish::util::MemInfo>& memList,
+                                       std::vector<pufferfish::util::UniMemInfo>& memCollection,
+                                       bool isFw, int64_t origin) const {
+  // boost::hash_combine style mixing of (uni-MEM, relative position) pairs
+  auto mix = [](uint64_t h, uint64_t v) -> uint64_t {
+    return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+  };
+  uint64_t h = mix(memList.size(), isFw ? 1 : 0);
+  for (auto& m : memList) {
+    h = mix(h, static_cast<uint64_t>(std::distance(memCollection.begin(), m.memInfo)));
+    h = mix(h, static_cast<uint64_t>(static_cast<int64_t>(m.tpos) - origin));
+  }
+  return h;
+}
+
+bool MemClusterer::layoutMatches(const ChainGroup& g,
+                                 std::vector<pufferfish::util::MemInfo>& memList,
+                                 std::vector<pufferfish::util::UniMemInfo>& memCollection,
+                                 bool isFw, int64_t origin) const {
+  if (g.isFw != isFw or (g.layoutEnd - g.layoutStart) != memList.size()) { return false; }
+  auto lit = chainGroupLayouts_.begin() + g.layoutStart;
+  for (auto& m : memList) {
+    if (lit->first != std::distance(memCollection.begin(), m.memInfo) or
+        lit->second != static_cast<int64_t>(m.tpos) - origin) {
+      return false;
+    }
+    ++lit;
+  }
+  return true;
+}
+
+// Merge MEMs within each cluster that are contiguous on both the read and
+// the reference.
+void MemClusterer::compactMemClusters(std::vector<pufferfish::util::MemCluster>& clusters,
+                                      bool isFw, int32_t signedReadLen) {
+  int32_t prev_qposi_end = 0;
+  int32_t prev_rposi_end = 0;
+  size_t currentMemIdx = 0;
+  for (auto & memClust : clusters) {
+    auto &memList = memClust.mems;
+    for (int32_t i = 0; i < static_cast<int32_t>(memList.size()); ++i) {
+      auto &hi = memList[i];
+      //chainOfInterest = /*chainOfInterest or */(hi.rpos == 1 and hi.tpos == 163 and tid == 151214);
+      int32_t qposi_start = hi.isFw ? hi.rpos : signedReadLen - (hi.rpos + hi.extendedlen);
+      int32_t rposi_start = hi.tpos;
+
+      int32_t qposi_end = hi.isFw ? (hi.rpos + hi.extendedlen) : (signedReadLen - hi.rpos);
+      int32_t rposi_end = hi.tpos + hi.extendedlen;
+
+      int32_t overlap_read = (prev_qposi_end - qposi_start);
+      int32_t overlap_ref = (prev_rposi_end - rposi_start);
+      if (i > 0 and overlap_ref >= 0 and (overlap_ref == overlap_read)) {
+        auto &lastMem = memList[currentMemIdx];
+        uint32_t extension = rposi_end - prev_rposi_end;
+        lastMem.extendedlen += extension;
+        if (!isFw) {
+          lastMem.rpos = hi.rpos;
+        }
+        hi.extendedlen = std::numeric_limits<decltype(hi.extendedlen)>::max();
+      } else {
+        currentMemIdx=i;
+      }
+      //prev_qposi_start = qposi_start;
+      //prev_rposi_start = rposi_start;
+      prev_qposi_end = qposi_end;
+      prev_rposi_end = rposi_end;
+    }
+
+    memList.erase(std::remove_if(memList.begin(), memList.end(),
+                                 [](pufferfish::util::MemInfo& m) {
+                                     bool r = m.extendedlen == std::numeric_limits<decltype(m.extendedlen)>::max(); return r;
+                                 }), memList.end());
+  }
+
+}
+
 bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::ProjectedHits>> &hits,
                                 pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>>& memClusters,
                                 //phmap::flat_hash_map<pufferfish::common_types::ReferenceID, std::vector<pufferfish::util::MemCluster>> &memClusters,
@@ -126,13 +213,19 @@ bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::Pro
     return false;
   }
 
+  chainGroupIndex_.clear();
+  chainGroups_.clear();
+  chainGroupLayouts_.clear();
+  chainGroupClusters_.clear();
+  chainGroupMems_.clear();
+
   bool filterBefore = (hitFilterPolicy_ == HitFilterPolicy::FILTER_BEFORE_CHAINING) or
     (hitFilterPolicy_ == HitFilterPolicy::FILTER_BEFORE_AND_AFTER_CHAINING);
   bool filterAfter= (hitFilterPolicy_ == HitFilterPolicy::FILTER_AFTER_CHAINING) or
     (hitFilterPolicy_ == HitFilterPolicy::FILTER_BEFORE_AND_AFTER_CHAINING);
 
 
-  double maxChainScore{0.0};
+  int32_t maxChainScore{0};
   int32_t signedReadLen = static_cast<int32_t>(readLen);
   for (auto hitIt = trMemMap.begin(); hitIt != trMemMap.end(); ++hitIt) {
     auto& trOri = hitIt->first;
@@ -141,6 +234,53 @@ bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::Pro
     auto &memList = *hitIt->second;
     size_t hits = memList.size();
     if (filterBefore and (hits < consensusFraction_ * maxHits)) { continue; }
+    if (memList.empty()) { continue; }
+
+    // References covered by the same projected hits at the same relative
+    // offsets (e.g. isoforms sharing the exons this read falls in) chain
+    // identically up to a shift in reference position.  We chain the first
+    // such reference and replay its clusters for the others.
+    int64_t layoutOrigin = static_cast<int64_t>(memList.front().tpos);
+    uint64_t layoutHash = layoutSignature(memList, memCollection, isFw, layoutOrigin);
+    int32_t groupId{-1};
+    auto groupIt = chainGroupIndex_.find(layoutHash);
+    if (groupIt == chainGroupIndex_.end()) {
+      groupId = static_cast<int32_t>(chainGroups_.size());
+      chainGroupIndex_[layoutHash] = groupId;
+      chainGroups_.emplace_back();
+      auto& g = chainGroups_.back();
+      g.isFw = isFw;
+      g.origin = layoutOrigin;
+      g.layoutStart = static_cast<uint32_t>(chainGroupLayouts_.size());
+      for (auto& m : memList) {
+        chainGroupLayouts_.emplace_back(std::distance(memCollection.begin(), m.memInfo),
+                                        static_cast<int64_t>(m.tpos) - layoutOrigin);
+      }
+      g.layoutEnd = static_cast<uint32_t>(chainGroupLayouts_.size());
+    } else if (layoutMatches(chainGroups_[groupIt->second], memList, memCollection, isFw, layoutOrigin)) {
+      auto& g = chainGroups_[groupIt->second];
+      if (filterAfter and g.bestScore < maxChainScore * consensusFraction_) { continue; }
+      maxChainScore = std::max(g.bestScore, maxChainScore);
+      if (g.hasClusters) {
+        auto& tidClusters = memClusters[tid];
+        int64_t shift = layoutOrigin - g.origin;
+        for (uint32_t ci = g.clustStart; ci < g.clustEnd; ++ci) {
+          auto& gc = chainGroupClusters_[ci];
+          tidClusters.emplace_back(isFw, signedReadLen);
+          auto& replayed = tidClusters.back();
+          for (uint32_t mi = gc.memStart; mi < gc.memEnd; ++mi) {
+            auto& m = chainGroupMems_[mi];
+            replayed.mems.emplace_back(m.memInfo, static_cast<size_t>(static_cast<int64_t>(m.tpos) + shift),
+                                       m.extendedlen, m.rpos, m.isFw);
+          }
+          replayed.coverage = gc.coverage;
+          replayed.perfectChain = gc.perfectChain;
+        }
+        compactMemClusters(tidClusters, isFw, signedReadLen);
+        ++numReplayedChains_;
+        continue;
+      }
+    }
 
     // sort memList according to mem reference positions
     std::sort(memList.begin(), memList.end(),
@@ -163,27 +303,10 @@ bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::Pro
 
     //auto minPosIt = memList.begin();
     // find the valid chains
-    // Use variant of minimap2 scoring (Li 2018)
-    // https://academic.oup.com/bioinformatics/advance-article/doi/10.1093/bioinformatics/bty191/4994778
-    auto alpha = [](int32_t qdiff, int32_t rdiff, int32_t ilen) -> double {
-        double score = ilen;
-        double mindiff = (qdiff < rdiff) ? qdiff : rdiff;
-        return (score < mindiff) ? score : mindiff;
-    };
-
-    auto beta = [maxSpliceGap](int32_t qdiff, int32_t rdiff, double avgseed) -> double {
-        if (qdiff < 0 or ((uint32_t) std::max(qdiff, rdiff) > maxSpliceGap)) {
-          return std::numeric_limits<double>::infinity();
-        }
-        double l = qdiff - rdiff;
-        int32_t al = std::abs(l);
-        // To penalize cases with organized gaps for reads such as
-        // CTCCTCATCCTCCTCATCCTCCTCCTCCTCCTCCTCCTCCGCTGCCGCCGCCGACCGACTGAACCGCACCCGCCGCGCCGCACCGCCTCCAAGTCCCGGC
-        // polyester simulated on human transcriptome. 0.01 -> 0.05
-        return (l == 0) ? 0.0 : (0.05 * avgseed * al + 0.5 * fastlog2(static_cast<float>(al)));
-    };
-    constexpr const double bottomScore = std::numeric_limits<double>::lowest();
-    double bestScore = bottomScore;
+    // Chain scores are kept in fixed point (chainScoreScale units per base)
+    // so that the predecessor scan below is pure integer arithmetic.
+    constexpr const int32_t bottomScore = std::numeric_limits<int32_t>::min() / 2;
+    int32_t bestScore = bottomScore;
     int32_t bestChainEnd = -1;
     double avgseed = 31.0;
     f.clear();
@@ -254,59 +377,100 @@ bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::Pro
     }
     */
 
-    p.reserve(memList.size());
-    f.reserve(memList.size());
-    for (int32_t i = 0; i < static_cast<int32_t>(memList.size()); ++i) {
+    const int32_t numMems = static_cast<int32_t>(memList.size());
+    p.reserve(numMems);
+    f.reserve(numMems);
+    // Structure-of-arrays view of the compacted MEMs.  The read coordinate
+    // is stored so that qdiff = qKey_[i] - qKey_[j] for either orientation.
+    qKey_.resize(numMems);
+    rKey_.resize(numMems);
+    mLen_.resize(numMems);
+    for (int32_t i = 0; i < numMems; ++i) {
       auto &hi = memList[i];
+      qKey_[i] = isFw ? static_cast<int32_t>(hi.rpos + hi.extendedlen) : -static_cast<int32_t>(hi.rpos);
+      rKey_[i] = static_cast<int32_t>(hi.tpos + hi.extendedlen);
+      mLen_[i] = static_cast<int32_t>(hi.extendedlen);
+    }
 
-      int32_t qposi = hi.rpos + hi.extendedlen;
-      int32_t rposi = hi.tpos + hi.extendedlen;
+    // Use variant of minimap2 scoring (Li 2018)
+    // https://academic.oup.com/bioinformatics/advance-article/doi/10.1093/bioinformatics/bty191/4994778
+    // To penalize cases with organized gaps for reads such as
+    // CTCCTCATCCTCCTCATCCTCCTCCTCCTCCTCCTCCTCCGCTGCCGCCGCCGACCGACTGAACCGCACCCGCCGCGCCGCACCGCCTCCAAGTCCCGGC
+    // polyester simulated on human transcriptome. 0.01 -> 0.05
+    const float gapCoef = static_cast<float>(0.05 * avgseed * chainScoreScale);
+    constexpr const float logCoef = 0.5f * chainScoreScale;
+    constexpr const float maxBeta = static_cast<float>(1 << 30);
+    const int32_t signedMaxSpliceGap = static_cast<int32_t>(std::min(maxSpliceGap,
+                                                            static_cast<uint32_t>(std::numeric_limits<int32_t>::max())));
+    const int32_t maxRefDist = signedReadLen * 2;
+
+    for (int32_t i = 0; i < numMems; ++i) {
+      const int32_t qi = qKey_[i];
+      const int32_t ri = rKey_[i];
+      const int32_t leni = mLen_[i];
 
-      double baseScore = static_cast<double>(hi.extendedlen);
       p.push_back(i);
-      f.push_back(baseScore);
+      f.push_back(leni * chainScoreScale);
 
-      // possible predecessors in the chain
+      // possible predecessors in the chain, at most maxChainLookback_ of them
+      const int32_t jMin = std::max(0, i - static_cast<int32_t>(maxChainLookback_));
       int32_t numRounds{2};
-      (void) numRounds;
-      for (int32_t j = i - 1; j >= 0; --j) {
-        auto &hj = memList[j];
-
-        int32_t qposj = hj.rpos + hj.extendedlen;
-        int32_t rposj = hj.tpos + hj.extendedlen;
-
-        int32_t qdiff = isFw ? qposi - qposj :
-                        (qposj - hj.extendedlen) - (qposi - hi.extendedlen);
-        int32_t rdiff = rposi - rposj;
-
-        auto extensionScore = f[j] + alpha(qdiff, rdiff, hi.extendedlen) - beta(qdiff, rdiff, avgseed);
-
-        bool extendWithJ = (extensionScore > f[i]);
-        p[i] = extendWithJ ? j : p[i];
-        f[i] = extendWithJ ? extensionScore : f[i];
-
-        // HEURISTIC : if we connected this match to an earlier one
-        // i.e. if we extended the chain.
-        // This implements Heng Li's heuristic ---
-        // "
-        // We note that if anchor i is chained to j, chaining i to a predecessor of j
-        // is likely to yield a lower score.
-        // "
-        // here we take this to the extreme, and stop at the first j to which we chain.
-        // we can add a parameter "h" as in the minimap paper.  But here we expect the
-        // chains of matches in short reads to be short enough that this may not be worth it.
-        if (hChain and p[i] < i) {
-          numRounds--;
-          if (numRounds <= 0) { break; }
+      bool done{false};
+      for (int32_t blockEnd = i; blockEnd > jMin and !done; blockEnd -= chainBlockSize) {
+        const int32_t blockStart = std::max(jMin, blockEnd - chainBlockSize);
+        const int32_t blockLen = blockEnd - blockStart;
+
+        // Score every candidate predecessor in this block.  The loop is
+        // branch-free over plain arrays so that it is vectorized.
+        const int32_t* qk = qKey_.data() + blockStart;
+        const int32_t* rk = rKey_.data() + blockStart;
+        const int32_t* fk = f.data() + blockStart;
+        for (int32_t k = 0; k < blockLen; ++k) {
+          int32_t qdiff = qi - qk[k];
+          int32_t rdiff = ri - rk[k];
+          int32_t mindiff = (qdiff < rdiff) ? qdiff : rdiff;
+          int32_t maxdiff = (qdiff < rdiff) ? rdiff : qdiff;
+          int32_t alpha = (leni < mindiff) ? leni : mindiff;
+          int32_t l = maxdiff - mindiff;
+          float fl = static_cast<float>(l);
+          float beta = gapCoef * fl + logCoef * fastlog2(fl);
+          // invalid lanes may carry arbitrarily large gaps; keep the cast in range
+          beta = (l == 0) ? 0.0f : ((beta < maxBeta) ? beta : maxBeta);
+          bool invalid = (qdiff < 0) | (maxdiff > signedMaxSpliceGap);
+          int32_t score = fk[k] + alpha * chainScoreScale - static_cast<int32_t>(beta);
+          candScore_[k] = invalid ? bottomScore : score;
         }
-        // If the last two hits are too far from each other, we are sure that 
-        // every other hit will be even further since the mems are sorted
-        if (rdiff > signedReadLen * 2) {
-          break;
+
+        for (int32_t k = blockLen - 1; k >= 0; --k) {
+          int32_t j = blockStart + k;
+          bool extendWithJ = (candScore_[k] > f[i]);
+          p[i] = extendWithJ ? j : p[i];
+          f[i] = extendWithJ ? candScore_[k] : f[i];
+
+          // HEURISTIC : if we connected this match to an earlier one
+          // i.e. if we extended the chain.
+          // This implements Heng Li's heuristic ---
+          // "
+          // We note that if anchor i is chained to j, chaining i to a predecessor of j
+          // is likely to yield a lower score.
+          // "
+          // here we take this to the extreme, and stop at the first j to which we chain.
+          // we can add a parameter "h" as in the minimap paper.  But here we expect the
+          // chains of matches in short reads to be short enough that this may not be worth it.
+          if (hChain and p[i] < i) {
+            numRounds--;
+            if (numRounds <= 0) { done = true; break; }
+          }
+          // If the last two hits are too far from each other, we are sure that
+          // every other hit will be even further since the mems are sorted
+          if (ri - rKey_[j] > maxRefDist) {
+            done = true;
+            break;
+          }
+          // Mohsen: This heuristic hurts the accuracy of the chain in the case of this read:
+          // TGAACGCTCTATGATGTCAGCCTACGAGCGCTCTATGATGTTAGCCTACGAGCGCTCTATGATGTCCCCTATGGCTGAGCGCTCTATGATGTCAGCTTAT
+          // from Polyester simalted sample aligning to the human transcriptome
         }
-        // Mohsen: This heuristic hurts the accuracy of the chain in the case of this read:
-        // TGAACGCTCTATGATGTCAGCCTACGAGCGCTCTATGATGTTAGCCTACGAGCGCTCTATGATGTCCCCTATGGCTGAGCGCTCTATGATGTCAGCTTAT
-        // from Polyester simalted sample aligning to the human transcriptome
       }
       if (f[i] > bestScore) {
         bestScore = f[i];
@@ -320,12 +484,15 @@ bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::Pro
 
     // early exit if this doesn't seem a promising chain
     //if (fp == FilterPolicy::AFTER_CHAIN and (bestScore < maxChainScore * consensusFraction_)) { continue; }
+    if (groupId >= 0) { chainGroups_[groupId].bestScore = bestScore; }
     if (filterAfter and bestScore < maxChainScore * consensusFraction_) { continue; }
     maxChainScore = std::max(bestScore, maxChainScore);
 
     //if (chainOfInterest) { std::cerr << "bestScore = " << bestScore << "\n"; }
     // Do backtracking
-    chobo::small_vector<uint8_t> seen(f.size(), 0);
+    auto& tidClusters = memClusters[tid];
+    size_t firstNewCluster = tidClusters.size();
+    seen.assign(f.size(), 0);
     for (auto bestChainEnd : bestChainEndList) {
       if (bestChainEnd >= 0) {
         bool shouldBeAdded = true;
@@ -350,14 +517,14 @@ bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::Pro
         if (shouldBeAdded) {
           // @fataltes --- is there a reason we were inserting here before rather than
           // pushing back?
-          memClusters[tid].push_back(pufferfish::util::MemCluster(isFw, signedReadLen));
-          auto& justAddedCluster = memClusters[tid].back();
+          tidClusters.emplace_back(isFw, signedReadLen);
+          auto& justAddedCluster = tidClusters.back();
           for (auto it = memIndicesInReverse.rbegin(); it != memIndicesInReverse.rend(); it++) {
             justAddedCluster.addMem(memList[*it].memInfo, memList[*it].tpos,
                                        memList[*it].extendedlen, memList[*it].rpos, isFw);
           }
-          justAddedCluster.coverage = bestScore;
-          if (justAddedCluster.coverage == signedReadLen)
+          justAddedCluster.coverage = static_cast<double>(bestScore) / chainScoreScale;
+          if (bestScore == signedReadLen * chainScoreScale)
             justAddedCluster.perfectChain = true;
           /*
           if (verbose)
@@ -375,42 +542,26 @@ bool MemClusterer::findOptChain(std::vector<std::pair<int, pufferfish::util::Pro
       }
     }
 
-    for (auto & memClust : memClusters[tid]) {
-      auto &memList = memClust.mems;
-      for (int32_t i = 0; i < static_cast<int32_t>(memList.size()); ++i) {
-        auto &hi = memList[i];
-        //chainOfInterest = /*chainOfInterest or */(hi.rpos == 1 and hi.tpos == 163 and tid == 151214);
-        int32_t qposi_start = hi.isFw ? hi.rpos : signedReadLen - (hi.rpos + hi.extendedlen);
-        int32_t rposi_start = hi.tpos;
-
-        int32_t qposi_end = hi.isFw ? (hi.rpos + hi.extendedlen) : (signedReadLen - hi.rpos);
-        int32_t rposi_end = hi.tpos + hi.extendedlen;
-
-        int32_t overlap_read = (prev_qposi_end - qposi_start);
-        int32_t overlap_ref = (prev_rposi_end - rposi_start);
-        if (i > 0 and overlap_ref >= 0 and (overlap_ref == overlap_read)) {
-          auto &lastMem = memList[currentMemIdx];
-          uint32_t extension = rposi_end - prev_rposi_end;
-          lastMem.extendedlen += extension;
-          if (!isFw) {
-            lastMem.rpos = hi.rpos;
-          }
-          hi.extendedlen = std::numeric_limits<decltype(hi.extendedlen)>::max();
-        } else {
-          currentMemIdx=i;
-        }
-        //prev_qposi_start = qposi_start;
-        //prev_rposi_start = rposi_start;
-        prev_qposi_end = qposi_end;
-        prev_rposi_end = rposi_end;
+    // remember the (uncompacted) clusters of this layout so that other
+    // references sharing it can replay them
+    if (groupId >= 0) {
+      auto& g = chainGroups_[groupId];
+      g.clustStart = static_cast<uint32_t>(chainGroupClusters_.size());
+      for (size_t ci = firstNewCluster; ci < tidClusters.size(); ++ci) {
+        auto& c = tidClusters[ci];
+        chainGroupClusters_.emplace_back();
+        auto& gc = chainGroupClusters_.back();
+        gc.memStart = static_cast<uint32_t>(chainGroupMems_.size());
+        chainGroupMems_.insert(chainGroupMems_.end(), c.mems.begin(), c.mems.end());
+        gc.memEnd = static_cast<uint32_t>(chainGroupMems_.size());
+        gc.coverage = c.coverage;
+        gc.perfectChain = c.perfectChain;
       }
-
-      memList.erase(std::remove_if(memList.begin(), memList.end(),
-                                   [](pufferfish::util::MemInfo& m) {
-                                       bool r = m.extendedlen == std::numeric_limits<decltype(m.extendedlen)>::max(); return r;
-                                   }), memList.end());
+      g.clustEnd = static_cast<uint32_t>(chainGroupClusters_.size());
+      g.hasClusters = true;
     }
 
+    compactMemClusters(tidClusters, isFw, signedReadLen);
   }
   /*
   if (verbose)
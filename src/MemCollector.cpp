@@ -10,6 +10,16 @@ void MemCollector<PufferfishIndexT>::configureMemClusterer(uint32_t max) {
   mc.setMaxAllowedRefsPerHit(max);
 }
 
+template <typename PufferfishIndexT>
+void MemCollector<PufferfishIndexT>::setMaxChainLookback(uint32_t lookback) {
+  mc.setMaxChainLookback(lookback);
+}
+
+template <typename PufferfishIndexT>
+uint64_t MemCollector<PufferfishIndexT>::numReplayedChains() const {
+  return mc.numReplayedChains();
+}
+
 template <typename PufferfishIndexT>
 void MemCollector<PufferfishIndexT>::setHitFilterPolicy(pufferfish::util::HitFilterPolicy hfp) {
   mc.setHitFilterPolicy(hfp);
@@ -116,7 +126,7 @@ double MemCollector<PufferfishIndexT>::getConsensusFraction() const {
 }
 
 template <typename PufferfishIndexT>
-bool MemCollector<PufferfishIndexT>::operator()(std::string &read,
+bool MemCollector<PufferfishIndexT>::operator()(stx::string_view read,
                   pufferfish::util::QueryCache& qc,
                   bool isLeft,
                   bool verbose) {
@@ -190,7 +200,7 @@ bool MemCollector<PufferfishIndexT>::operator()(std::string &read,
 }
 
 template <typename PufferfishIndexT>
-bool MemCollector<PufferfishIndexT>::findChains(std::string &read,
+bool MemCollector<PufferfishIndexT>::findChains(stx::string_view read,
                                                 pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>>& memClusters,
                                                 //phmap::flat_hash_map<size_t, std::vector<pufferfish::util::MemCluster>>& memClusters,
                   uint32_t maxSpliceGap,
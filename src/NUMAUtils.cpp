@@ -0,0 +1,137 @@
+#include "NUMAUtils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// from <linux/mempolicy.h>; spelled out so that we don't need libnuma's headers
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0
+#define MPOL_PREFERRED 1
+#define MPOL_INTERLEAVE 3
+#endif
+
+namespace pufferfish {
+namespace numa {
+
+namespace {
+constexpr size_t bitsPerLong = 8 * sizeof(unsigned long);
+
+long setMempolicy(int mode, const std::vector<unsigned long>& mask) {
+#ifdef SYS_set_mempolicy
+  // maxnode counts one past the last bit the kernel should look at
+  unsigned long maxNode = mask.empty() ? 0 : mask.size() * bitsPerLong + 1;
+  return syscall(SYS_set_mempolicy, mode, mask.empty() ? nullptr : mask.data(), maxNode);
+#else
+  (void)mode;
+  (void)mask;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+std::vector<unsigned long> nodeMask(const std::vector<int>& nodeIds) {
+  int maxId = nodeIds.empty() ? 0 : *std::max_element(nodeIds.begin(), nodeIds.end());
+  std::vector<unsigned long> mask(static_cast<size_t>(maxId) / bitsPerLong + 1, 0);
+  for (int id : nodeIds) {
+    mask[static_cast<size_t>(id) / bitsPerLong] |= 1UL << (static_cast<size_t>(id) % bitsPerLong);
+  }
+  return mask;
+}
+
+// a sysfs cpulist such as "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() or range == "\n") { continue; }
+    auto dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for (int c = first; c <= last; ++c) { cpus.push_back(c); }
+  }
+  return cpus;
+}
+} // namespace
+
+Topology Topology::detect() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  auto isAllowed = [&](int cpu) -> bool {
+    return !haveMask or (cpu >= 0 and cpu < CPU_SETSIZE and CPU_ISSET(cpu, &allowed));
+  };
+
+  std::vector<std::pair<int, std::vector<int>>> nodes;
+  if (DIR* dir = opendir("/sys/devices/system/node")) {
+    while (struct dirent* e = readdir(dir)) {
+      std::string name(e->d_name);
+      if (name.compare(0, 4, "node") != 0 or name.size() == 4 or
+          name.find_first_not_of("0123456789", 4) != std::string::npos) {
+        continue;
+      }
+      std::ifstream in("/sys/devices/system/node/" + name + "/cpulist");
+      std::string list;
+      std::getline(in, list);
+      std::vector<int> cpus;
+      for (int c : parseCpuList(list)) {
+        if (isAllowed(c)) { cpus.push_back(c); }
+      }
+      // memory-only nodes, or nodes we may not run on, get no threads
+      if (!cpus.empty()) { nodes.emplace_back(std::atoi(name.c_str() + 4), cpus); }
+    }
+    closedir(dir);
+  }
+  std::sort(nodes.begin(), nodes.end());
+
+  Topology topo;
+  for (auto& n : nodes) {
+    topo.nodeIds.push_back(n.first);
+    topo.nodeCpus.push_back(std::move(n.second));
+  }
+  if (topo.nodeIds.empty()) {
+    std::vector<int> cpus;
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int c = 0; c < numCpus; ++c) {
+      if (isAllowed(c)) { cpus.push_back(c); }
+    }
+    topo.nodeIds.push_back(0);
+    topo.nodeCpus.push_back(cpus);
+  }
+  return topo;
+}
+
+bool interleaveAllocations(const Topology& topo) {
+  return setMempolicy(MPOL_INTERLEAVE, nodeMask(topo.nodeIds)) == 0;
+}
+
+bool preferNode(int nodeId) {
+  return setMempolicy(MPOL_PREFERRED, nodeMask({nodeId})) == 0;
+}
+
+bool resetAllocations() {
+  return setMempolicy(MPOL_DEFAULT, {}) == 0;
+}
+
+bool pinToNode(const Topology& topo, size_t node) {
+  if (node >= topo.numNodes() or topo.nodeCpus[node].empty()) { return false; }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int c : topo.nodeCpus[node]) {
+    if (c >= 0 and c < CPU_SETSIZE) { CPU_SET(c, &cpus); }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+} // namespace numa
+} // namespace pufferfish
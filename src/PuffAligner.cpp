@@ -1,7 +1,12 @@
 #include "nonstd/string_view.hpp"
 #include "PuffAligner.hpp"
+#include "ScoreBound.hpp"
 #include "Util.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+
 std::string extractReadSeq(const std::string& readSeq, uint32_t rstart, uint32_t rend, bool isFw) {
     std::string subseq = readSeq.substr(rstart, rend - rstart);
     if (isFw)
@@ -9,6 +14,16 @@ std::string extractReadSeq(const std::string& readSeq, uint32_t rstart, uint32_t
     return pufferfish::util::reverseComplement(subseq); //reverse-complement the substring
 }
 
+#ifdef SPDLOG_DEBUG_ON
+// The codes ksw2 aligns (0-3, and 4 for N), back as bases for the debug output
+static std::string codesToBases(const uint8_t* codes, size_t len) {
+    std::string bases(len, 'N');
+    for (size_t i = 0; i < len; ++i) { bases[i] = codes[i] < 4 ? "ACGT"[codes[i]] : 'N'; }
+    return bases;
+}
+static std::string codesToBases(const std::vector<uint8_t>& codes) { return codesToBases(codes.data(), codes.size()); }
+#endif // SPDLOG_DEBUG_ON
+
 // decode CIGAR, just like : https://github.com/lh3/ksw2/blob/master/cli.c#L134
 std::string cigar2str(const ksw_extz_t *ez) {
     std::string cigar;
@@ -101,6 +116,47 @@ bool fillRefSeqBuffer(compact::vector<uint64_t, 2> &refseq, uint64_t refAccPos,
   return true;
 }
 
+// the ksw2 codes (A=0, C=1, G=2, T=3) of the 4 bases packed into each possible byte of the 2-bit reference
+static const std::array<std::array<uint8_t, 4>, 256> twoBitCodeTable = [] {
+  std::array<std::array<uint8_t, 4>, 256> t;
+  for (uint32_t b = 0; b < 256; ++b) {
+    for (uint32_t i = 0; i < 4; ++i) { t[b][i] = (b >> (2 * i)) & 0x03; }
+  }
+  return t;
+}();
+
+// Like fillRefSeqBuffer, but fills refBuffer_ with the ksw2 codes of the reference bases rather than
+// their characters, so that they can be handed to the aligner without being decoded and re-encoded.
+// Whole 64-bit words (32 bases) are unpacked a byte at a time through twoBitCodeTable.
+bool fillRefCodeBuffer(compact::vector<uint64_t, 2> &refseq, uint64_t refAccPos, size_t tpos, uint32_t memlen, std::vector<uint8_t>& refBuffer_) {
+  refBuffer_.resize(memlen);
+  if (memlen == 0) return false;
+  uint64_t bucket_offset = (refAccPos + tpos) * 2;
+  uint8_t* out = refBuffer_.data();
+  uint32_t toFetch = memlen;
+  while (toFetch >= 32) {
+    uint64_t word = refseq.get_int(bucket_offset, 64);
+    for (uint32_t b = 0; b < 64; b += 8) {
+      std::memcpy(out, twoBitCodeTable[(word >> b) & 0xff].data(), 4);
+      out += 4;
+    }
+    bucket_offset += 64;
+    toFetch -= 32;
+  }
+  if (toFetch > 0) {
+    uint64_t word = refseq.get_int(bucket_offset, 2 * toFetch);
+    for (uint32_t i = 0; i < toFetch; ++i) { out[i] = (word >> (2 * i)) & 0x03; }
+  }
+  return true;
+}
+
+// The code equivalent of fillRefSeqBufferReverse; the reverse, *NOT* the reverse-complement.
+bool fillRefCodeBufferReverse(compact::vector<uint64_t, 2> &refseq, uint64_t refAccPos, size_t tpos, uint32_t memlen, std::vector<uint8_t>& refBuffer_) {
+  bool filled = fillRefCodeBuffer(refseq, refAccPos, tpos, memlen, refBuffer_);
+  std::reverse(refBuffer_.begin(), refBuffer_.end());
+  return filled;
+}
+
 // NOTE: This fills in refBuffer_ with the reference sequence from tpos to tpos+memlen in *reverse* order.
 // refBuffer will contain the reverse of the reference substring, *NOT* the reverse-complement.
 bool fillRefSeqBufferReverse(compact::vector<uint64_t, 2> &refseq, uint64_t refAccPos, size_t tpos, uint32_t memlen, std::string& refBuffer_) {
@@ -124,6 +180,220 @@ bool fillRefSeqBufferReverse(compact::vector<uint64_t, 2> &refseq, uint64_t refA
   return true;
 }
 
+/**
+ *  Hash of everything about the scoring configuration that can change an
+ *  alignment result; used to seed the keys of the cross-read alignment cache.
+ **/
+uint64_t PuffAligner::scoringParamsHash() const {
+  auto& kc = aligner.config();
+  int64_t params[] = {mopts.refExtendLength, mopts.fullAlignment, mopts.matchScore, mopts.missMatchScore,
+                      mopts.gapExtendPenalty, mopts.gapOpenPenalty, mopts.mimicBT2,
+                      mopts.mimicBT2Strict, mopts.allowOverhangSoftclip,
+                      kc.gapo, kc.gape, kc.bandwidth, kc.dropoff, kc.flag, kc.end_bonus};
+  uint64_t h{0};
+  MetroHash64::Hash(reinterpret_cast<uint8_t*>(params), sizeof(params), reinterpret_cast<uint8_t*>(&h), 0);
+  return h;
+}
+
+/**
+ *  The reference interval alignRead may look at when aligning a read of length `readLen`
+ *  with the chain `mems`, as ksw2 codes.  For full alignment this is the window starting
+ *  at refStart (already in refSeqBuffer_); for between-MEM alignment it also includes the
+ *  windows used to extend the ends of the chain, and is fetched into refWindowBuffer_.
+ **/
+PuffAligner::RefWindow PuffAligner::alignmentRefWindow(const std::vector<pufferfish::util::MemInfo>& mems,
+                                                       bool isFw, bool doFullAlignment, int64_t readLen,
+                                                       uint64_t refAccPos, int64_t refTotalLength,
+                                                       uint32_t refStart, int32_t keyLen) {
+  RefWindow win;
+  win.start = refStart;
+  win.end = static_cast<int64_t>(refStart) + keyLen;
+  if (doFullAlignment) {
+    win.seq = refSeqBuffer_.data();
+    return win;
+  }
+  int64_t refExtLength = static_cast<int64_t>(mopts.refExtendLength);
+  auto& front = mems.front();
+  auto& back = mems.back();
+  int64_t frontStartRead = isFw ? front.rpos : readLen - (front.rpos + front.extendedlen);
+  int64_t backEndRead = isFw ? back.rpos + back.extendedlen : readLen - back.rpos;
+  int64_t backEndRef = static_cast<int64_t>(back.tpos) + back.extendedlen;
+  win.start = std::max(int64_t{0}, static_cast<int64_t>(front.tpos) - frontStartRead - refExtLength);
+  win.end = std::min(refTotalLength, std::max(win.end, backEndRef + (readLen - backEndRead) + refExtLength + 1));
+  fillRefCodeBuffer(allRefSeq, refAccPos, win.start, win.end - win.start, refWindowBuffer_);
+  win.seq = refWindowBuffer_.data();
+  return win;
+}
+
+/**
+ *  Key under which the alignment of `read` with the chain `mems` is stored in the
+ *  cross-read alignment cache.  Besides the read and its orientation, it covers the
+ *  whole reference window alignRead may look at and the chain's placement within it,
+ *  so equal keys imply equal alignments up to hash collisions.
+ **/
+uint64_t PuffAligner::crossReadCacheKey(const std::string& read, const std::vector<pufferfish::util::MemInfo>& mems,
+                                        bool isFw, bool doFullAlignment, const RefWindow& win,
+                                        uint32_t refStart, uint32_t readStart) {
+  MetroHash64 hasher;
+  hasher.Initialize(crossReadCacheSeed_);
+  int64_t layout[] = {isFw, doFullAlignment, readStart, static_cast<int64_t>(refStart) - win.start, win.end - win.start};
+  hasher.Update(reinterpret_cast<const uint8_t*>(layout), sizeof(layout));
+  hasher.Update(reinterpret_cast<const uint8_t*>(read.data()), read.length());
+  for (auto& mem : mems) {
+    int64_t m[] = {mem.rpos, static_cast<int64_t>(mem.tpos) - win.start, mem.extendedlen};
+    hasher.Update(reinterpret_cast<const uint8_t*>(m), sizeof(m));
+  }
+  hasher.Update(win.seq, win.end - win.start);
+  uint64_t key{0};
+  hasher.Finalize(reinterpret_cast<uint8_t*>(&key));
+  return key;
+}
+
+/**
+ *  Length of the longest common subsequence of q and t (ksw2 codes; N's never match),
+ *  computed bit-parallel over q as in Hyyro's formulation of Allison-Dix.
+ **/
+int32_t PuffAligner::lcsLength(const uint8_t* q, int32_t qlen, const uint8_t* t, int32_t tlen) {
+  if (qlen <= 0 or tlen <= 0) { return 0; }
+  size_t words = (qlen + 63) / 64;
+  lcsPeq_.assign(4 * words, 0);
+  for (int32_t i = 0; i < qlen; ++i) {
+    if (q[i] < 4) { lcsPeq_[q[i] * words + i / 64] |= uint64_t{1} << (i % 64); }
+  }
+  lcsV_.assign(words, ~uint64_t{0});
+  for (int32_t j = 0; j < tlen; ++j) {
+    if (t[j] > 3) { continue; }
+    const uint64_t* peq = lcsPeq_.data() + t[j] * words;
+    uint64_t carry{0};
+    for (size_t w = 0; w < words; ++w) {
+      uint64_t v = lcsV_[w];
+      uint64_t u = v & peq[w];
+      uint64_t sum = v + u;
+      uint64_t c = (sum < v);
+      sum += carry;
+      c |= (sum < carry);
+      carry = c;
+      lcsV_[w] = sum | (v - u);
+    }
+  }
+  int32_t unmatched{0};
+  for (auto v : lcsV_) { unmatched += __builtin_popcountll(v); }
+  // bits past qlen in the last word stay set
+  return qlen - (unmatched - static_cast<int32_t>(64 * words - qlen));
+}
+
+/**
+ *  Returns true if the alignment alignRead would compute for the read (as ksw2 codes in
+ *  `readCodes`) and the chain `mems` provably cannot score above the minScoreFraction
+ *  threshold, so the DP can be skipped.
+ *
+ *  The bound follows alignRead piece by piece: MEMs and the gap penalties between them are
+ *  scored exactly, and each window that would go to ksw2 is replaced by an upper bound
+ *  on its score.  If M bases of a read piece of length m can be matched (M at most the
+ *  LCS of the piece and its reference window), the other m - M bases each cost at least
+ *  a mismatch or an insertion, and for a global alignment the unmatched reference bases
+ *  must be paired with them or deleted.  Pieces that do not fit in the ksw2 band are not
+ *  bounded, since the banded DP does not reliably score them.
+ **/
+bool PuffAligner::cannotReachMinScore(const std::vector<uint8_t>& readCodes,
+                                      const std::vector<pufferfish::util::MemInfo>& mems,
+                                      bool isFw, bool doFullAlignment, const RefWindow& win) {
+  int64_t a = mopts.matchScore;
+  int64_t b = -static_cast<int64_t>(mopts.missMatchScore);
+  int64_t q = mopts.gapOpenPenalty;
+  int64_t e = mopts.gapExtendPenalty;
+  if (a <= 0 or b < 0 or q < 0 or e < 0) { return false; }
+  int32_t band = aligner.config().bandwidth;
+  auto fitsBand = [band](int64_t m, int64_t n) -> bool { return band < 0 or std::abs(m - n) < band; };
+  auto numN = [](const uint8_t* s, int64_t len) -> int64_t { return std::count(s, s + len, 4); };
+
+  // upper bound on ez.mqe for an extension of read piece s[0, m) into a window of n bases
+  auto extensionBound = [&](const uint8_t* s, int64_t m, int64_t refStart, int64_t n, int64_t& ub) -> bool {
+    if (refStart < win.start or refStart + n > win.end or !(band < 0 or n + band > m)) { return false; }
+    int64_t u = m - lcsLength(s, m, win.seq + (refStart - win.start), n);
+    int64_t ns = std::min(numN(s, m), u);
+    ub = a * m - (std::min(a + b, a + e) * (u - ns) + a * ns);
+    return true;
+  };
+  // upper bound on the global alignment score of read piece s[0, m) and n reference bases
+  auto globalBound = [&](const uint8_t* s, int64_t m, int64_t refStart, int64_t n, int64_t& ub) -> bool {
+    if (refStart < win.start or refStart + n > win.end or !fitsBand(m, n)) { return false; }
+    int64_t lcs = lcsLength(s, m, win.seq + (refStart - win.start), n);
+    ub = score_bound::globalScoreBound(a, b, q, e, m, n, lcs, numN(s, m));
+    return true;
+  };
+
+  int64_t readLen = static_cast<int64_t>(readCodes.size());
+  int64_t ub{0};
+  if (doFullAlignment) {
+    if (!extensionBound(readCodes.data(), readLen, win.start, win.end - win.start, ub)) { return false; }
+  } else {
+    auto& front = mems.front();
+    int64_t firstMemStart_read = isFw ? front.rpos : readLen - (front.rpos + front.extendedlen);
+    int64_t tpos = front.tpos;
+    if (firstMemStart_read > 0) {
+      int64_t refWindowStart = std::max(int64_t{0}, tpos - firstMemStart_read - mopts.refExtendLength);
+      int64_t pieceUb{0};
+      if (tpos - refWindowStart > 0) {
+        if (!extensionBound(readCodes.data(), firstMemStart_read, refWindowStart, tpos - refWindowStart, pieceUb)) {
+          return false;
+        }
+      } else {
+        pieceUb = -q - e * firstMemStart_read;
+      }
+      ub += pieceUb;
+    }
+
+    int64_t prevMemEnd_read = firstMemStart_read;
+    int64_t prevMemEnd_ref = tpos;
+    for (size_t i = 0; i < mems.size(); ++i) {
+      auto& mem = mems[i];
+      int64_t memlen = mem.extendedlen;
+      int64_t currMemStart_ref = mem.tpos;
+      int64_t currMemStart_read = isFw ? mem.rpos : readLen - (mem.rpos + memlen);
+      int64_t gapRef = currMemStart_ref - prevMemEnd_ref - 1;
+      int64_t gapRead = currMemStart_read - prevMemEnd_read - 1;
+      int64_t score = a * memlen;
+      if ((gapRef <= 0 or gapRead <= 0) and gapRef != gapRead) {
+        score += -q - e * std::abs(gapRef - gapRead);
+        if (gapRead < 0) { score += a * gapRead; }
+      } else if (gapRead > 0 and gapRef > 0) {
+        int64_t pieceUb{0};
+        if (!globalBound(readCodes.data() + prevMemEnd_read + 1, gapRead, prevMemEnd_ref + 1, gapRef, pieceUb)) {
+          return false;
+        }
+        score += pieceUb;
+      } else if (i > 0 and (currMemStart_read <= prevMemEnd_read or currMemStart_ref <= prevMemEnd_ref)) {
+        // alignRead reports these itself
+        return false;
+      }
+      prevMemEnd_read = currMemStart_read + memlen - 1;
+      prevMemEnd_ref = currMemStart_ref + memlen - 1;
+      ub += score;
+    }
+
+    int64_t gapRead = readLen - (prevMemEnd_read + 1);
+    if (gapRead > 0) {
+      int64_t refTailStart = prevMemEnd_ref + 1;
+      int64_t refTailEnd = std::min(refTailStart + gapRead + std::min<int64_t>(mopts.refExtendLength, 5 * gapRead),
+                                    win.end - 1);
+      int64_t refLen = (refTailEnd > refTailStart) ? refTailEnd - refTailStart + 1 : 0;
+      int64_t delCost = -q - e * gapRead;
+      int64_t pieceUb{delCost};
+      if (refLen > 0) {
+        if (!extensionBound(readCodes.data() + prevMemEnd_read + 1, gapRead, refTailStart, refLen, pieceUb)) {
+          return false;
+        }
+        pieceUb = std::max(pieceUb, delCost);
+      }
+      ub += pieceUb;
+    }
+  }
+  // the alignment is accepted only if its score is strictly above this
+  double minScore = mopts.minScoreFraction * a * readLen;
+  return ub <= minScore;
+}
+
 /**
  *  Align the read `original_read`, whose mems consist of `mems` against the index and return the result
  *  in `arOut`.  How the alignment is computed (i.e. full vs between-mem and CIGAR vs. score only) depends
@@ -153,7 +423,10 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
   auto& cigarGen = cigarGen_;
   cigarGen.clear();
 
-  std::string cigar = "";
+  // reuse the aligner-owned buffers so a warmed-up thread does not
+  // allocate per candidate alignment.
+  auto& cigar = cigarBuffer_;
+  cigar.clear();
   ksw_reset_extz(&ez);
 
   // where this reference starts, and its length.
@@ -185,7 +458,8 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
   // alignment cache (or to compute a full alignment).
   int32_t keyLen = 0;
 
-  std::string tseq;
+  auto& tseq = tseqBuffer_;
+  tseq.clear();
 
   uint64_t hashKey{0};
   bool didHash{false};
@@ -235,11 +509,10 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
   }
 
 
-  fillRefSeqBuffer(allRefSeq, refAccPos, refStart, keyLen, refSeqBuffer_);
-  int32_t originalRefSeqLen = static_cast<int32_t>(refSeqBuffer_.length());
   // If we're not using fullAlignment, we'll need the full reference sequence later
-  // so copy it into tseq.
-  if (!doFullAlignment) { tseq = refSeqBuffer_; }
+  // (refSeqBuffer_ is reused for the windows at the ends of the read), so keep it in tseq.
+  auto& windowSeq = doFullAlignment ? refSeqBuffer_ : tseq;
+  fillRefCodeBuffer(allRefSeq, refAccPos, refStart, keyLen, windowSeq);
 
   // first, check if we can skip this by perfect chaining
   // if not, check if we can skip it via the alignment cache
@@ -253,7 +526,7 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
     SPDLOG_DEBUG(logger_,"perfect chain!\n]]\n");*/
   } else if (!alnCache.empty() and isMultimapping_) {
     // hash the reference string
-    MetroHash64::Hash(reinterpret_cast<uint8_t *>(const_cast<char*>(refSeqBuffer_.data())), keyLen, reinterpret_cast<uint8_t *>(&hashKey), 0);
+    MetroHash64::Hash(windowSeq.data(), keyLen, reinterpret_cast<uint8_t *>(&hashKey), 0);
     didHash = true;
     // see if we have this hash
     auto hit = alnCache.find(hashKey);
@@ -267,14 +540,50 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
     }
   }
 
+  // the whole reference window this alignment may look at; needed by the
+  // cross-read cache and the score bound below
+  bool useCrossReadCache = !perfectChain and crossReadCache_.enabled();
+  bool useScoreBound = !perfectChain and mopts.scoreBoundFilter and !allowOverhangSoftclip;
+  RefWindow refWindow;
+  if (useCrossReadCache or useScoreBound) {
+    refWindow = alignmentRefWindow(mems, isFw, doFullAlignment, readLen, refAccPos, refTotalLength, refStart, keyLen);
+  }
+
+  // then check if an earlier read on this thread already computed this alignment
+  uint64_t crossReadKey{0};
+  if (useCrossReadCache) {
+    crossReadKey = crossReadCacheKey(read, mems, isFw, doFullAlignment, refWindow, refStart, readStart);
+    auto* cached = crossReadCache_.find(crossReadKey);
+    if (cached != nullptr) {
+      hctr.crossReadCacheHits += 1;
+      arOut.score = cached->score;
+      if (computeCIGAR) { arOut.cigar = cached->cigar; }
+      arOut.openGapLen = cached->openGapLen;
+      return true;
+    }
+    hctr.crossReadCacheMisses += 1;
+  }
+
   //auto logger_ = spdlog::get("console");
   //spdlog::set_level(spdlog::level::debug); // Set global log level to debug
   //logger_->set_pattern("%v");
 
   // @mohsen & @fataltes --- we should figure out how to
   // avoid computing the rc of a read if we've already done it.
-  if (!isFw and read_rc.empty()) { read_rc = pufferfish::util::reverseComplement(read); }
+  if (!isFw and read_rc.empty()) { pufferfish::util::reverseRead(read, read_rc); }
   nonstd::string_view readView = (isFw) ? read : read_rc;
+  // the aligner is fed ksw2 codes directly; encode the read once for all of the windows below
+  auto& readCodes = readCodeBuffer_;
+  if (!perfectChain) { aligner.transformSequenceKSW2(readView.data(), readView.length(), readCodes); }
+
+  // skip the DP entirely if the candidate provably cannot reach the minimum score
+  if (useScoreBound and cannotReachMinScore(readCodes, mems, isFw, doFullAlignment, refWindow)) {
+    hctr.skippedAlignments_byScoreBound += 1;
+    arOut.score = std::numeric_limits<decltype(arOut.score)>::min();
+    arOut.cigar.clear();
+    arOut.openGapLen = 0;
+    return false;
+  }
 
   if (!perfectChain) {
     if (doFullAlignment) {
@@ -282,14 +591,14 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
     // before the start of the reference
     decltype(readStart) readOffset = allowOverhangSoftclip ? readStart : 0;
     nonstd::string_view readSeq = readView.substr(readOffset);
-    aligner(readSeq.data(), readSeq.length(), refSeqBuffer_.data(), refSeqBuffer_.length(), &ez,
+    aligner(readCodes.data() + readOffset, readSeq.length(), refSeqBuffer_.data(), refSeqBuffer_.size(), &ez,
             ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::EXTENSION>());
     // if we allow softclipping of overhaning bases, then we only care about the best
     // score to the end of the query or the end of the reference.  Otherwise, we care about
     // the best score all the way until the end of the query.
     alignmentScore = allowOverhangSoftclip ? std::max(ez.mqe, ez.mte) : ez.mqe;
 
-    SPDLOG_DEBUG(logger_,"readSeq : {}\nrefSeq  : {}\nscore   : {}\nreadStart : {}", readSeq, refSeqBuffer_, alignmentScore, readStart);
+    SPDLOG_DEBUG(logger_,"readSeq : {}\nrefSeq  : {}\nscore   : {}\nreadStart : {}", readSeq, codesToBases(refSeqBuffer_), alignmentScore, readStart);
     SPDLOG_DEBUG(logger_,"currHitStart_read : {}, currHitStart_ref : {}\nmqe : {}, mte : {}\n", currHitStart_read, currHitStart_ref, ez.mqe, ez.mte);
 
     if (computeCIGAR) {
@@ -306,7 +615,7 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
     //std::stringstream ss;
     SPDLOG_DEBUG(logger_,"[[");
     SPDLOG_DEBUG(logger_,"read sequence ({}) : {}", (isFw ? "FW" : "RC"), readView);
-    SPDLOG_DEBUG(logger_,"ref  sequence      : {}\nrefID : {}", tseq, tid);
+    SPDLOG_DEBUG(logger_,"ref  sequence      : {}\nrefID : {}", codesToBases(tseq), tid);
 
     // If the first mem does not start at the beginning of the
     // read, then there is a gap to align.
@@ -322,15 +631,16 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
 
       int32_t refWindowStart = (readStartPosOnRef - refExtLength) > 0 ? (readStartPosOnRef - refExtLength) : 0;
       int32_t refWindowLength = tpos - refWindowStart;
-      fillRefSeqBufferReverse(allRefSeq, refAccPos, refWindowStart, refWindowLength, refSeqBuffer_);
+      fillRefCodeBufferReverse(allRefSeq, refAccPos, refWindowStart, refWindowLength, refSeqBuffer_);
 
-      if (refSeqBuffer_.length() > 0) {
-        auto readWindow = readView.substr(0, firstMemStart_read).to_string();
-        std::reverse(readWindow.begin(), readWindow.end());
+      if (refSeqBuffer_.size() > 0) {
+        auto& readWindow = readWindowBuffer_;
+        readWindow.assign(readCodes.rend() - firstMemStart_read, readCodes.rend());
         SPDLOG_DEBUG(logger_,"PRE:\nreadStartPosOnRef : {}\nrefWindowStart : {}", readStartPosOnRef, refWindowStart);
-        SPDLOG_DEBUG(logger_,"refWindowLength : {}\nread : [{}]\nref : [{}]", refWindowLength, readWindow, refSeqBuffer_);
+        SPDLOG_DEBUG(logger_,"refWindowLength : {}\nread : [{}]\nref : [{}]", refWindowLength,
+                     codesToBases(readWindow), codesToBases(refSeqBuffer_));
         ksw_reset_extz(&ez);
-        aligner(readWindow.data(), readWindow.length(), refSeqBuffer_.data(), refSeqBuffer_.length(), &ez,
+        aligner(readWindow.data(), readWindow.size(), refSeqBuffer_.data(), refSeqBuffer_.size(), &ez,
                 ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::EXTENSION>());
         alignmentScore += allowOverhangSoftclip ? std::max(ez.mqe, ez.mte) : ez.mqe;
         openGapLen = computeCIGAR ? addCigar(cigarGen, ez, true) : (ez.mqe_t + 1);
@@ -373,15 +683,15 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
       } else if (gapRead > 0 and gapRef > 0) {
         SPDLOG_DEBUG(logger_,"\t\t overlaps : \n\t\t gapRef : {}, gapRead : {}", gapRef, gapRead);
 
-        auto readWindow = readView.substr(prevMemEnd_read + 1, gapRead);
-        const char* refSeq1 = tseq.data() + (prevMemEnd_ref) - refStart + 1;
+        const uint8_t* refSeq1 = tseq.data() + (prevMemEnd_ref) - refStart + 1;
 
-        SPDLOG_DEBUG(logger_,"\t\t aligning\n\t\t [{}]\n\t\t\ [{}]", readWindow, nonstd::string_view(refSeq1, gapRef));
+        SPDLOG_DEBUG(logger_,"\t\t aligning\n\t\t [{}]\n\t\t [{}]", readView.substr(prevMemEnd_read + 1, gapRead),
+                     codesToBases(refSeq1, gapRef));
         if (prevMemEnd_ref - refStart + 1 + gapRef >= tseq.size()) {
           SPDLOG_DEBUG(logger_,"\t\t tseq was not long enough; need to fetch more!");
         }
 
-        score += aligner(readWindow.data(), readWindow.length(), refSeq1, gapRef, &ez,
+        score += aligner(readCodes.data() + prevMemEnd_read + 1, gapRead, refSeq1, gapRef, &ez,
                         ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::GLOBAL>());
         if (computeCIGAR) { addCigar(cigarGen, ez, false); }
       } else if ( it > mems.begin() and ((currMemStart_read <= prevMemEnd_read) or (currMemStart_ref <= prevMemEnd_ref)) ){
@@ -396,11 +706,9 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
       SPDLOG_DEBUG(logger_,"\t MEM (rpos : {}, memlen : {}, tpos : {})", rpos, memlen, tpos);
       SPDLOG_DEBUG(logger_,"\t gapRef : {}, gapRead : {}", gapRef, gapRead);
       auto printView = readView.substr(currMemStart_read, memlen);
-      auto refView = nonstd::string_view(tseq.c_str() + tpos - refStart, memlen);
-
       SPDLOG_DEBUG(logger_,"\t read [{}], pos : {}, len : {}, ori : {}", printView, currMemStart_read, memlen, (isFw ? "FW" : "RC"));
-      SPDLOG_DEBUG(logger_,"\t ref  [{}], pos : {}, len : {}", refView, currMemStart_ref, memlen);
-      if (printView.length() != refView.length()) {
+      SPDLOG_DEBUG(logger_,"\t ref  pos : {}, len : {}", currMemStart_ref, memlen);
+      if (printView.length() != memlen) {
         SPDLOG_DEBUG(logger_,"\t readView length != refView length; should not happen!");
         std::exit(1);
       }
@@ -421,15 +729,15 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
       if (refTailEnd >= refTotalLength) {refTailEnd = refTotalLength - 1;}
       int32_t refLen = (refTailEnd > refTailStart) ? refTailEnd - refTailStart + 1 : 0;
       auto readWindow = readView.substr(prevMemEnd_read + 1);
-      fillRefSeqBuffer(allRefSeq, refAccPos, refTailStart, refLen, refSeqBuffer_);
+      fillRefCodeBuffer(allRefSeq, refAccPos, refTailStart, refLen, refSeqBuffer_);
 
       SPDLOG_DEBUG(logger_,"POST:");
       SPDLOG_DEBUG(logger_,"read : [{}]", readWindow);
-      SPDLOG_DEBUG(logger_,"ref  : [{}]", refSeqBuffer_);
+      SPDLOG_DEBUG(logger_,"ref  : [{}]", codesToBases(refSeqBuffer_));
       SPDLOG_DEBUG(logger_,"gapRead : {}, refLen : {}, refBuffer_.size() : {}, refTotalLength : {}", gapRead, refLen, refSeqBuffer_.size(), refTotalLength);
 
       if (refLen > 0) {
-        aligner(readWindow.data(), readWindow.length(), refSeqBuffer_.data(), refLen, &ez,
+        aligner(readCodes.data() + prevMemEnd_read + 1, readWindow.length(), refSeqBuffer_.data(), refLen, &ez,
                 ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::EXTENSION>());
         int32_t alnCost = allowOverhangSoftclip ? std::max(ez.mqe, ez.mte) : ez.mqe;
         int32_t delCost = (-1 * mopts.gapOpenPenalty + -1 * mopts.gapExtendPenalty * readWindow.length());
@@ -768,7 +1076,7 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
   }
   } // not a perfect chain
   bool cigar_fixed{false};
-  if (computeCIGAR) { cigar = cigarGen.get_cigar(readLen, cigar_fixed); }
+  if (computeCIGAR) { cigarGen.get_cigar(readLen, cigar_fixed, cigar); }
   if (cigar_fixed) { hctr.cigar_fixed_count++; }
   if (isMultimapping_ and !perfectChain) { // don't bother to fill up a cache unless this is a multi-mapping read
     if (!didHash) {
@@ -777,8 +1085,7 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
       // then refSeqBuffer_ could have been used to store shorter portions of the reference during
       // the alignment procedure.  In that case, get the original reference sequence from tseq, which
       // was copied from the full reference sequence in the beginning of the function.
-      char* ptr = const_cast<char*>((doFullAlignment ? refSeqBuffer_.data() : tseq.data()));
-      MetroHash64::Hash(reinterpret_cast<uint8_t *>(ptr), keyLen, reinterpret_cast<uint8_t *>(&hashKey), 0);
+      MetroHash64::Hash(windowSeq.data(), keyLen, reinterpret_cast<uint8_t *>(&hashKey), 0);
     }
     AlignmentResult aln;
     aln.score = alignmentScore;
@@ -786,6 +1093,7 @@ bool PuffAligner::alignRead(std::string& read, std::string& read_rc, const std::
     aln.openGapLen = openGapLen;
     alnCache[hashKey] = aln;
   }
+  if (useCrossReadCache) { crossReadCache_.insert(crossReadKey, alignmentScore, cigar, openGapLen); }
   arOut.score = alignmentScore;
   arOut.cigar = cigar;
   arOut.openGapLen = openGapLen;
@@ -899,6 +1207,129 @@ int32_t PuffAligner::calculateAlignments(std::string& read, pufferfish::util::Jo
     return jointHit.alignmentScore;
 }
 
+/**
+ *  Batch scoring only applies to full alignments (the windows alignRead would hand to a
+ *  single ksw2 extension) of multi-mapping reads, without overhang soft-clipping.
+ **/
+bool PuffAligner::batchScoringEnabled(size_t numHits) const {
+  return mopts.batchAlignment and mopts.fullAlignment and !mopts.allowOverhangSoftclip and numHits > 1;
+}
+
+/**
+ *  Queue the full-alignment window alignRead would use for `clust` on reference `tid`,
+ *  unless alignRead would not align it (perfect chains, strict BT2 bounds) or an earlier
+ *  candidate of the read has the same window, in which case alignRead will find that
+ *  candidate's result in the alignment cache, just as it would without batching.
+ **/
+void PuffAligner::addBatchCandidate(const std::string& read, const pufferfish::util::MemCluster& clust, size_t tid,
+                                    std::vector<BatchCandidate>& cands) {
+  auto& mems = clust.mems;
+  if (mems.empty() or clust.perfectChain) { return; }
+  int64_t refAccPos = tid > 0 ? refAccumLengths[tid - 1] : 0;
+  int64_t refTotalLength = refAccumLengths[tid] - refAccPos;
+  int64_t readLen = static_cast<int64_t>(read.length());
+  auto& front = mems.front();
+  int64_t hitStart_read = clust.isFw ? front.rpos : readLen - (front.rpos + front.extendedlen);
+  if (hitStart_read < 0 or hitStart_read >= readLen) { return; }
+  int64_t hitStart_ref = front.tpos;
+  int64_t signedRefStartPos = hitStart_ref - hitStart_read;
+  if (mopts.mimicBT2Strict and (signedRefStartPos < 0 or signedRefStartPos + readLen > refTotalLength)) { return; }
+
+  int64_t buff{20};
+  int64_t refStart = std::max(int64_t{0}, signedRefStartPos);
+  int64_t keyLen = (refStart + readLen + buff < refTotalLength) ? readLen + buff : refTotalLength - refStart;
+  if (keyLen <= 0) { return; }
+  // near the end of the reference the window can end within the band's lower
+  // edge, where the batch score may differ from ksw2's; those go to alignRead
+  if (keyLen <= readLen - aligner.config().bandwidth) { return; }
+  fillRefCodeBuffer(allRefSeq, refAccPos, refStart, keyLen, refSeqBuffer_);
+  uint64_t hashKey{0};
+  MetroHash64::Hash(refSeqBuffer_.data(), keyLen, reinterpret_cast<uint8_t *>(&hashKey), 0);
+  if (!batchSeen_.insert(hashKey).second) { return; }
+
+  BatchCandidate c;
+  c.hashKey = hashKey;
+  c.isFw = clust.isFw;
+  c.refOffset = batchRefCodes_.size();
+  c.refLen = static_cast<int32_t>(keyLen);
+  batchRefCodes_.insert(batchRefCodes_.end(), refSeqBuffer_.begin(), refSeqBuffer_.end());
+  cands.push_back(c);
+}
+
+/**
+ *  Score the queued windows of one read end, one orientation at a time, and cache the
+ *  candidates whose score does not exceed minScoreFraction.  The batch kernel agrees with
+ *  ksw2's extension score whenever the window is longer than the read minus the bandwidth,
+ *  which addBatchCandidate only queues windows for, so a cached rejection is the one alignRead
+ *  would have reached.  Rejected alignments are never reported, so their cache entries carry
+ *  no CIGAR or open gap length.  Candidates that pass are left to alignRead.
+ **/
+void PuffAligner::scoreBatch(std::string& read, std::string& read_rc, std::vector<BatchCandidate>& cands,
+                             AlnCacheMap& alnCache, HitCounters& hctr) {
+  if (cands.empty()) { return; }
+  int64_t readLen = static_cast<int64_t>(read.length());
+  double minScore = mopts.matchScore ? mopts.minScoreFraction * mopts.matchScore * readLen : -0.6 + -0.6 * readLen;
+  for (bool isFw : {true, false}) {
+    batchMembers_.clear();
+    batchTargets_.clear();
+    batchTargetLens_.clear();
+    for (size_t i = 0; i < cands.size(); ++i) {
+      if (cands[i].isFw != isFw) { continue; }
+      batchMembers_.push_back(i);
+      batchTargets_.push_back(batchRefCodes_.data() + cands[i].refOffset);
+      batchTargetLens_.push_back(cands[i].refLen);
+    }
+    if (batchMembers_.empty()) { continue; }
+    if (!isFw and read_rc.empty()) { pufferfish::util::reverseRead(read, read_rc); }
+    std::string& oriented = isFw ? read : read_rc;
+    aligner.transformSequenceKSW2(oriented.data(), oriented.length(), readCodeBuffer_);
+    batchScores_.resize(batchMembers_.size());
+    if (!aligner(readCodeBuffer_.data(), readLen, batchTargets_.data(), batchTargetLens_.data(),
+                 static_cast<int>(batchMembers_.size()), batchScores_.data(),
+                 ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::BATCH_EXTENSION>())) {
+      continue;
+    }
+    hctr.batchScoredAlignments += batchMembers_.size();
+    for (size_t j = 0; j < batchMembers_.size(); ++j) {
+      if (batchScores_[j] > minScore) { continue; }
+      auto& c = cands[batchMembers_[j]];
+      AlignmentResult aln;
+      aln.score = batchScores_[j];
+      alnCache[c.hashKey] = aln;
+      hctr.batchRejectedAlignments += 1;
+    }
+  }
+}
+
+void PuffAligner::batchScoreCandidates(std::string& read_left, std::string& read_right,
+                                       std::vector<pufferfish::util::JointMems>& jointHits, HitCounters& hctr) {
+  if (!batchScoringEnabled(jointHits.size())) { return; }
+  batchLeft_.clear();
+  batchRight_.clear();
+  batchRefCodes_.clear();
+  // the left and right ends have separate alignment caches
+  batchSeen_.clear();
+  for (auto& jointHit : jointHits) {
+    if (jointHit.isLeftAvailable()) { addBatchCandidate(read_left, *jointHit.leftClust, jointHit.tid, batchLeft_); }
+  }
+  batchSeen_.clear();
+  for (auto& jointHit : jointHits) {
+    if (jointHit.isRightAvailable()) { addBatchCandidate(read_right, *jointHit.rightClust, jointHit.tid, batchRight_); }
+  }
+  scoreBatch(read_left, read_left_rc_, batchLeft_, alnCacheLeft, hctr);
+  scoreBatch(read_right, read_right_rc_, batchRight_, alnCacheRight, hctr);
+}
+
+void PuffAligner::batchScoreCandidates(std::string& read, std::vector<pufferfish::util::JointMems>& jointHits,
+                                       HitCounters& hctr) {
+  if (!batchScoringEnabled(jointHits.size())) { return; }
+  batchLeft_.clear();
+  batchRefCodes_.clear();
+  batchSeen_.clear();
+  for (auto& jointHit : jointHits) { addBatchCandidate(read, *jointHit.orphanClust(), jointHit.tid, batchLeft_); }
+  scoreBatch(read, read_left_rc_, batchLeft_, alnCacheLeft, hctr);
+}
+
 bool PuffAligner::recoverSingleOrphan(std::string& read_left, std::string& read_right, pufferfish::util::MemCluster& clust, std::vector<pufferfish::util::MemCluster> &recoveredMemClusters, uint32_t tid, bool anchorIsLeft, bool verbose) {
   int32_t anchorLen = anchorIsLeft ? read_left.length() : read_right.length();
   auto tpos = clust.mems[0].tpos;
@@ -982,14 +1413,14 @@ bool PuffAligner::recoverSingleOrphan(std::string& read_left, std::string& read_
   }
 
   if (verbose) { std::cerr<< anchorPos<< "\n"; }
-  fillRefSeqBuffer(allRefSeq, refAccPos, startPos, windowLength, refSeqBuffer_);
+  fillRefSeqBuffer(allRefSeq, refAccPos, startPos, windowLength, orphanWindowBuffer_);
   /*windowSeq.reset(new char[tseq.length() + 1]);
   strcpy(windowSeq.get(), tseq.c_str());
   */
 
   // Note -- we use score only mode to find approx end position in rapmap, can we
   // do the same here?
-  EdlibAlignResult result = edlibAlign(rptr, rlen, refSeqBuffer_.data(), windowLength,
+  EdlibAlignResult result = edlibAlign(rptr, rlen, orphanWindowBuffer_.data(), windowLength,
                                        edlibNewAlignConfig(maxDist, EDLIB_MODE_HW, EDLIB_TASK_LOC));
 
   if (result.editDistance > -1) {
@@ -24,6 +24,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <functional>
 #include <cstdlib>
 #include <clocale>
 #include <ghc/filesystem.hpp>
@@ -32,6 +33,7 @@
 #include "PufferfishConfig.hpp"
 #include "ProgOpts.hpp"
 #include "Util.hpp"
+#include "MappingServer.hpp"
 //#include "IndexHeader.hpp"
 
 int pufferfishIndex(pufferfish::IndexOptions& indexOpts); // int argc, char* argv[]);
@@ -42,13 +44,15 @@ int pufferfishTestLookup(
                          pufferfish::ValidateOptions& lookupOpts); // int argc, char* argv[]);
 int pufferfishAligner(pufferfish::AlignmentOpts& alignmentOpts) ;
 int pufferfishExamine(pufferfish::ExamineOptions& examineOpts);
+int pufferfishServe(pufferfish::ServeOptions& serveOpts,
+                    const std::function<bool(const std::vector<std::string>&, pufferfish::AlignmentOpts&, std::string&)>& parseJob);
 
 int main(int argc, char* argv[]) {
   using namespace clipp;
   using std::cout;
   std::setlocale(LC_ALL, "en_US.UTF-8");
 
-  enum class mode {help, index, validate, lookup, align, examine};
+  enum class mode {help, index, validate, lookup, align, serve, examine};
   mode selected = mode::help;
   pufferfish::AlignmentOpts alignmentOpt ;
   pufferfish::IndexOptions indexOpt;
@@ -56,6 +60,7 @@ int main(int argc, char* argv[]) {
   pufferfish::ValidateOptions validateOpt;
   pufferfish::ValidateOptions lookupOpt;
   pufferfish::ExamineOptions examineOpt;
+  pufferfish::ServeOptions serveOpt;
 
   auto ensure_file_exists = [](const std::string& s) -> bool {
       bool exists = ghc::filesystem::exists(s);
@@ -162,9 +167,14 @@ int main(int argc, char* argv[]) {
     }
   };
 
-  auto alignMode = (
+  // built by a function so that `pufferfish serve` can parse the jobs it is sent; the
+  // server takes -i relative to the client's directory, so it checks the index itself
+  auto makeAlignMode = [&](pufferfish::AlignmentOpts& alignmentOpt, bool checkIndex) {
+    auto indexValue = checkIndex ? value(ensure_index_exists, "index", alignmentOpt.indexDir)
+                                 : value("index", alignmentOpt.indexDir);
+    return (
                     command("align").set(selected, mode::align),
-                    (required("-i", "--index") & value(ensure_index_exists, "index", alignmentOpt.indexDir)) % "Directory where the Pufferfish index is stored",
+                    (required("-i", "--index") & indexValue) % "Directory where the Pufferfish index is stored",
                     (
                       (
                         ((required("--mate1", "-1") & value("mate 1", alignmentOpt.read1)) % "Path to the left end of the read files"),
@@ -178,6 +188,17 @@ int main(int argc, char* argv[]) {
 
                     (option("--coverageScoreRatio") & value("score ratio", alignmentOpt.scoreRatio).call(isValidRatio)) % "Discard mappings with a coverage score < scoreRatio * OPT (default=0.6)",
                     (option("-t", "--threads") & value("num threads", alignmentOpt.numThreads)) % "Specify the number of threads (default=8)",
+                    (option("--decompressionThreads") & value("num threads", alignmentOpt.decompressionThreads)) %
+                            "Threads inflating each gzip / BGZF read file (default: an eighth of --threads, at least 1)",
+                    (
+                      (option("--numaInterleave").set(alignmentOpt.numaInterleave, true)) %
+                            "Interleave the index over all NUMA nodes and pin the mapping threads to nodes round-robin"
+                      |
+                      (option("--numaReplicate").set(alignmentOpt.numaReplicate, true)) %
+                            "Load one copy of the index per NUMA node; each mapping thread uses the copy on its node"
+                    ),
+                    (option("--hugePages").set(alignmentOpt.hugePages, true)) %
+                            "Back the index lookup structures with 2MB transparent huge pages (fewer TLB misses)",
                     (option("-m", "--just-mapping").set(alignmentOpt.justMap, true)) % "don't attempt alignment validation; just do mapping",
                     (
                       (required("--noOutput").set(alignmentOpt.noOutput, true)) % "Run without writing SAM file"
@@ -190,15 +211,39 @@ int main(int argc, char* argv[]) {
                     (option("--noOrphans").set(alignmentOpt.noOrphan, true)) % "Write Orphans flag",
                     (option("--orphanRecovery").set(alignmentOpt.recoverOrphans, true)) % "Recover mappings for the other end of orphans using alignment",
                     (option("--noDiscordant").set(alignmentOpt.noDiscordant, true)) % "Write Orphans flag",
-		            (option("-z", "--compressedOutput").set(alignmentOpt.compressedOutput, true)) % "Compress (gzip) the output file",
+		            (option("-z", "--compressedOutput").set(alignmentOpt.compressedOutput, true)) % "Compress (BGZF, gzip compatible) the output file",
+                    (option("--orderedOutput").set(alignmentOpt.orderedOutput, true)) % "Write SAM records in the order of the input reads",
                     (
                       (option("-k", "--krakOut").set(alignmentOpt.krakOut, true)) % "Write output in the format required for krakMap"
                       |
                       (option("-p", "--pam").set(alignmentOpt.salmonOut, true)) % "Write output in the format required for salmon"
+                      |
+                      (option("--bam").set(alignmentOpt.bamOutput, true)) % "Write alignments as BAM rather than SAM"
+                      |
+                      (option("--eqclasses").set(alignmentOpt.eqClassOutput, true)) %
+                            "Write only the equivalence classes of the aligned reads (salmon eq_classes.txt layout)"
+                      |
+                      (option("--screen").set(alignmentOpt.screen, true)) %
+                            "Only sort the reads into <output>_classified and <output>_unclassified FASTQ files "
+                            "(_1 / _2 for pairs), by whether they align well enough to some reference; "
+                            "stops at the first such alignment"
                     ),
+                    (option("--screenMinScore") & value("score", alignmentOpt.screenMinScore)) %
+                            "With --screen, the alignment score a read must reach, on top of --minScoreFraction, to be classified",
+                    (option("--screenDecoys").set(alignmentOpt.screenDecoys, true)) %
+                            "With --screen, only alignments to the decoy sequences of the index classify a read",
+                    (option("--pamV2").set(alignmentOpt.pamV2, true)) %
+                            "Write krakOut / salmon output in the blocked, columnar v2 format (with a block index)",
+                    (option("--compressionThreads") & value("num threads", alignmentOpt.compressionThreads)) %
+                            "Number of threads compressing BAM or --compressedOutput output (default: a quarter of --threads, at least 1)",
 					(option("--verbose").set(alignmentOpt.verbose, true)) % "Print out auxilary information to trace program's flow",
                     (option("--fullAlignment").set(alignmentOpt.fullAlignment, true)) % "Perform full alignment instead of gapped alignment",
                     (option("--heuristicChaining").set(alignmentOpt.heuristicChaining, true)) % "Whether or not perform only 2 rounds of chaining",
+                    (option("--maxChainLookback") & value("max chain lookback", alignmentOpt.maxChainLookback)) % "Maximum number of preceding MEMs considered as predecessors when chaining (default=64)",
+                    (option("--noScoreBoundFilter").set(alignmentOpt.noScoreBoundFilter, true)) % "Do not skip the alignment of candidates whose matchable bases already rule out reaching the minimum score",
+                    (option("--batchAlignment").set(alignmentOpt.batchAlignment, true)) % "With --fullAlignment, score all candidates of a multi-mapping read together with an inter-sequence kernel and only align the ones that pass --minScoreFraction",
+                    (option("--crossReadCacheSize") & value("cache entries", alignmentOpt.crossReadCacheSize)) % "Number of alignments each thread remembers across reads so that duplicate reads are not re-aligned; 0 disables this cache (default=0)",
+                    (option("--readCacheSize") & value("cache entries", alignmentOpt.readCacheSize)) % "Number of read pairs each thread remembers, with their alignments, so that pairs with exactly the same sequences are not mapped again; paired-end only, not used with -k, -p or --screen. 0 disables this cache (default=0)",
                     (option("--bestStrata").set(alignmentOpt.bestStrata, true)) % "Keep only the alignments with the best score for each read",
 					(option("--genomicReads").set(alignmentOpt.genomicReads, true)) % "Align genomic dna-seq reads instead of RNA-seq reads",
 					(option("--primaryAlignment").set(alignmentOpt.primaryAlignment, true).set(alignmentOpt.bestStrata, true)) % "Report at most one alignment per read",
@@ -212,11 +257,43 @@ int main(int argc, char* argv[]) {
                     (option("--minScoreFraction") & value("minScoreFraction", alignmentOpt.minScoreFraction)) % "Discard alignments with alignment score < minScoreFraction * max_alignment_score for that read (default=0.65)",
                     (option("--consensusFraction") & value("consensus fraction", alignmentOpt.consensusFraction)) % "The fraction of mems, relative to the reference with "
                     "the maximum number of mems, that a reference must contain in order "
-                    "to move forward with computing an optimal chain score (default=0.65)"
+                    "to move forward with computing an optimal chain score (default=0.65)",
+                    (option("--server") & value("socket", alignmentOpt.serverSocket)) %
+                            "Run the job on the `pufferfish serve` listening on this socket instead of loading the index here"
+    );
+  };
+  auto alignMode = makeAlignMode(alignmentOpt, true);
+
+  auto serveMode = (
+                    command("serve").set(selected, mode::serve),
+                    (required("-i", "--index") & value(ensure_index_exists, "index", serveOpt.indexDir)) % "Directory where the Pufferfish index is stored",
+                    (required("--socket") & value("socket", serveOpt.socketPath)) % "Unix domain socket to take `pufferfish align --server` jobs on",
+                    (option("-t", "--threads") & value("num threads", serveOpt.numThreads)) % "Number of threads every job is mapped with (default=8)",
+                    (
+                      (option("--numaInterleave").set(serveOpt.numaInterleave, true)) %
+                            "Interleave the index over all NUMA nodes and pin the mapping threads to nodes round-robin"
+                      |
+                      (option("--numaReplicate").set(serveOpt.numaReplicate, true)) %
+                            "Load one copy of the index per NUMA node; each mapping thread uses the copy on its node"
+                    ),
+                    (option("--hugePages").set(serveOpt.hugePages, true)) %
+                            "Back the index lookup structures with 2MB transparent huge pages (fewer TLB misses)"
   );
 
+  // a job sent to the server: the arguments of `pufferfish align`, from the command on
+  auto parseJob = [&](const std::vector<std::string>& args, pufferfish::AlignmentOpts& jobOpt, std::string& err) -> bool {
+    try {
+      auto jobMode = makeAlignMode(jobOpt, false);
+      if (parse(args, jobMode)) { return true; }
+      err = usage_lines(jobMode, "").str();
+    } catch (std::exception& e) {
+      err = e.what();
+    }
+    return false;
+  };
+
   auto cli = (
-              (indexMode | validateMode | lookupMode | alignMode | examineMode | command("help").set(selected,mode::help) ),
+              (indexMode | validateMode | lookupMode | alignMode | serveMode | examineMode | command("help").set(selected,mode::help) ),
               option("-v", "--version").call([]{std::cout << "version " << pufferfish::version << "\n"; std::exit(0);}).doc("show version"));
 
   decltype(parse(argc, argv, cli)) res;
@@ -235,7 +312,19 @@ int main(int argc, char* argv[]) {
     case mode::index: pufferfishIndex(indexOpt);  break;
     case mode::validate: pufferfishValidate(validateOpt);  break;
     case mode::lookup: pufferfishTestLookup(lookupOpt); break;
-    case mode::align: pufferfishAligner(alignmentOpt); break;
+    case mode::align:
+      if (!alignmentOpt.serverSocket.empty()) {
+        // everything but --server goes to the server, which parses it again
+        std::vector<std::string> jobArgs;
+        for (int i = 1; i < argc; ++i) {
+          if (std::string(argv[i]) == "--server") { ++i; continue; }
+          jobArgs.emplace_back(argv[i]);
+        }
+        return pufferfish::server::runOnServer(alignmentOpt.serverSocket, jobArgs);
+      }
+      pufferfishAligner(alignmentOpt);
+      break;
+    case mode::serve: return pufferfishServe(serveOpt, parseJob);
     case mode::examine: pufferfishExamine(examineOpt); break;
     case mode::help: std::cout << make_man_page(cli, pufferfish::progname); break;
     }
@@ -251,6 +340,8 @@ int main(int argc, char* argv[]) {
         std::cout << make_man_page(lookupMode, pufferfish::progname);
       } else if (b->arg() == "align") {
         std::cout << make_man_page(alignMode, pufferfish::progname);
+      } else if (b->arg() == "serve") {
+        std::cout << make_man_page(serveMode, pufferfish::progname);
       } else {
         std::cout << "There is no command \"" << b->arg() << "\"\n";
         std::cout << usage_lines(cli, pufferfish::progname) << '\n';
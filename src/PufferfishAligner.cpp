@@ -19,7 +19,14 @@
 #include <tuple>
 #include <memory>
 #include <cstring>
+#include <cerrno>
 #include <queue>
+#include <chrono>
+#include <csignal>
+#include <functional>
+
+#include <sys/un.h>
+#include <unistd.h>
 
 //we already have timers
 
@@ -40,10 +47,15 @@
 #include "spdlog/fmt/fmt.h"
 
 #include "FastxParser.hpp"
+#include "ReadTaskQueue.hpp"
+#include "NUMAUtils.hpp"
 
 //index header
 #include "SelectiveAlignmentUtils.hpp"
 #include "PuffAligner.hpp"
+#include "MappingWorkspace.hpp"
+#include "PairedReadMapper.hpp"
+#include "ReadScreener.hpp"
 #include "ProgOpts.hpp"
 #include "PufferfishIndex.hpp"
 #include "PufferfishSparseIndex.hpp"
@@ -56,7 +68,11 @@
 #include "SAMWriter.hpp"
 #include "RefSeqConstructor.hpp"
 #include "KSW2Aligner.hpp"
-#include "zstr/zstr.hpp"
+#include "OutputRing.hpp"
+#include "BAMWriter.hpp"
+#include "BGZFStream.hpp"
+#include "EquivalenceClassBuilder.hpp"
+#include "MappingServer.hpp"
 
 
 #define MATCH_SCORE 1
@@ -67,8 +83,42 @@
 
 #define ALLOW_VERBOSE 0
 
-using paired_parser = fastx_parser::FastxParser<fastx_parser::ReadPair>;
-using single_parser = fastx_parser::FastxParser<fastx_parser::ReadSeq>;
+using paired_parser = fastx_parser::FastxParser<fastx_parser::ReadViewPair>;
+using single_parser = fastx_parser::FastxParser<fastx_parser::ReadSeqView>;
+// what the mapping threads take their reads from: the parsers' chunks, split into small tasks
+using paired_tasks = ReadTaskQueue<fastx_parser::ReadViewPair>;
+using single_tasks = ReadTaskQueue<fastx_parser::ReadSeqView>;
+
+// Which copy of the index each mapping thread uses, and where it runs
+template <typename PufferfishIndexT>
+struct MappingPlacement {
+    // one copy per NUMA node with --numaReplicate, otherwise just the one
+    std::vector<PufferfishIndexT*> nodeIndex;
+    // the nodes the threads are spread over; with none, they are not pinned
+    pufferfish::numa::Topology topology;
+
+    size_t nodeOf(size_t worker) const {
+        return topology.numNodes() > 0 ? worker % topology.numNodes() : 0;
+    }
+    PufferfishIndexT& indexFor(size_t worker) const {
+        return *nodeIndex[nodeOf(worker) % nodeIndex.size()];
+    }
+    // a thread the kernel won't pin (e.g. in a restricted cpuset) just runs unpinned
+    void pin(size_t worker) const {
+        if (topology.numNodes() > 0) { pufferfish::numa::pinToNode(topology, nodeOf(worker)); }
+    }
+};
+
+// The parser hands out views into its chunk buffers.  Paired-end mapping and
+// the read cache work on those views; the single-end loop and the record
+// writers still take std::string, so those reads are copied here, once, on
+// the mapping thread, into strings that keep their capacity from read to
+// read.  (--screen only copies reads with a candidate to align; see
+// ReadScreener.)
+inline void loadRead(const fastx_parser::ReadSeqView& v, fastx_parser::ReadSeq& r) {
+    r.seq.assign(v.seq.data(), v.seq.size());
+    r.name.assign(v.name.data(), v.name.size());
+}
 
 using HitCounters = pufferfish::util::HitCounters;
 using QuasiAlignment = pufferfish::util::QuasiAlignment;
@@ -76,402 +126,151 @@ using MateStatus = pufferfish::util::MateStatus;
 
 using MutexT = std::mutex;
 
+// With --eqclasses each mapping thread counts its reads in a builder of its
+// own, merged into the main one at the end; those grow as they need to
+// rather than reserving a million classes each.
+constexpr size_t threadEqClasses{1024};
+
+/**
+ * Count a read towards the equivalence class of the references it aligned to.
+ * Each reference keeps its best alignment score, and the read's weights are
+ * those scores normalized to sum to 1 (uniform when none is positive).
+ **/
+template<typename PufferfishIndexT>
+void addReadToEqClasses(PufferfishIndexT &pfi,
+                        std::vector<QuasiAlignment> &alignments,
+                        EquivalenceClassBuilder &eqb,
+                        std::vector<std::pair<uint32_t, double>> &refScores) {
+    refScores.clear();
+    for (auto &qa : alignments) {
+        double score = qa.isPaired ? qa.score + qa.mateScore : qa.score;
+        refScores.emplace_back(static_cast<uint32_t>(pfi.getRefId(qa.tid)), std::max(score, 0.0));
+    }
+    std::sort(refScores.begin(), refScores.end(),
+              [](const std::pair<uint32_t, double> &a, const std::pair<uint32_t, double> &b) {
+                  return a.first < b.first or (a.first == b.first and a.second > b.second);
+              });
+    refScores.erase(std::unique(refScores.begin(), refScores.end(),
+                                [](const std::pair<uint32_t, double> &a, const std::pair<uint32_t, double> &b) {
+                                    return a.first == b.first;
+                                }), refScores.end());
+    double total{0.0};
+    for (auto &rs : refScores) { total += rs.second; }
+    std::vector<uint32_t> refIds;
+    std::vector<double> weights;
+    refIds.reserve(refScores.size());
+    weights.reserve(refScores.size());
+    for (auto &rs : refScores) {
+        refIds.push_back(rs.first);
+        weights.push_back(total > 0.0 ? rs.second / total : 1.0 / refScores.size());
+    }
+    eqb.addGroup(TargetGroup(refIds), weights);
+}
+
+/**
+ * Write the classes in salmon's eq_classes.txt layout: the number of
+ * references and of classes, the reference names, then one line per class
+ * with its size, reference ids, weights and read count.
+ **/
+template<typename PufferfishIndexT>
+void writeEquivalenceClasses(PufferfishIndexT &pfi, EquivalenceClassBuilder &eqb, std::ostream &out) {
+    eqb.finish();
+    auto &refNames = pfi.getFullRefNames();
+    auto &eqVec = eqb.eqVec();
+    fmt::MemoryWriter w;
+    w << refNames.size() << '\n' << eqVec.size() << '\n';
+    for (auto &name : refNames) { w << name << '\n'; }
+    for (auto &eq : eqVec) {
+        auto &tgts = eq.first.tgts;
+        w << tgts.size();
+        for (auto t : tgts) { w << '\t' << t; }
+        for (auto wt : eq.second.weights) { w.write("\t{}", wt); }
+        w << '\t' << eq.second.count << '\n';
+        if (w.size() > (1u << 20)) {
+            out.write(w.data(), w.size());
+            w.clear();
+        }
+    }
+    out.write(w.data(), w.size());
+}
+
 
 //===========
 // PAIRED END
 //============
 template<typename PufferfishIndexT>
-void processReadsPair(paired_parser *parser,
+void processReadsPair(paired_tasks *parser,
                       PufferfishIndexT &pfi,
                       MutexT *iomutex,
                       std::shared_ptr<spdlog::logger> outQueue,
+                      OutputRing *outRing,
+                      const BAMRefIds *bamRefs,
+                      pam::PAMWriter *pamWriter,
+                      EquivalenceClassBuilder *eqBuilder,
                       HitCounters &hctr,
                       phmap::flat_hash_set<std::string>& gene_names,
                       phmap::flat_hash_set<std::string>& rrna_names,
                       pufferfish::AlignmentOpts *mopts) {
-    MemCollector<PufferfishIndexT> memCollector(&pfi);
-    memCollector.configureMemClusterer(mopts->maxAllowedRefsPerHit);
-    memCollector.setConsensusFraction(mopts->consensusFraction);
+    PairedReadMapper<PufferfishIndexT> mapper(&pfi, mopts, gene_names, rrna_names);
+    auto &jointHits = mapper.jointHits();
+    auto &jointAlignments = mapper.jointAlignments();
 
-    auto logger = spdlog::get("stderrLog");
-    fmt::MemoryWriter sstream;
     BinWriter bstream;
+    // with --pamV2, the chunk's mappings are collected here instead of in bstream
+    pam::PAMBlockBuilder pamBlock(true, mopts->krakOut);
+    std::vector<uint8_t> pamScratch;
+    // with --eqclasses, this thread's classes; merged into eqBuilder when it is done
+    std::unique_ptr<EquivalenceClassBuilder> localEqb{nullptr};
+    if (eqBuilder) { localEqb.reset(new EquivalenceClassBuilder(threadEqClasses)); }
+    std::vector<std::pair<uint32_t, double>> eqRefScores;
+    // SAM records of the current chunk are formatted straight into a buffer of the output ring
+    OutputRing::Buffer* samBuf{nullptr};
 
-    //size_t batchSize{2500} ;
-    uint32_t readLen{0}, mateLen{0}, totLen{0};
-
-
-    pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>> leftHits;
-    pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>> rightHits;
-    //phmap::flat_hash_map<size_t, std::vector<pufferfish::util::MemCluster>> leftHits;
-    //phmap::flat_hash_map<size_t, std::vector<pufferfish::util::MemCluster>> rightHits;
-
-    std::vector<pufferfish::util::MemCluster> recoveredHits;
-    std::vector<pufferfish::util::JointMems> jointHits;
     PairedAlignmentFormatter<PufferfishIndexT *> formatter(&pfi);
-    pufferfish::util::QueryCache qc;
-
-    //Initialize aligner ksw
-    ksw2pp::KSW2Aligner aligner(mopts->matchScore, mopts->missMatchScore);
-    ksw2pp::KSW2Config config;
-
-    config.dropoff = -1;
-    config.gapo = mopts->gapOpenPenalty;
-    config.gape = mopts->gapExtendPenalty;
-    config.bandwidth = 15;
-    config.flag = 0;
-    config.flag |= KSW_EZ_RIGHT;
-    config.flag |= KSW_EZ_SCORE_ONLY;
-    aligner.config() = config;
-
-    constexpr const int32_t invalidScore = std::numeric_limits<int32_t>::min();
-
-    // don't think we should have these, they should
-    // be baked into the index I think.
-    bool filterGenomics = mopts->filterGenomics;
-    bool filterMicrobiom = mopts->filterMicrobiom;
-    bool filterBestScoreMicrobiom = mopts->filterMicrobiomBestScore;
 
     auto rg = parser->getReadGroup();
 
-    phmap::flat_hash_map<uint32_t, std::pair<int32_t, int32_t>> bestScorePerTranscript;
-
-    pufferfish::util::AlignmentConfig aconf;
-    aconf.refExtendLength = mopts->refExtendLength;
-    aconf.fullAlignment = mopts->fullAlignment;
-    aconf.matchScore = mopts->matchScore;
-    aconf.gapExtendPenalty = mopts->gapExtendPenalty;
-    aconf.gapOpenPenalty = mopts->gapOpenPenalty;
-    aconf.minScoreFraction = mopts->minScoreFraction;
-    aconf.mimicBT2 = mopts->mimicBt2Default;
-
-    PuffAligner puffaligner(pfi.refseq_, pfi.refAccumLengths_, pfi.k(), aconf, aligner);
-
-    std::vector<QuasiAlignment> jointAlignments;
-    using pufferfish::util::BestHitReferenceType;
-    BestHitReferenceType bestHitRefType{BestHitReferenceType::UNKNOWN};
-    BestHitReferenceType hitRefType{BestHitReferenceType::UNKNOWN};
-    pufferfish::util::MappingConstraintPolicy mpol;
-    mpol.noDiscordant = mopts->noDiscordant;
-    mpol.noOrphans = mopts->noOrphan;
-    mpol.noDovetail = false; // Add flag for this
-    uint64_t firstDecoyIndex = pfi.firstDecoyIndex();
-
-    //For filtering reads
-    bool verbose = mopts->verbose;
-//    auto &txpNames = pfi.getRefNames();
-    while (parser->refill(rg)) {
-        for (auto &rpair : rg) {
-            readLen = static_cast<uint32_t >(rpair.first.seq.length());
-            mateLen = static_cast<uint32_t >(rpair.second.seq.length());
-            totLen = readLen + mateLen;
-
+    fastx_parser::ReadPair rpair;
+    auto nextChunk = [&]() -> bool {
+        if (!outRing) { return parser->refill(rg); }
+        samBuf = outRing->nextChunk(parser, rg);
+        return samBuf != nullptr;
+    };
+    while (nextChunk()) {
+        for (auto &rview : rg) {
             ++hctr.numReads;
 
-            jointHits.clear();
-            leftHits.clear();
-            rightHits.clear();
-            recoveredHits.clear();
-            memCollector.clear();
-            jointAlignments.clear();
-
-            // There is no way to revocer the following case other than aligning indels
-            //verbose = rpair.first.seq == "CAGTGAGCCAAGATGGCGCCACTGCACTCCAGCCTGGGCAAAAAGAAACTCCATCTAAAAAAAAAAAAAAAAAAAAAAAAAAGAGAAAACCCTGGTCCCT" or
-            //          rpair.second.seq == "CAGTGAGCCAAGATGGCGCCACTGCACTCCAGCCTGGGCAAAAAGAAACTCCATCTAAAAAAAAAAAAAAAAAAAAAAAAAAGAGAAAACCCTGGTCCCT";
-
-            // The only way to get it right is with non-heuristic chaining
-            // verbose = rpair.first.seq == "AGCAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGTGGTGGGGGTGGTGGTGGTGGTGGTGGTGGTGGTGGTGGTGGTAGAGAGGCACCAGCA" or
-            //           rpair.second.seq == "AGCAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGAGGTGGTGGGGGTGGTGGTGGTGGTGGTGGTGGTGGTGGTGGTGGTAGAGAGGCACCAGCA";
-
-            //verbose = rpair.first.name == "mason_sample5_primary_1M_random.fasta.000050010/1";
-            bool lh = memCollector(rpair.first.seq,
-                                   qc,
-                                   true, // isLeft
-                                   verbose);
-            bool rh = memCollector(rpair.second.seq,
-                                   qc,
-                                   false, // isLeft
-                                   verbose);
-            memCollector.findChains(rpair.first.seq,
-                                   leftHits,
-                                   mopts->maxSpliceGap,
-                                   MateStatus::PAIRED_END_LEFT,
-                                   mopts->heuristicChaining,
-                                   true, // isLeft
-                                   verbose);
-            memCollector.findChains(rpair.second.seq,
-                                   rightHits,
-                                   mopts->maxSpliceGap,
-                                   MateStatus::PAIRED_END_RIGHT,
-                                   mopts->heuristicChaining,
-                                   false, // isLeft
-                                   verbose);
-
-            hctr.numMappedAtLeastAKmer += (leftHits.size() > 0 || rightHits.size() > 0) ? 1 : 0;
-            //do intersection on the basis of
-            //performance, or going towards selective alignment
-            //otherwise orphan
-
-            // We also handle orphans inside this function
-            /*if (rpair.first.name == "SRR3192367.14734") {
-                std::stringstream ss;
-                ss << "\n\nBefore joining:\n";
-                for (auto &kv: leftHits) {
-                    ss << kv.first << ":" << txpNames[kv.first] << " ";
-                }
-                ss << "\n";
-                for (auto &kv: rightHits) {
-                    ss << kv.first << ":" << txpNames[kv.first] << " ";
-                }
-                ss << "\n\n";
-                std::cerr << ss.str();
-            }*/
-            auto mergeRes = pufferfish::util::joinReadsAndFilter(leftHits, rightHits, jointHits,
-                                                                 mopts->maxFragmentLength,
-                                                                 totLen,
-                                                                 mopts->scoreRatio,
-                                                                 firstDecoyIndex,
-                                                                 mpol, hctr);
-
-            bool mergeStatusOR = (mergeRes == pufferfish::util::MergeResult::HAD_EMPTY_INTERSECTION or
-                                  mergeRes == pufferfish::util::MergeResult::HAD_ONLY_LEFT or
-                                  mergeRes == pufferfish::util::MergeResult::HAD_ONLY_RIGHT);
-
-            if ( mopts->recoverOrphans and mergeStatusOR ) {
-              // TODO NOTE : do futher testing
-              bool recoveredAny = selective_alignment::utils::recoverOrphans(rpair.first.seq, rpair.second.seq, recoveredHits, jointHits, puffaligner, verbose);
-              (void)recoveredAny;
+            // seeding reads the mates where the parser left them
+            if (!mapper.map(rview.first.seq, rview.second.seq, hctr)) {
+                // dropped by one of the reference filters
+                continue;
             }
 
-            hctr.peHits += jointHits.size();
-
-#if ALLOW_VERBOSE
-            if (verbose)
-                std::cerr<<"Number of hits: "<<jointHits.size()<<"\n";
-#endif // ALLOW_VERBOSE
-
-            if (!mopts->justMap) {
-              puffaligner.clear();
-              int32_t bestScore = invalidScore;
-              std::vector<decltype(bestScore)> scores(jointHits.size(), bestScore);
-              size_t idx{0};
-
-                if (!mopts->genomicReads) { bestScorePerTranscript.clear(); }
-                bestHitRefType = BestHitReferenceType::UNKNOWN;
-                hitRefType = BestHitReferenceType::UNKNOWN;
-                bool isMultimapping = (jointHits.size() > 1);
-//                if (rpair.first.name == "SRR3192367.14734") {
-//                    verbose = true;
-//                }
-//                std::stringstream ss;
-//                if (verbose)
-//                   ss << "\n\n found the read:\n" << rpair.first.name << " " << jointHits.size() <<"\n";
-                for (auto &&jointHit : jointHits) {
-                  auto hitScore = puffaligner.calculateAlignments(rpair.first.seq, rpair.second.seq, jointHit, hctr, isMultimapping, false);
-                  scores[idx] = hitScore;
-//                    if (verbose)
-//                        ss << txpNames[jointHit.tid] << " " << jointHit.alignmentScore << " " << scores[idx] << "\n";
-                    const std::string& ref_name = pfi.refName(jointHit.tid);//txpNames[jointHit.tid];
-                    if (filterMicrobiom and hitScore != invalidScore
-                    and hitRefType != BestHitReferenceType::FILTERED) {
-                        bool inFilteredList = (rrna_names.find(ref_name) != rrna_names.end());
-                        if (inFilteredList) {
-/*
-                            std::stringstream ss;
-                            ss << ref_name << " " << hitScore << "\n";
-                            std::cerr << ss.str();
-*/
-                            hitRefType = BestHitReferenceType::FILTERED;
-                        }
-                    }
-                    if (filterGenomics or filterBestScoreMicrobiom) {
-                      bool inFilteredList = (gene_names.find(ref_name) != gene_names.end());
-                      if (inFilteredList) {
-//                          ss << "in filterMicrobiom\n";
-                          scores[idx] = invalidScore;
-                          if (hitScore > bestScore) {
-                              bestHitRefType = BestHitReferenceType::FILTERED;
-//                            if (verbose) ss << "1 " << bestScore;
-                          } else if (hitScore == bestScore) {
-                              bestHitRefType = (bestHitRefType == BestHitReferenceType::NON_FILTERED or
-                                                bestHitRefType == BestHitReferenceType::BOTH) ?
-                                               BestHitReferenceType::BOTH : BestHitReferenceType::FILTERED;
-//                            if (verbose) ss << "2 " << bestScore;
-                          }
-                      } else { // the current hit was not in the list of references to filter
-                          if (hitScore > bestScore) {
-                              bestHitRefType = BestHitReferenceType::NON_FILTERED;
-//                            if (verbose) ss << "3 " << bestScore;
-                          } else if (hitScore == bestScore) {
-                              bestHitRefType = (bestHitRefType == BestHitReferenceType::FILTERED or
-                                                bestHitRefType == BestHitReferenceType::BOTH) ?
-                                               BestHitReferenceType::BOTH : BestHitReferenceType::NON_FILTERED;
-//                            if (verbose) ss << "4 " << bestScore;
-                          }
-                      }
-//                      if (verbose) ss << "\n";
-                    }
-
-                    bestScore = (hitScore > bestScore) ? hitScore : bestScore;
-
-                    // use ALIGNMENT SCORE, not COVERAGE
-                    // We should have valid alignment scores at this point as we are inside !justMap if and passed calculating alignment score
-                    if (!mopts->genomicReads) {
-                        // removing dupplicate hits from a read to the same transcript
-                      auto it = bestScorePerTranscript.find(jointHit.tid);
-                        if (it == bestScorePerTranscript.end()) {
-                          // if we didn't have any alignment for this transcript yet, then
-                          // this is the current best
-                          // cast is a hack :(
-                          bestScorePerTranscript[jointHit.tid].first = jointHit.alignmentScore+jointHit.mateAlignmentScore;/*static_cast<int32_t>(jointHit.coverage());*/
-                          bestScorePerTranscript[jointHit.tid].second = idx;
-                        } else if (jointHit.coverage() > it->second.first) {
-                          // otherwise, if we had an alignment for this transcript and it's
-                          // better than the current best, then set the best score to this
-                          // alignment's score, and invalidate the previous alignment
-                          it->second.first = jointHit.alignmentScore+jointHit.mateAlignmentScore;/*static_cast<int32_t>(jointHit.coverage());*/
-                          scores[it->second.second] = invalidScore;
-                          it->second.second = idx;
-                        } else {
-                          // otherwise, there is already a better mapping for this transcript.
-                          scores[idx] = invalidScore;
-                        }
-                    }
-                    ++idx;
-                }
-
-                /*if (verbose) {
-                    ss << "\n\nbestHitRefType: ";
-                    switch(bestHitRefType) {
-                        case BestHitReferenceType::UNKNOWN:
-                            ss << "unknown\n"; break;
-                        case BestHitReferenceType::FILTERED:
-                            ss << "filtered\n"; break;
-                        case BestHitReferenceType::NON_FILTERED:
-                            ss << "nonFiltered\n"; break;
-                        case BestHitReferenceType::BOTH:
-                            ss << "both\n"; break;
-                    }
-                }
-                if (verbose) {std::cerr << ss.str();  verbose = false; std::exit(1);}*/
-                if (filterGenomics and (bestHitRefType == BestHitReferenceType::FILTERED) ) {
-                    // This read is likely come from decoy sequence and should be discarded from reference alignments
-                    continue;
-                }
-               /* std::stringstream ss;
-
-                ss << filterMicrobiom << " ";
-                switch(bestHitRefType) {
-                    case BestHitReferenceType::UNKNOWN:
-                        ss << "unknown\n"; break;
-                    case BestHitReferenceType::FILTERED:
-                        ss << "filtered\n"; break;
-                    case BestHitReferenceType::NON_FILTERED:
-                        ss << "nonFiltered\n"; break;
-                    case BestHitReferenceType::BOTH:
-                        ss << "both\n"; break;
-                }
-                std::cerr << ss.str();*/
-                if (filterBestScoreMicrobiom and (bestHitRefType != BestHitReferenceType::NON_FILTERED)) {
-                    continue;
-                }
-                if (filterMicrobiom and (hitRefType == BestHitReferenceType::FILTERED)) {
-//                    std::cerr << "filtered\n";
-                    continue;
-                }
-                // Filter out these alignments with low scores
-                uint32_t ctr{0};
-                if (bestScore > invalidScore) {
-                  bool filterBestStrata = mopts->bestStrata;
-                  jointHits.erase(
-                                  std::remove_if(jointHits.begin(), jointHits.end(),
-                                                 [&ctr, &scores, filterBestStrata, bestScore](pufferfish::util::JointMems &) -> bool {
-                                                   bool rem = filterBestStrata ? (scores[ctr] < bestScore) : (scores[ctr] == invalidScore);
-                                                   ++ctr;
-                                                   return rem;
-                                                 }),
-                                  jointHits.end()
-                                  );
-
-                  if (mopts->primaryAlignment and !jointHits.empty()) {
-                    jointHits.resize(1);
-                  }
-                } else {
-                    // There is no alignment with high quality for this read, so we skip this reads' alignments
-                    jointHits.clear();
-                }
-            }
-
-            if (jointHits.size() > mopts->maxNumHits) {
-                std::sort(jointHits.begin(), jointHits.end(),
-                          [](const auto &lhs, const auto &rhs) {
-                              return lhs.alignmentScore < rhs.alignmentScore;
-                          });
-                jointHits.erase(jointHits.begin() + mopts->maxNumHits, jointHits.end());
-            }
-
-            hctr.totHits += !jointHits.empty() && !jointHits.back().isOrphan() ? 1 : 0;;
-            hctr.numMapped += !jointHits.empty() ? 1 : 0;
-            if (mopts->noOrphan) {
-                hctr.numOfOrphans += jointHits.empty() && (lh || rh);
-            } else {
-                hctr.numOfOrphans += !jointHits.empty() && (jointHits.back().isOrphan()) ? 1 : 0;
-            }
-
-            if (jointHits.size() > hctr.maxMultimapping) {
-                hctr.maxMultimapping = jointHits.size();
-            }
-
-            for (auto &&jointHit : jointHits) {
-              if (jointHit.isOrphan()) {
-                readLen = jointHit.isLeftAvailable() ? readLen : mateLen;
-                jointAlignments.emplace_back(jointHit.tid,           // reference id
-                                             jointHit.orphanClust()->getTrFirstHitPos(),     // reference pos
-                                             jointHit.orphanClust()->isFw,     // fwd direction
-                                             readLen, // read length
-                                             jointHit.orphanClust()->cigar, // cigar string
-                                             jointHit.fragmentLen,       // fragment length
-                                             false);
-                auto &qaln = jointAlignments.back();
-                // NOTE : score should not be filled in from a double
-                qaln.score = mopts->justMap ? static_cast<int32_t >(jointHit.orphanClust()->coverage):jointHit.alignmentScore;//()->coverage;
-                // NOTE : wth is numHits?
-                qaln.numHits = static_cast<uint32_t >(jointHits.size());//orphanClust()->coverage;
-                qaln.mateStatus = jointHit.mateStatus;
-              } else {
-                jointAlignments.emplace_back(jointHit.tid,           // reference id
-                                             jointHit.leftClust->getTrFirstHitPos(),     // reference pos
-                                             jointHit.leftClust->isFw,     // fwd direction
-                                             readLen, // read length
-                                             jointHit.leftClust->cigar, // cigar string
-                                             jointHit.fragmentLen,       // fragment length
-                                             true);         // properly paired
-                // Fill in the mate info
-                auto &qaln = jointAlignments.back();
-                qaln.mateLen = mateLen;
-                qaln.mateCigar = jointHit.rightClust->cigar;
-                qaln.matePos = static_cast<int32_t >(jointHit.rightClust->getTrFirstHitPos());
-                qaln.mateIsFwd = jointHit.rightClust->isFw;
-                qaln.mateStatus = MateStatus::PAIRED_END_PAIRED;
-                // NOTE : wth is numHits?
-                qaln.numHits = static_cast<uint32_t >(jointHits.size());
-                // NOTE : score should not be filled in from a double
-                qaln.score = mopts->justMap ? static_cast<int32_t >(jointHit.leftClust->coverage):jointHit.alignmentScore;
-                qaln.mateScore = mopts->justMap ? static_cast<int32_t >(jointHit.rightClust->coverage):jointHit.mateAlignmentScore;;
-              }
-            }
-
-            hctr.totAlignment += jointAlignments.size();
-
             if (!mopts->noOutput) {
-              if (mopts->krakOut) {
+              // the writers take the records as strings; the eq classes don't need them
+              if (!localEqb) {
+                loadRead(rview.first, rpair.first);
+                loadRead(rview.second, rpair.second);
+              }
+              if (localEqb) {
+                if (!jointAlignments.empty()) { addReadToEqClasses(pfi, jointAlignments, *localEqb, eqRefScores); }
+              } else if (pamWriter) {
+                addAlignmentsToPAMBlock(rpair, formatter, jointHits, pamBlock, mopts->justMap);
+              } else if (mopts->krakOut) {
                 writeAlignmentsToKrakenDump(rpair,  formatter,  jointHits, bstream, mopts->justMap);
               } else if (mopts->salmonOut) {
                 writeAlignmentsToKrakenDump(rpair,  formatter,  jointHits, bstream, mopts->justMap, false);
+              } else if (bamRefs) {
+                BAMRecordSink bamOut{samBuf->text, *bamRefs};
+                if (jointAlignments.size() > 0) {
+                  writeAlignmentsToStream(rpair, formatter, jointAlignments, bamOut, !mopts->noOrphan);
+                } else {
+                  writeUnalignedPairToStream(rpair, bamOut);
+                }
               } else if (jointAlignments.size() > 0) {
-                writeAlignmentsToStream(rpair, formatter, jointAlignments, sstream, !mopts->noOrphan);
+                writeAlignmentsToStream(rpair, formatter, jointAlignments, samBuf->text, !mopts->noOrphan);
               } else if (jointAlignments.size() == 0) {
-                writeUnalignedPairToStream(rpair, sstream);
+                writeUnalignedPairToStream(rpair, samBuf->text);
               }
             }
 
@@ -492,8 +291,10 @@ void processReadsPair(paired_parser *parser,
         } // for all reads in this job
         // dump output
         if (!mopts->noOutput) {
-            // Get rid of last newline
-            if (mopts->salmonOut) {
+            if (pamWriter) {
+                // tasks are small; blocks span several of them
+                if (pamBlock.numReads() >= pam::targetBlockReads) { pamWriter->writeBlock(pamBlock, pamScratch); }
+            } else if (mopts->salmonOut) {
                 if (bstream.getBytes() != 0) {
                     BinWriter sbw(sizeof(uint64_t));
                     sbw << bstream.getBytes();
@@ -501,41 +302,56 @@ void processReadsPair(paired_parser *parser,
                 }
             } else if (mopts->krakOut) {
                 outQueue->info("{}", bstream);
-            } else {
-                std::string outStr(sstream.str());
-                if (!outStr.empty()) {
-                    outStr.pop_back();
-                    outQueue->info(std::move(outStr));
-                }
+            } else if (outRing) {
+                outRing->submit(samBuf);
+                samBuf = nullptr;
             }
-            sstream.clear();
             bstream.clear();
         }
     } // processed all reads
+    mapper.addWorkspaceStats(hctr);
+    if (pamWriter and !mopts->noOutput) { pamWriter->writeBlock(pamBlock, pamScratch); }
+    if (localEqb) {
+        std::lock_guard<MutexT> l(*iomutex);
+        eqBuilder->mergeUnfinishedEQB(*localEqb);
+    }
 }
 
 //===========
 // SINGLE END
 //============
 template<typename PufferfishIndexT>
-void processReadsSingle(single_parser *parser,
+void processReadsSingle(single_tasks *parser,
                         PufferfishIndexT &pfi,
                         MutexT *iomutex,
                         std::shared_ptr<spdlog::logger> outQueue,
+                        OutputRing *outRing,
+                        const BAMRefIds *bamRefs,
+                        pam::PAMWriter *pamWriter,
+                        EquivalenceClassBuilder *eqBuilder,
                         HitCounters &hctr,
                         phmap::flat_hash_set<std::string>& gene_names,
                         pufferfish::AlignmentOpts *mopts) {
-    MemCollector<PufferfishIndexT> memCollector(&pfi);
-    memCollector.configureMemClusterer(mopts->maxAllowedRefsPerHit);
-    memCollector.setConsensusFraction(mopts->consensusFraction);
+    MappingWorkspace<PufferfishIndexT> ws(&pfi, mopts);
+    auto& memCollector = ws.memCollector;
+    auto& puffaligner = ws.puffaligner;
+    auto& qc = ws.qc;
 
     using pufferfish::util::BestHitReferenceType;
     BestHitReferenceType bestHitRefType{BestHitReferenceType::UNKNOWN};
     phmap::flat_hash_map<uint32_t, std::pair<int32_t, int32_t>> bestScorePerTranscript;
 
     auto logger = spdlog::get("stderrLog");
-    fmt::MemoryWriter sstream;
     BinWriter bstream;
+    // with --pamV2, the chunk's mappings are collected here instead of in bstream
+    pam::PAMBlockBuilder pamBlock(false, mopts->krakOut);
+    std::vector<uint8_t> pamScratch;
+    // with --eqclasses, this thread's classes; merged into eqBuilder when it is done
+    std::unique_ptr<EquivalenceClassBuilder> localEqb{nullptr};
+    if (eqBuilder) { localEqb.reset(new EquivalenceClassBuilder(threadEqClasses)); }
+    std::vector<std::pair<uint32_t, double>> eqRefScores;
+    // SAM records of the current chunk are formatted straight into a buffer of the output ring
+    OutputRing::Buffer* samBuf{nullptr};
     //size_t batchSize{2500} ;
     uint32_t readLen{0};
     std::string dummyRead = "";
@@ -544,40 +360,25 @@ void processReadsSingle(single_parser *parser,
     pufferfish::util::CachedVectorMap<size_t, std::vector<pufferfish::util::MemCluster>, std::hash<size_t>> leftHits;
     std::vector<pufferfish::util::JointMems> jointHits;
     PairedAlignmentFormatter<PufferfishIndexT *> formatter(&pfi);
-    pufferfish::util::QueryCache qc;
     std::vector<pufferfish::util::MemCluster> all;
-
-    //Initialize aligner ksw
-    ksw2pp::KSW2Aligner aligner(mopts->matchScore, mopts->missMatchScore);
-    ksw2pp::KSW2Config config;
-
-    config.dropoff = -1;
-    config.gapo = mopts->gapOpenPenalty;
-    config.gape = mopts->gapExtendPenalty;
-    config.bandwidth = 15;
-    config.flag = 0;
-    config.flag |= KSW_EZ_RIGHT;
-    config.flag |= KSW_EZ_SCORE_ONLY;
-    aligner.config() = config;
+    std::vector<QuasiAlignment> jointAlignments;
+    std::vector<std::pair<uint32_t, std::vector<pufferfish::util::MemCluster>::iterator>> validHits;
+    std::vector<int32_t> scores;
 
     constexpr const int32_t invalidScore = std::numeric_limits<int32_t>::min();
 
 //    auto &txpNames = pfi.getRefNames();
 
-    pufferfish::util::AlignmentConfig aconf;
-    aconf.refExtendLength = mopts->refExtendLength;
-    aconf.fullAlignment = mopts->fullAlignment;
-    aconf.matchScore = mopts->matchScore;
-    aconf.gapExtendPenalty = mopts->gapExtendPenalty;
-    aconf.gapOpenPenalty = mopts->gapOpenPenalty;
-    aconf.minScoreFraction = mopts->minScoreFraction;
-    aconf.mimicBT2 = mopts->mimicBt2Default;
-
-    PuffAligner puffaligner(pfi.refseq_, pfi.refAccumLengths_, pfi.k(), aconf, aligner);
-
     auto rg = parser->getReadGroup();
-    while (parser->refill(rg)) {
-        for (auto &read : rg) {
+    fastx_parser::ReadSeq read;
+    auto nextChunk = [&]() -> bool {
+        if (!outRing) { return parser->refill(rg); }
+        samBuf = outRing->nextChunk(parser, rg);
+        return samBuf != nullptr;
+    };
+    while (nextChunk()) {
+        for (auto &rview : rg) {
+            loadRead(rview, read);
             readLen = static_cast<uint32_t >(read.seq.length());
             auto totLen = readLen;
             bool verbose = false;
@@ -592,11 +393,12 @@ void processReadsSingle(single_parser *parser,
             bool filterGenomics = mopts->filterGenomics;
             bool filterMicrobiom = mopts->filterMicrobiom;
 
-            bool lh = memCollector(read.seq,
+            // seeding reads the record where the parser left it
+            bool lh = memCollector(rview.seq,
                                    qc,
                                    true, // isLeft
                                    verbose);
-            memCollector.findChains(read.seq,
+            memCollector.findChains(rview.seq,
                                    leftHits,
                                    mopts->maxSpliceGap,
                                    MateStatus::SINGLE_END,
@@ -609,14 +411,14 @@ void processReadsSingle(single_parser *parser,
                                      totLen,
                                      mopts->scoreRatio);
 
-            std::vector<QuasiAlignment> jointAlignments;
-            std::vector<std::pair<uint32_t, std::vector<pufferfish::util::MemCluster>::iterator>> validHits;
+            jointAlignments.clear();
+            validHits.clear();
 
             if (!mopts->justMap) {
                 puffaligner.clear();
 
                 int32_t bestScore = invalidScore;
-                std::vector<decltype(bestScore)> scores(jointHits.size(), bestScore);
+                scores.assign(jointHits.size(), bestScore);
                 size_t idx{0};
 
                 bool bestScoreGenomic{false};
@@ -625,6 +427,7 @@ void processReadsSingle(single_parser *parser,
                 if (!mopts->genomicReads) { bestScorePerTranscript.clear(); }
                 bestHitRefType = BestHitReferenceType::UNKNOWN;
                 bool isMultimapping = (jointHits.size() > 1);
+                puffaligner.batchScoreCandidates(read.seq, jointHits, hctr);
                 for (auto &jointHit : jointHits) {
                   int32_t hitScore = puffaligner.calculateAlignments(read.seq, jointHit, hctr, isMultimapping, verbose);
                     scores[idx] = hitScore;
@@ -748,18 +551,29 @@ void processReadsSingle(single_parser *parser,
             hctr.totAlignment += jointHits.size();
 
             // write puffkrak format output
-            if (mopts->krakOut) {
+            if (localEqb) {
+              if (!jointAlignments.empty()) { addReadToEqClasses(pfi, jointAlignments, *localEqb, eqRefScores); }
+            } else if (pamWriter) {
+              addAlignmentsToPAMBlock(read, formatter, validHits, pamBlock);
+            } else if (mopts->krakOut) {
               writeAlignmentsToKrakenDump(read, formatter,
                                           validHits, bstream);
             } else if (mopts->salmonOut) {
               writeAlignmentsToKrakenDump(read, formatter,
                                             validHits, bstream, false);
+            } else if (bamRefs and !mopts->noOutput) {
+              BAMRecordSink bamOut{samBuf->text, *bamRefs};
+              if (jointHits.size() > 0) {
+                writeAlignmentsToStreamSingle(read, formatter, jointAlignments, bamOut, !mopts->noOrphan);
+              } else {
+                writeUnalignedSingleToStream(read, bamOut);
+              }
             } else if (jointHits.size() > 0 and !mopts->noOutput) {
                 // write sam output for mapped reads
-                writeAlignmentsToStreamSingle(read, formatter, jointAlignments, sstream, !mopts->noOrphan);
+                writeAlignmentsToStreamSingle(read, formatter, jointAlignments, samBuf->text, !mopts->noOrphan);
             } else if (jointHits.size() == 0 and !mopts->noOutput) {
                 // write sam output for un-mapped reads
-              writeUnalignedSingleToStream(read, sstream);
+              writeUnalignedSingleToStream(read, samBuf->text);
             }
 
             // write them on cmd
@@ -782,8 +596,10 @@ void processReadsSingle(single_parser *parser,
 
         // dump output
         if (!mopts->noOutput) {
-            // Get rid of last newline
-            if (mopts->krakOut || mopts->salmonOut) {
+            if (pamWriter) {
+                // tasks are small; blocks span several of them
+                if (pamBlock.numReads() >= pam::targetBlockReads) { pamWriter->writeBlock(pamBlock, pamScratch); }
+            } else if (mopts->krakOut || mopts->salmonOut) {
                 if (mopts->salmonOut && bstream.getBytes() > 0) {
                     BinWriter sbw(64);
                     sbw << bstream.getBytes();
@@ -792,18 +608,19 @@ void processReadsSingle(single_parser *parser,
                     outQueue->info("{}", bstream);
                 }
                 bstream.clear();
-            } else {
-                std::string outStr(sstream.str());
-                // Get rid of last newline
-                if (!outStr.empty()) {
-                    outStr.pop_back();
-                    outQueue->info(std::move(outStr));
-                }
-                sstream.clear();
+            } else if (outRing) {
+                outRing->submit(samBuf);
+                samBuf = nullptr;
             }
         }
 
     } // processed all reads
+    ws.addStats(hctr);
+    if (pamWriter and !mopts->noOutput) { pamWriter->writeBlock(pamBlock, pamScratch); }
+    if (localEqb) {
+        std::lock_guard<MutexT> l(*iomutex);
+        eqBuilder->mergeUnfinishedEQB(*localEqb);
+    }
 }
 
 //===========
@@ -812,10 +629,14 @@ void processReadsSingle(single_parser *parser,
 template<typename PufferfishIndexT>
 bool spawnProcessReadsThreads(
         uint32_t nthread,
-        paired_parser *parser,
-        PufferfishIndexT &pfi,
+        paired_tasks *parser,
+        const MappingPlacement<PufferfishIndexT> &placement,
         MutexT &iomutex,
         std::shared_ptr<spdlog::logger> outQueue,
+        OutputRing *outRing,
+        const BAMRefIds *bamRefs,
+        pam::PAMWriter *pamWriter,
+        EquivalenceClassBuilder *eqBuilder,
         HitCounters &hctr,
         phmap::flat_hash_set<std::string>& gene_names,
         phmap::flat_hash_set<std::string>& rrna_names,
@@ -825,15 +646,21 @@ bool spawnProcessReadsThreads(
 
     for (size_t i = 0; i < nthread; ++i) {
 
-        threads.emplace_back(processReadsPair<PufferfishIndexT>,
-                             parser,
-                             std::ref(pfi),
-                             &iomutex,
-                             outQueue,
-                             std::ref(hctr),
-                             std::ref(gene_names),
-                             std::ref(rrna_names),
-                             mopts);
+        threads.emplace_back([&, i]() {
+            placement.pin(i);
+            processReadsPair<PufferfishIndexT>(parser,
+                                               placement.indexFor(i),
+                                               &iomutex,
+                                               outQueue,
+                                               outRing,
+                                               bamRefs,
+                                               pamWriter,
+                                               eqBuilder,
+                                               hctr,
+                                               gene_names,
+                                               rrna_names,
+                                               mopts);
+        });
     }
     for (auto &t : threads) { t.join(); }
 
@@ -846,10 +673,14 @@ bool spawnProcessReadsThreads(
 template<typename PufferfishIndexT>
 bool spawnProcessReadsThreads(
         uint32_t nthread,
-        single_parser *parser,
-        PufferfishIndexT &pfi,
+        single_tasks *parser,
+        const MappingPlacement<PufferfishIndexT> &placement,
         MutexT &iomutex,
         std::shared_ptr<spdlog::logger> outQueue,
+        OutputRing *outRing,
+        const BAMRefIds *bamRefs,
+        pam::PAMWriter *pamWriter,
+        EquivalenceClassBuilder *eqBuilder,
         HitCounters &hctr,
         phmap::flat_hash_set<std::string>& gene_names,
         pufferfish::AlignmentOpts *mopts) {
@@ -858,20 +689,193 @@ bool spawnProcessReadsThreads(
 
     for (size_t i = 0; i < nthread; ++i) {
 
-        threads.emplace_back(processReadsSingle<PufferfishIndexT>,
-                             parser,
-                             std::ref(pfi),
-                             &iomutex,
-                             outQueue,
-                             std::ref(hctr),
-                             std::ref(gene_names),
-                             mopts);
+        threads.emplace_back([&, i]() {
+            placement.pin(i);
+            processReadsSingle<PufferfishIndexT>(parser,
+                                                 placement.indexFor(i),
+                                                 &iomutex,
+                                                 outQueue,
+                                                 outRing,
+                                                 bamRefs,
+                                                 pamWriter,
+                                                 eqBuilder,
+                                                 hctr,
+                                                 gene_names,
+                                                 mopts);
+        });
     }
     for (auto &t : threads) { t.join(); }
 
     return true;
 }
 
+/**
+ * The files --screen sorts the reads into: <prefix>_classified and
+ * <prefix>_unclassified, with _1 / _2 for the two mates of pairs.  The
+ * mapping threads hand over the records of a whole chunk at once, so the
+ * mates stay in step.
+ **/
+class ScreenOutput {
+public:
+    ScreenOutput(const std::string &prefix, bool paired, bool compressed, uint32_t compressionThreads) {
+        for (size_t c = 0; c < 2; ++c) {
+            for (size_t m = 0; m < (paired ? 2 : 1); ++m) {
+                std::string name = prefix + (c ? "_classified" : "_unclassified") +
+                                   (paired ? (m ? "_2" : "_1") : "") + (compressed ? ".fq.gz" : ".fq");
+                files_[c][m].open(name);
+                if (!files_[c][m]) {
+                    openError_ = "Could not open " + name + " for writing";
+                    return;
+                }
+                if (compressed) {
+                    streams_[c][m].reset(new BGZFOStream(files_[c][m].rdbuf(), compressionThreads));
+                } else {
+                    streams_[c][m].reset(new std::ostream(files_[c][m].rdbuf()));
+                }
+            }
+        }
+    }
+
+    // Appends the records of one chunk, indexed by [classified][mate]
+    void write(std::string (&records)[2][2]) {
+        std::lock_guard<MutexT> l(mutex_);
+        for (size_t c = 0; c < 2; ++c) {
+            for (size_t m = 0; m < 2; ++m) {
+                if (streams_[c][m]) { streams_[c][m]->write(records[c][m].data(), records[c][m].size()); }
+                records[c][m].clear();
+            }
+        }
+    }
+
+    void close() {
+        for (auto &c : streams_) { for (auto &m : c) { m.reset(); } }
+        for (auto &c : files_) { for (auto &m : c) { m.close(); } }
+    }
+
+    // why the files could not all be opened, if they couldn't
+    const std::string &openError() const { return openError_; }
+
+private:
+    std::string openError_;
+    std::ofstream files_[2][2];
+    std::unique_ptr<std::ostream> streams_[2][2];
+    MutexT mutex_;
+};
+
+// A read as it came in: FASTQ, or FASTA when the input had no qualities
+inline void appendRecord(const fastx_parser::ReadSeqView &r, std::string &out) {
+    bool fastq = !r.qual.empty();
+    out += fastq ? '@' : '>';
+    out.append(r.name.data(), r.name.size());
+    out += '\n';
+    out.append(r.seq.data(), r.seq.size());
+    if (fastq) {
+        out += "\n+\n";
+        out.append(r.qual.data(), r.qual.size());
+    }
+    out += '\n';
+}
+
+inline void printScreenProgress(HitCounters &hctr, MutexT *iomutex, const pufferfish::AlignmentOpts *mopts) {
+    if (hctr.numReads > hctr.lastPrint + 100000) {
+        hctr.lastPrint.store(hctr.numReads.load());
+        if (!mopts->quiet and iomutex->try_lock()) {
+            std::cerr << "\r\rsaw " << hctr.numReads << " reads : classified "
+                      << hctr.numMapped << ' ';
+            iomutex->unlock();
+        }
+    }
+}
+
+//===========
+// SCREENING
+//============
+template<typename PufferfishIndexT>
+void screenReads(paired_tasks *parser,
+                 PufferfishIndexT &pfi,
+                 MutexT *iomutex,
+                 ScreenOutput *screenOut,
+                 HitCounters &hctr,
+                 pufferfish::AlignmentOpts *mopts) {
+    ReadScreener<PufferfishIndexT> screener(&pfi, mopts);
+    std::string records[2][2];
+    auto rg = parser->getReadGroup();
+    while (parser->refill(rg)) {
+        for (auto &rview : rg) {
+            ++hctr.numReads;
+            bool classified = screener.pairMatches(rview.first.seq, rview.second.seq, hctr);
+            if (screenOut) {
+                appendRecord(rview.first, records[classified][0]);
+                appendRecord(rview.second, records[classified][1]);
+            }
+            printScreenProgress(hctr, iomutex, mopts);
+        }
+        if (screenOut) { screenOut->write(records); }
+    }
+    screener.addWorkspaceStats(hctr);
+}
+
+template<typename PufferfishIndexT>
+void screenReads(single_tasks *parser,
+                 PufferfishIndexT &pfi,
+                 MutexT *iomutex,
+                 ScreenOutput *screenOut,
+                 HitCounters &hctr,
+                 pufferfish::AlignmentOpts *mopts) {
+    ReadScreener<PufferfishIndexT> screener(&pfi, mopts);
+    std::string records[2][2];
+    auto rg = parser->getReadGroup();
+    while (parser->refill(rg)) {
+        for (auto &rview : rg) {
+            ++hctr.numReads;
+            bool classified = screener.readMatches(rview.seq, hctr);
+            if (screenOut) { appendRecord(rview, records[classified][0]); }
+            printScreenProgress(hctr, iomutex, mopts);
+        }
+        if (screenOut) { screenOut->write(records); }
+    }
+    screener.addWorkspaceStats(hctr);
+}
+
+template<typename PufferfishIndexT, typename TasksT>
+bool spawnScreenThreads(
+        uint32_t nthread,
+        TasksT *parser,
+        const MappingPlacement<PufferfishIndexT> &placement,
+        MutexT &iomutex,
+        ScreenOutput *screenOut,
+        HitCounters &hctr,
+        pufferfish::AlignmentOpts *mopts) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nthread; ++i) {
+        threads.emplace_back([&, i]() {
+            placement.pin(i);
+            screenReads<PufferfishIndexT>(parser, placement.indexFor(i), &iomutex, screenOut, hctr, mopts);
+        });
+    }
+    for (auto &t : threads) { t.join(); }
+    return true;
+}
+
+void printScreenSummary(HitCounters &hctrs, std::shared_ptr<spdlog::logger> consoleLog) {
+    consoleLog->info("Done screening reads.");
+    consoleLog->info("\n\n");
+    consoleLog->info("=====");
+    consoleLog->info("Observed {} reads", hctrs.numReads);
+    consoleLog->info("Rate of Fragments with at least one found k-mer: {:03.2f}%",
+                     (100.0 * static_cast<float>(hctrs.numMappedAtLeastAKmer)) / hctrs.numReads);
+    consoleLog->info("Classified reads : {} ({:03.2f}%)", hctrs.numMapped,
+                     (100.0 * static_cast<float>(hctrs.numMapped)) / hctrs.numReads);
+    consoleLog->info("Unclassified reads : {}", hctrs.numReads - hctrs.numMapped);
+    consoleLog->info("Total number of alignment attempts : {}", hctrs.totalAlignmentAttempts);
+    consoleLog->info("Number of candidates not aligned because the read was already classified : {}",
+                     hctrs.screenSkippedCandidates);
+    consoleLog->info("Number of skipped alignments because of perfect chains : {}", hctrs.skippedAlignments_byCov);
+    consoleLog->info("Number of skipped alignments because their score is bounded below the minimum : {}",
+                     hctrs.skippedAlignments_byScoreBound);
+    consoleLog->info("=====");
+}
+
 void printAlignmentSummary(HitCounters &hctrs, std::shared_ptr<spdlog::logger> consoleLog) {
     consoleLog->info("Done mapping reads.");
     consoleLog->info("\n\n");
@@ -892,15 +896,54 @@ void printAlignmentSummary(HitCounters &hctrs, std::shared_ptr<spdlog::logger> c
     consoleLog->info("Max multimapping group : {}", hctrs.maxMultimapping);
     consoleLog->info("Total number of alignment attempts : {}", hctrs.totalAlignmentAttempts);
     consoleLog->info("Number of skipped alignments because of cache hits : {}", hctrs.skippedAlignments_byCache);
+    consoleLog->info("Cross-read alignment cache hits : {}, misses : {}",
+                     hctrs.crossReadCacheHits, hctrs.crossReadCacheMisses);
+    if (hctrs.readCacheHits + hctrs.readCacheMisses > 0) {
+        consoleLog->info("Read pairs answered from the read cache : {} ({:03.2f}%), mapped afresh : {}",
+                         hctrs.readCacheHits,
+                         (100.0 * static_cast<float>(hctrs.readCacheHits)) / (hctrs.readCacheHits + hctrs.readCacheMisses),
+                         hctrs.readCacheMisses);
+    }
     consoleLog->info("Number of skipped alignments because of perfect chains : {}", hctrs.skippedAlignments_byCov);
+    consoleLog->info("Number of skipped alignments because their score is bounded below the minimum : {}",
+                     hctrs.skippedAlignments_byScoreBound);
+    consoleLog->info("Alignments scored in batches : {}, rejected there : {}",
+                     hctrs.batchScoredAlignments, hctrs.batchRejectedAlignments);
 
     consoleLog->info("Number of cigar strings which are fixed: {}", hctrs.cigar_fixed_count);
+    consoleLog->info("MemCluster MEM lists reused : {}, newly allocated : {}",
+                     hctrs.clusterBufferReuses, hctrs.clusterBufferMisses);
+    consoleLog->info("Number of chains replayed from references with identical MEM layouts : {}", hctrs.chainsReplayed);
+    consoleLog->info("ksw2 DP workspace : {} bytes over all threads, grown {} times",
+                     hctrs.ksw2WorkspaceBytes, hctrs.ksw2WorkspaceGrowths);
+    consoleLog->info("=====");
+}
+
+// How the reads flowed from the parsing threads to the mapping threads, and
+// which side held up the other
+void printQueueSummary(const fastx_parser::QueueStats &qs, uint32_t numParsers, uint32_t numMappers,
+                       std::shared_ptr<spdlog::logger> consoleLog) {
+    double mapperWait = qs.elapsedSec > 0 ? 100.0 * qs.consumerWaitSec / (numMappers * qs.elapsedSec) : 0.0;
+    double parserWait = qs.elapsedSec > 0 ? 100.0 * qs.parserWaitSec / (numParsers * qs.elapsedSec) : 0.0;
+    consoleLog->info("Read chunks : {} ({} reads), chunk size between {} and {} reads",
+                     qs.chunks, qs.reads, qs.minChunkSize, qs.maxChunkSize);
+    consoleLog->info("Chunks waiting for a mapping thread : {:03.2f} on average, {} at most",
+                     qs.meanDepth, qs.maxDepth);
+    consoleLog->info("Mapping threads waiting for reads : {:03.2f}% of their time", mapperWait);
+    consoleLog->info("Parsing threads waiting for mapping threads : {:03.2f}% of their time", parserWait);
+    if (mapperWait >= 10.0 and parserWait < 10.0) {
+        consoleLog->info("Parsing the input held up mapping; more --decompressionThreads "
+                         "(or the reads split over more files) should help.");
+    } else if (parserWait >= 10.0) {
+        consoleLog->info("Mapping held up parsing; more --threads should help.");
+    }
     consoleLog->info("=====");
 }
 
 template<typename PufferfishIndexT>
 bool alignReads(
         PufferfishIndexT &pfi,
+        const MappingPlacement<PufferfishIndexT> &placement,
         std::shared_ptr<spdlog::logger> consoleLog,
         pufferfish::AlignmentOpts *mopts) {
 
@@ -909,6 +952,23 @@ bool alignReads(
     std::unique_ptr<std::ostream> outStream{nullptr};
     //bool haveOutputFile{false} ;
     std::shared_ptr<spdlog::logger> outLog{nullptr};
+    // SAM output goes through the ring; declared after outStream so it is stopped first
+    std::unique_ptr<OutputRing> outRing{nullptr};
+    // with --bam, the header id of each reference the records point at
+    BAMRefIds bamRefs;
+    // krakOut / salmon output in the blocked v2 format
+    std::unique_ptr<pam::PAMWriter> pamWriter{nullptr};
+    // with --eqclasses, the classes of all threads
+    std::unique_ptr<EquivalenceClassBuilder> eqBuilder{nullptr};
+    // with --screen, the classified and unclassified reads
+    std::unique_ptr<ScreenOutput> screenOut{nullptr};
+    uint32_t nthread = mopts->numThreads;
+
+    if (mopts->readCacheSize > 0 and (mopts->krakOut or mopts->salmonOut)) {
+        // these write the chains of every read, which the cache does not keep
+        consoleLog->warn("--readCacheSize is ignored with --krakOut and --pam");
+        mopts->readCacheSize = 0;
+    }
 
     phmap::flat_hash_set<std::string> gene_names;
     if (mopts->filterGenomics or mopts->filterMicrobiomBestScore) {
@@ -947,52 +1007,88 @@ bool alignReads(
     }
 
 
-    if (!mopts->noOutput) {
+    if (!mopts->noOutput and mopts->screen) {
+        // -o is the prefix of the read files here
+        uint32_t compressionThreads = mopts->compressionThreads > 0 ?
+                                      mopts->compressionThreads : std::max(nthread / 4, 1u);
+        screenOut.reset(new ScreenOutput(mopts->outname, !mopts->singleEnd, mopts->compressedOutput,
+                                         compressionThreads));
+        if (!screenOut->openError().empty()) {
+            consoleLog->error(screenOut->openError());
+            return false;
+        }
+    } else if (!mopts->noOutput) {
         if (mopts->outname == "-") {
             outBuf = std::cout.rdbuf();
         } else {
             outFile.open(mopts->outname);
+            if (!outFile) {
+                consoleLog->error("Could not open {} for writing", mopts->outname);
+                return false;
+            }
             outBuf = outFile.rdbuf();
             //haveOutputFile = true ;
         }
 
         // out stream to the buffer
         // it can be std::cerr or a file
-        if (mopts->compressedOutput) {
-            outStream.reset(new zstr::ostream(outBuf));
+        // compressed output is BGZF: blocks are deflated in parallel and written in order,
+        // and the result is still a plain .gz file. BAM is always compressed this way.
+        bool pamV2 = mopts->pamV2 and (mopts->krakOut or mopts->salmonOut);
+        if (pamV2 and mopts->compressedOutput) {
+            // the block index holds file offsets, and the blocks are compressed already
+            consoleLog->warn("--compressedOutput is ignored with --pamV2");
+        }
+        if (mopts->bamOutput or (mopts->compressedOutput and !pamV2)) {
+            uint32_t compressionThreads = mopts->compressionThreads > 0 ?
+                                          mopts->compressionThreads : std::max(nthread / 4, 1u);
+            outStream.reset(new BGZFOStream(outBuf, compressionThreads));
         } else {
             outStream.reset(new std::ostream(outBuf));
         }
-        // the async queue size must be a power of 2
-        size_t queueSize{268435456};
-        spdlog::set_async_mode(queueSize);
-
-        if (mopts->krakOut || mopts->salmonOut) {
+        if (mopts->eqClassOutput) {
+            // nothing is written until all reads are mapped
+            eqBuilder.reset(new EquivalenceClassBuilder());
+        } else if (pamV2) {
+            pamWriter.reset(new pam::PAMWriter(*outStream, !mopts->singleEnd, mopts->krakOut,
+                                               pfi.getFullRefNames(), pfi.getFullRefLengths()));
+        } else if (mopts->krakOut || mopts->salmonOut) {
+            // the async queue size must be a power of 2
+            size_t queueSize{268435456};
+            spdlog::set_async_mode(queueSize);
             auto outputSink = std::make_shared<ostream_bin_sink_mt>(*outStream);
             outLog = std::make_shared<spdlog::logger>("puffer::outLog", outputSink);
             outLog->set_pattern("");
-        } else {
-            auto outputSink = std::make_shared<spdlog::sinks::ostream_sink_mt>(*outStream);
-            outLog = std::make_shared<spdlog::logger>("puffer::outLog", outputSink);
-            outLog->set_pattern("%v");
-        }
-        // write the SAM Header
-        // If nothing gets printed by this time we are in trouble
-        if (mopts->krakOut || mopts->salmonOut) {
             writeKrakOutHeader(pfi, outLog, mopts);
         } else { //TODO do we need to remove the txp from the list? The ids are then invalid
-            writeSAMHeader(pfi, outLog,
-                    mopts->filterGenomics or mopts->filterMicrobiom or mopts->filterMicrobiomBestScore,
-                    gene_names,
-                    rrna_names);
+            // write the SAM header before any worker (or the ring's writer) runs
+            fmt::MemoryWriter hd;
+            bool filterRefs = mopts->filterGenomics or mopts->filterMicrobiom or mopts->filterMicrobiomBestScore;
+            if (mopts->bamOutput) {
+                encodeBAMHeader(pfi, hd, filterRefs, gene_names, rrna_names, bamRefs);
+            } else {
+                formatSAMHeader(pfi, hd, filterRefs, gene_names, rrna_names);
+            }
+            outStream->write(hd.data(), hd.size());
+            // keep the BAM header in blocks of its own, as htslib does
+            if (mopts->bamOutput) { outStream->flush(); }
+            // two buffers per worker: one being filled while the other waits for the writer
+            outRing.reset(new OutputRing(*outStream, 2 * static_cast<size_t>(nthread), mopts->orderedOutput));
         }
     }
 
-    uint32_t nthread = mopts->numThreads;
+    // gzip input is inflated off the parsing threads; BGZF input on several threads per file
+    uint32_t decompressionThreads = mopts->decompressionThreads > 0 ?
+                                    mopts->decompressionThreads : std::max(nthread / 8, 1u);
+
     std::unique_ptr<paired_parser> pairParserPtr{nullptr};
     std::unique_ptr<single_parser> singleParserPtr{nullptr};
 
-    size_t chunkSize{10000};
+    // chunks start small so that every mapping thread gets reads early, then
+    // follow the mapping speed, up to the former fixed size of 10000 reads
+    size_t chunkSize{1000};
+    size_t minChunkSize{100};
+    size_t maxChunkSize{10000};
     MutexT iomutex;
 
     if (!mopts->singleEnd) {
@@ -1008,39 +1104,76 @@ bool alignReads(
             std::exit(1);
         }
 
-        uint32_t nprod = (read1Vec.size() > 1) ? 2 : 1;
+        // with ordered output, a single parser keeps the chunks in input order
+        uint32_t nprod = (read1Vec.size() > 1 and !mopts->orderedOutput) ? 2 : 1;
         pairParserPtr.reset(new paired_parser(read1Vec, read2Vec, nthread, nprod, chunkSize));
+        pairParserPtr->setDecompressionThreads(decompressionThreads);
+        pairParserPtr->setChunkSizeRange(minChunkSize, maxChunkSize);
         pairParserPtr->start();
-        spawnProcessReadsThreads(nthread, pairParserPtr.get(), pfi, iomutex,
-                                 outLog, hctrs, gene_names, rrna_names, mopts);
-        pairParserPtr->stop();
+        paired_tasks tasks(pairParserPtr.get(), nthread);
+        if (mopts->screen) {
+            spawnScreenThreads(nthread, &tasks, placement, iomutex, screenOut.get(), hctrs, mopts);
+        } else {
+            spawnProcessReadsThreads(nthread, &tasks, placement, iomutex,
+                                     outLog, outRing.get(), mopts->bamOutput ? &bamRefs : nullptr, pamWriter.get(), eqBuilder.get(), hctrs, gene_names, rrna_names, mopts);
+        }
+        try {
+            pairParserPtr->stop();
+        } catch (const std::exception& e) {
+            consoleLog->error("{}", e.what());
+            if (outRing) { outRing->stop(); }
+            return false;
+        }
         consoleLog->info("flushing output queue.");
-        printAlignmentSummary(hctrs, consoleLog);
+        if (mopts->screen) { printScreenSummary(hctrs, consoleLog); } else { printAlignmentSummary(hctrs, consoleLog); }
+        printQueueSummary(pairParserPtr->stats(), nprod, nthread, consoleLog);
         if (outLog) { outLog->flush(); }
+        if (pamWriter) { pamWriter->close(); }
+        if (eqBuilder) { writeEquivalenceClasses(pfi, *eqBuilder, *outStream); }
+        if (outRing) { outRing->stop(); }
     } else {
         ScopedTimer timer(!mopts->quiet);
         HitCounters hctrs;
         consoleLog->info("mapping reads ... \n\n\n");
         std::vector<std::string> readVec = pufferfish::util::tokenize(mopts->unmatedReads, ',');
 
-        uint32_t nprod = (readVec.size() > 1) ? 2 : 1;
+        uint32_t nprod = (readVec.size() > 1 and !mopts->orderedOutput) ? 2 : 1;
         singleParserPtr.reset(new single_parser(readVec, nthread, nprod, chunkSize));
+        singleParserPtr->setDecompressionThreads(decompressionThreads);
+        singleParserPtr->setChunkSizeRange(minChunkSize, maxChunkSize);
         singleParserPtr->start();
+        single_tasks tasks(singleParserPtr.get(), nthread);
 
-        spawnProcessReadsThreads(nthread, singleParserPtr.get(), pfi, iomutex,
-                                 outLog, hctrs, gene_names, mopts);
+        if (mopts->screen) {
+            spawnScreenThreads(nthread, &tasks, placement, iomutex, screenOut.get(), hctrs, mopts);
+        } else {
+            spawnProcessReadsThreads(nthread, &tasks, placement, iomutex,
+                                     outLog, outRing.get(), mopts->bamOutput ? &bamRefs : nullptr, pamWriter.get(), eqBuilder.get(), hctrs, gene_names, mopts);
+        }
 
-        singleParserPtr->stop();
+        try {
+            singleParserPtr->stop();
+        } catch (const std::exception& e) {
+            consoleLog->error("{}", e.what());
+            if (outRing) { outRing->stop(); }
+            return false;
+        }
         consoleLog->info("flushing output queue.");
-        printAlignmentSummary(hctrs, consoleLog);
+        if (mopts->screen) { printScreenSummary(hctrs, consoleLog); } else { printAlignmentSummary(hctrs, consoleLog); }
+        printQueueSummary(singleParserPtr->stats(), nprod, nthread, consoleLog);
         if (outLog) { outLog->flush(); }
+        if (pamWriter) { pamWriter->close(); }
+        if (eqBuilder) { writeEquivalenceClasses(pfi, *eqBuilder, *outStream); }
+        if (outRing) { outRing->stop(); }
     }
+    if (screenOut) { screenOut->close(); }
     return true;
 }
 
 template<typename PufferfishIndexT>
 bool alignReadsWrapper(
         PufferfishIndexT &pfi,
+        const MappingPlacement<PufferfishIndexT> &placement,
         std::shared_ptr<spdlog::logger> consoleLog,
         pufferfish::AlignmentOpts *mopts) {
     bool res = true;
@@ -1053,7 +1186,7 @@ bool alignReadsWrapper(
                 uint64_t start = mopts->unmatedReads.find_last_of('/');
                 uint64_t end = mopts->unmatedReads.find_last_of('.');
                 mopts->outname += mopts->unmatedReads.substr(start + 1, end - start - 1);
-                res &= alignReads(pfi, consoleLog, mopts);
+                res &= alignReads(pfi, placement, consoleLog, mopts);
             }
         } else {
             std::string readFile1 = mopts->read1;
@@ -1070,37 +1203,92 @@ bool alignReadsWrapper(
 //                std::cerr << mopts->read1 << "\n";
 //                std::cerr << mopts->read2 << "\n";
 //                std::cerr << mopts->outname << "\n";
-                res &= alignReads(pfi, consoleLog, mopts);
+                res &= alignReads(pfi, placement, consoleLog, mopts);
             }
         }
-    } else res &= alignReads(pfi, consoleLog, mopts);
+    } else res &= alignReads(pfi, placement, consoleLog, mopts);
     return res;
 }
 
+template<typename PufferfishIndexT>
+struct LoadedIndex {
+    std::vector<std::unique_ptr<PufferfishIndexT>> copies;
+    MappingPlacement<PufferfishIndexT> placement;
+};
+
+/**
+ * Load the index.  With --numaInterleave the index pages are spread over all
+ * NUMA nodes; with --numaReplicate each node gets its own copy, placed in its
+ * memory, and the mapping threads use the copy of the node they are pinned
+ * to.  On a single-node machine both come down to one copy and pinned threads.
+ **/
+template<typename PufferfishIndexT>
+void loadIndex(const std::string &indexDir,
+               std::shared_ptr<spdlog::logger> consoleLog,
+               const pufferfish::AlignmentOpts *mopts,
+               LoadedIndex<PufferfishIndexT> &loaded) {
+    namespace numa = pufferfish::numa;
+    bool useNUMA = mopts->numaInterleave or mopts->numaReplicate;
+    auto &placement = loaded.placement;
+    if (useNUMA) {
+        placement.topology = numa::Topology::detect();
+        consoleLog->info("NUMA nodes to map on : {}", placement.topology.numNodes());
+    }
+
+    pufferfish::util::IndexLoadingOpts loadingOpts;
+    loadingOpts.huge_pages = mopts->hugePages;
+    auto &copies = loaded.copies;
+    size_t numCopies = mopts->numaReplicate ? placement.topology.numNodes() : 1;
+    for (size_t n = 0; n < numCopies; ++n) {
+        bool placed{true};
+        if (mopts->numaReplicate) {
+            placed = numa::preferNode(placement.topology.nodeIds[n]);
+        } else if (mopts->numaInterleave) {
+            placed = numa::interleaveAllocations(placement.topology);
+        }
+        if (!placed) {
+            consoleLog->warn("Could not set the NUMA memory policy ({}); the index goes wherever it is first touched",
+                             std::strerror(errno));
+        }
+        copies.emplace_back(new PufferfishIndexT(indexDir, loadingOpts));
+        if (useNUMA) { numa::resetAllocations(); }
+        placement.nodeIndex.push_back(copies.back().get());
+    }
+}
+
+template<typename PufferfishIndexT>
+bool loadIndexAndAlign(const std::string &indexDir,
+                       std::shared_ptr<spdlog::logger> consoleLog,
+                       pufferfish::AlignmentOpts *mopts) {
+    LoadedIndex<PufferfishIndexT> loaded;
+    loadIndex(indexDir, consoleLog, mopts, loaded);
+    return alignReadsWrapper(*loaded.copies.front(), loaded.placement, consoleLog, mopts);
+}
+
+std::string readIndexType(const std::string &indexDir) {
+    std::string indexType;
+    std::ifstream infoStream(indexDir + "/info.json");
+    cereal::JSONInputArchive infoArchive(infoStream);
+    infoArchive(cereal::make_nvp("sampling_type", indexType));
+    std::cerr << "Index type = " << indexType << "\n";
+    infoStream.close();
+    return indexType;
+}
+
 int pufferfishAligner(pufferfish::AlignmentOpts &alnargs) {
 
     auto consoleLog = spdlog::stderr_color_mt("console");
     bool success{false};
     auto indexDir = alnargs.indexDir;
 
-    std::string indexType;
-    {
-        std::ifstream infoStream(indexDir + "/info.json");
-        cereal::JSONInputArchive infoArchive(infoStream);
-        infoArchive(cereal::make_nvp("sampling_type", indexType));
-        std::cerr << "Index type = " << indexType << "\n";
-        infoStream.close();
-    }
+    std::string indexType = readIndexType(indexDir);
 
     if (indexType == "dense") {
-        PufferfishIndex pfi(indexDir);
-        success = alignReadsWrapper(pfi, consoleLog, &alnargs);
+        success = loadIndexAndAlign<PufferfishIndex>(indexDir, consoleLog, &alnargs);
     } else if (indexType == "sparse") {
-        PufferfishSparseIndex pfi(indexDir);
-        success = alignReadsWrapper(pfi, consoleLog, &alnargs);
+        success = loadIndexAndAlign<PufferfishSparseIndex>(indexDir, consoleLog, &alnargs);
     } else if (indexType == "lossy") {
-        PufferfishLossyIndex pfi(indexDir);
-        success = alignReadsWrapper(pfi, consoleLog, &alnargs);
+        success = loadIndexAndAlign<PufferfishLossyIndex>(indexDir, consoleLog, &alnargs);
     }
 
     if (!success) {
@@ -1108,3 +1296,169 @@ int pufferfishAligner(pufferfish::AlignmentOpts &alnargs) {
     }
     return 0;
 }
+
+namespace {
+// the socket `pufferfish serve` removes when it is stopped
+char servedSocketPath[sizeof(sockaddr_un::sun_path)];
+
+void stopServing(int) {
+    unlink(servedSocketPath);
+    _exit(0);
+}
+
+std::string absolutePath(const std::string &path, const std::string &cwd) {
+    if (path.empty() or path[0] == '/') { return path; }
+    return cwd + "/" + path;
+}
+
+std::string canonicalPath(const std::string &path) {
+    std::unique_ptr<char, decltype(&std::free)> resolved(realpath(path.c_str(), nullptr), &std::free);
+    return resolved ? std::string(resolved.get()) : path;
+}
+
+// whether the server may write the (absolute) path: the file if it is there, else its directory
+bool canWrite(const std::string &path) {
+    if (access(path.c_str(), F_OK) == 0) { return access(path.c_str(), W_OK) == 0; }
+    std::string dir = path.substr(0, path.find_last_of('/'));
+    return access(dir.empty() ? "/" : dir.c_str(), W_OK | X_OK) == 0;
+}
+
+/**
+ * Makes the options of a job runnable by the server: relative paths are taken
+ * relative to the client's working directory, and the job runs on the
+ * server's threads and index.  Since the mapping code gives up on the whole
+ * process when an input is missing, inputs (and where the output goes) are
+ * checked here, so that a bad job fails on its own.  Returns what is wrong
+ * with the job, if anything.
+ **/
+std::string prepareJob(pufferfish::AlignmentOpts &jopts, const std::string &cwd,
+                       const std::string &servedIndex, const pufferfish::AlignmentOpts &serverOpts) {
+    if (canonicalPath(absolutePath(jopts.indexDir, cwd)) != servedIndex) {
+        return "this server holds the index " + servedIndex + ", not " + jopts.indexDir;
+    }
+    if (!jopts.noOutput and jopts.outname == "-") {
+        return "the server can't write to the client's standard output; give an output file with -o";
+    }
+    if (jopts.listOfReads) {
+        return "--batchOfReads is not supported by the server; send one job per sample";
+    }
+    if (!jopts.singleEnd and pufferfish::util::tokenize(jopts.read1, ',').size() !=
+                             pufferfish::util::tokenize(jopts.read2, ',').size()) {
+        return "the number of files given with -1 and -2 differ";
+    }
+    auto absoluteList = [&cwd](const std::string &files) {
+        std::string res;
+        for (auto &f : pufferfish::util::tokenize(files, ',')) {
+            res += (res.empty() ? "" : ",") + absolutePath(f, cwd);
+        }
+        return res;
+    };
+    jopts.read1 = absoluteList(jopts.read1);
+    jopts.read2 = absoluteList(jopts.read2);
+    jopts.unmatedReads = absoluteList(jopts.unmatedReads);
+    jopts.outname = absolutePath(jopts.outname, cwd);
+    jopts.genesNamesFile = absolutePath(jopts.genesNamesFile, cwd);
+    jopts.rrnaFile = absolutePath(jopts.rrnaFile, cwd);
+
+    std::vector<std::string> inputs;
+    for (auto *files : {&jopts.read1, &jopts.read2, &jopts.unmatedReads}) {
+        auto v = pufferfish::util::tokenize(*files, ',');
+        inputs.insert(inputs.end(), v.begin(), v.end());
+    }
+    if (jopts.filterGenomics or jopts.filterMicrobiomBestScore) { inputs.push_back(jopts.genesNamesFile); }
+    if (jopts.filterMicrobiom) { inputs.push_back(jopts.rrnaFile); }
+    for (auto &f : inputs) {
+        if (!f.empty() and access(f.c_str(), R_OK) != 0) {
+            return "can't read " + f + ": " + std::strerror(errno);
+        }
+    }
+    // with --screen, -o is the prefix of the files the reads are sorted into
+    if (!jopts.noOutput and !canWrite(jopts.screen ? jopts.outname + "_classified" : jopts.outname)) {
+        return "can't write " + jopts.outname + ": " + std::strerror(errno);
+    }
+
+    jopts.numThreads = serverOpts.numThreads;
+    jopts.indexDir = serverOpts.indexDir;
+    return "";
+}
+} // namespace
+
+template<typename PufferfishIndexT>
+int serveJobs(const pufferfish::ServeOptions &sopts, const pufferfish::AlignmentOpts &serverOpts,
+              const std::function<bool(const std::vector<std::string>&, pufferfish::AlignmentOpts&, std::string&)> &parseJob,
+              std::shared_ptr<spdlog::logger> consoleLog) {
+    namespace server = pufferfish::server;
+    LoadedIndex<PufferfishIndexT> loaded;
+    loadIndex(sopts.indexDir, consoleLog, &serverOpts, loaded);
+    std::string servedIndex = canonicalPath(sopts.indexDir);
+
+    std::string err;
+    int listenFd = server::listenOn(sopts.socketPath, err);
+    if (listenFd < 0) {
+        consoleLog->error("Could not listen on {}: {}", sopts.socketPath, err);
+        return 1;
+    }
+    std::strncpy(servedSocketPath, sopts.socketPath.c_str(), sizeof(servedSocketPath) - 1);
+    std::signal(SIGINT, stopServing);
+    std::signal(SIGTERM, stopServing);
+    consoleLog->info("Serving {} on {} with {} mapping threads", servedIndex, sopts.socketPath, sopts.numThreads);
+
+    // one job at a time, on all the mapping threads; clients that come in the
+    // meantime wait in the socket's backlog
+    for (uint64_t jobId = 1; ; ++jobId) {
+        server::Job job;
+        if (!server::acceptJob(listenFd, job, err)) {
+            consoleLog->warn("Dropped a connection: {}", err);
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::ostringstream jobOut;
+        auto jobLog = std::make_shared<spdlog::logger>("job",
+                                                       std::make_shared<spdlog::sinks::ostream_sink_mt>(jobOut));
+        pufferfish::AlignmentOpts jopts;
+        int status{1};
+        std::string problem;
+        if (!parseJob(job.args, jopts, problem)) {
+            problem = "invalid align arguments: " + problem;
+        } else {
+            problem = prepareJob(jopts, job.cwd, servedIndex, serverOpts);
+        }
+        if (problem.empty()) {
+            status = alignReadsWrapper(*loaded.copies.front(), loaded.placement, jobLog, &jopts) ? 0 : 1;
+        } else {
+            jobLog->error(problem);
+        }
+        jobLog->flush();
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        consoleLog->info("job {} -> {} : {} in {:.1f}s", jobId,
+                         jopts.noOutput ? std::string("(no output)") : jopts.outname,
+                         problem.empty() ? "mapped" : problem, took.count());
+        if (!server::finishJob(job, status, jobOut.str())) {
+            consoleLog->warn("job {}: the client left before the job was done", jobId);
+        }
+    }
+    return 0;
+}
+
+int pufferfishServe(pufferfish::ServeOptions &serveOpts,
+                    const std::function<bool(const std::vector<std::string>&, pufferfish::AlignmentOpts&, std::string&)> &parseJob) {
+    auto consoleLog = spdlog::stderr_color_mt("console");
+    // what loading the index needs to know
+    pufferfish::AlignmentOpts serverOpts;
+    serverOpts.indexDir = serveOpts.indexDir;
+    serverOpts.numThreads = serveOpts.numThreads;
+    serverOpts.numaInterleave = serveOpts.numaInterleave;
+    serverOpts.numaReplicate = serveOpts.numaReplicate;
+    serverOpts.hugePages = serveOpts.hugePages;
+
+    std::string indexType = readIndexType(serveOpts.indexDir);
+    if (indexType == "dense") {
+        return serveJobs<PufferfishIndex>(serveOpts, serverOpts, parseJob, consoleLog);
+    } else if (indexType == "sparse") {
+        return serveJobs<PufferfishSparseIndex>(serveOpts, serverOpts, parseJob, consoleLog);
+    } else if (indexType == "lossy") {
+        return serveJobs<PufferfishLossyIndex>(serveOpts, serverOpts, parseJob, consoleLog);
+    }
+    consoleLog->error("Unknown index type {}", indexType);
+    return 1;
+}
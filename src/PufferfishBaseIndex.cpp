@@ -2,6 +2,7 @@
 #include "PufferfishIndex.hpp"
 #include "PufferfishSparseIndex.hpp"
 #include "PufferfishLossyIndex.hpp"
+#include "HugePages.hpp"
 
 // from : https://www.fluentcpp.com/2017/05/19/crtp-helper/
 template <typename T>
@@ -9,6 +10,13 @@ T& PufferfishBaseIndex<T>::underlying() { return static_cast<T&>(*this); }
 template <typename T>
 T const& PufferfishBaseIndex<T>::underlying() const { return static_cast<T const&>(*this); }
 
+template <typename T>
+void PufferfishBaseIndex<T>::adviseHugePages() {
+  pufferfish::hugepages::Advisor advisor;
+  underlying().listLookupArrays(advisor);
+  if (auto console = spdlog::get("console")) { console->info("{}", advisor.describe()); }
+}
+
 //template <typename T>
 //PufferfishBaseIndex<T>::PufferfishBaseIndex() {}
 //PufferfishBaseIndex::PufferfishBaseIndex(const std::string& indexDir) {}
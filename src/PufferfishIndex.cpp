@@ -4,6 +4,7 @@
 #include <stdlib.h> 
 
 #include "CLI/Timer.hpp"
+#include "HugePages.hpp"
 #include "CanonicalKmerIterator.hpp"
 #include "PufferFS.hpp"
 #include "PufferfishIndex.hpp"
@@ -150,6 +151,19 @@ PufferfishIndex::PufferfishIndex(const std::string& indexDir, pufferfish::util::
     std::string pfile = indexDir + "/" + pufferfish::util::EDGE;
     edge_.deserialize(pfile, false);
   }
+
+  if (opts.huge_pages) { adviseHugePages(); }
+}
+
+void PufferfishIndex::listLookupArrays(pufferfish::hugepages::Advisor& advisor) const {
+  advisor.adviseBuffers(*hash_);
+  advisor.advise(contigBoundary_);
+  advisor.adviseBuffers(rankSelDict);
+  advisor.advise(contigOffsets_);
+  advisor.advise(contigTable_);
+  advisor.advise(seq_);
+  advisor.advise(pos_);
+  advisor.advise(refseq_);
 }
 
 /**
@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "CLI/Timer.hpp"
+#include "HugePages.hpp"
 #include "CanonicalKmerIterator.hpp"
 #include "PufferFS.hpp"
 #include "PufferfishLossyIndex.hpp"
@@ -143,6 +144,20 @@ PufferfishLossyIndex::PufferfishLossyIndex(const std::string& indexDir, pufferfi
     }
   }
 
+  if (opts.huge_pages) { adviseHugePages(); }
+}
+
+void PufferfishLossyIndex::listLookupArrays(pufferfish::hugepages::Advisor& advisor) const {
+  advisor.adviseBuffers(*hash_);
+  advisor.advise(contigBoundary_);
+  advisor.adviseBuffers(rankSelDict);
+  advisor.advise(contigOffsets_);
+  advisor.advise(contigTable_);
+  advisor.advise(seq_);
+  advisor.advise(presenceVec_);
+  advisor.adviseBuffers(presenceRank_);
+  advisor.advise(sampledPos_);
+  advisor.advise(refseq_);
 }
 
 /**
@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "CLI/Timer.hpp"
+#include "HugePages.hpp"
 #include "cereal/archives/binary.hpp"
 #include "cereal/archives/json.hpp"
 
@@ -179,6 +180,25 @@ PufferfishSparseIndex::PufferfishSparseIndex(const std::string& indexDir, puffer
     std::string pfile = indexDir + "/" + pufferfish::util::DIRECTION;
     directionVec_.deserialize(pfile,false);
   }
+
+  if (opts.huge_pages) { adviseHugePages(); }
+}
+
+void PufferfishSparseIndex::listLookupArrays(pufferfish::hugepages::Advisor& advisor) const {
+  advisor.adviseBuffers(*hash_);
+  advisor.advise(contigBoundary_);
+  advisor.adviseBuffers(rankSelDict);
+  advisor.advise(contigOffsets_);
+  advisor.advise(contigTable_);
+  advisor.advise(seq_);
+  advisor.advise(presenceVec_);
+  advisor.adviseBuffers(presenceRank_);
+  advisor.advise(canonicalNess_);
+  advisor.advise(sampledPos_);
+  advisor.advise(auxInfo_);
+  advisor.advise(extSize_);
+  advisor.advise(directionVec_);
+  advisor.advise(refseq_);
 }
 
 auto PufferfishSparseIndex::getRefPosHelper_(CanonicalKmer& mer, uint64_t pos,
@@ -1,5 +1,8 @@
 #include "Util.hpp"
 
+#include <algorithm>
+#include <limits>
+
 #define ALLOW_VERBOSE 0
 
 namespace pufferfish {
@@ -58,46 +61,21 @@ pufferfish::util::MergeResult joinReadsAndFilter(
     std::cerr << "\n[JOINREADSANDFILTER]\n";
 #endif // ALLOW_VERBOSE
 
-    // If we will allow orphans in the output, then we compute here the
-    // maximum coverage of any optimal chain for the left and right read.
-    // Later, we will report orphans, in addition to concordant alignments,
-    // if they have sufficiently high coverage with respect to the maximum.
+    // Maximum coverage of any optimal chain for the left and right read.  If we
+    // allow orphans in the output, we will report them, in addition to concordant
+    // alignments, if they have sufficiently high coverage with respect to this
+    // maximum.  These are gathered during the concordant sweep below.
     uint64_t maxLeft{0}, maxRight{0}, maxLeftCnt{0}, maxRightCnt{0};
-    bool isMaxLeftAndRight = false;
-    if (!noOrphans) {
-        for (auto &kv : leftMemClusters) {
-#if ALLOW_VERBOSE
-          std::cerr << "\ntid:" << kv.first << "\n"; 
-#endif // ALLOW_VERBOSE
-            auto &lClusts = *(kv.second);
-            for (auto clust = lClusts.begin(); clust != lClusts.end(); clust++) {
-                if (maxLeft == clust->coverage) {
-                    maxLeftCnt += 1;
-                } else if (maxLeft < clust->coverage) {
-                    maxLeft = clust->coverage;
-                    maxLeftCnt = 1;
-                }
-            }
-        } // leftMemClusters
-        for (auto &kv : rightMemClusters) {
-#if ALLOW_VERBOSE
-          std::cerr << "\ntid:" << kv.first << "\n"; 
-#endif // ALLOW_VERBOSE
-          auto &rClusts = *(kv.second);
-          for (auto clust = rClusts.begin(); clust != rClusts.end(); clust++) {
-            if (maxRight == clust->coverage) {
-              maxRightCnt += 1;
-            } else if (maxRight < clust->coverage) {
-              maxRight = clust->coverage;
-              maxRightCnt = 1;
-            }
-          }
-        } // rightMemClusters
-    } // !noOrphans
-
-
-    // The maximum coverage of a mem cluster for the left or right read
-    auto maxLeftOrRight = maxLeft > maxRight ? maxLeft : maxRight;
+    auto updateMax = [](std::vector<pufferfish::util::MemCluster>& clusts, uint64_t& maxCov, uint64_t& maxCnt) {
+      for (auto& clust : clusts) {
+        if (maxCov == clust.coverage) {
+          maxCnt += 1;
+        } else if (maxCov < clust.coverage) {
+          maxCov = clust.coverage;
+          maxCnt = 1;
+        }
+      }
+    };
 
     //orphan reads should be taken care of maybe with a flag!
     uint32_t maxCoverage{0};
@@ -106,87 +84,169 @@ pufferfish::util::MergeResult joinReadsAndFilter(
     int32_t numConcordant{0};
     int32_t numDiscordant{0};
     bool hadDovetail{false};
-    //phmap::parallel_hash_set<uint32_t> refsWithJointMems;
-    while (round == 0 or (round == 1 and !jointMemsList.size() and !noDiscordant)) {
-      bool concordantSearch = (round == 0);
-      for (auto &leftClustItr : leftMemClusters) {
-            // reference id
-            size_t tid = leftClustItr.first;
-            // left mem clusters
-            auto &lClusts = *(leftClustItr.second);
-            // right mem clusters for the same reference id
-            auto &rClusts = rightMemClusters[tid];
-	
-	    // if we are allowing orphans, then don't 
-	    // report orphans to any reference that had joint mem hits
-	    // regardless of whether they are concordant or discordant.
-            /*
-	    if (!noOrphans and !rClusts.empty()) { 
-		refsWithJointMems.insert(tid);
-	    }
-            */
-
-            // Compare the left clusters to the right clusters to filter by positional constraints
-            for (auto lclust = lClusts.begin(); lclust != lClusts.end(); lclust++) {
-
-                for (auto rclust = rClusts.begin(); rclust != rClusts.end(); rclust++) {
-                    // if both the left and right clusters are oriented in the same direction, skip this pair
-                    // NOTE: This should be optional as some libraries could allow this.
-	            bool satisfiesOri = lclust->isFw != rclust->isFw;
-                    if (concordantSearch and !satisfiesOri) { // if priority 0, ends should be concordant
-                        continue;
-                    }
-		    
-		    bool isDovetail{false};
-		    if (satisfiesOri) {
-          isDovetail = lclust->isFw ? (lclust->approxReadStartPos() > rclust->approxReadStartPos()) :
-			             (rclust->approxReadStartPos() > lclust->approxReadStartPos());
-          if (isDovetail and (static_cast<uint64_t>(tid) < firstDecoyIndex)) { hadDovetail = true; }
-		    }
-		    // if noDovetail is set, then dovetail mappings are considered discordant
-                    // otherwise we consider then concordant.
-		    if (isDovetail and noDovetail and concordantSearch) {
-			continue;
-		    }
-
-                    // FILTER 1
-                    // filter read pairs based on the fragment length which is approximated by the distance between the left most start and right most hit end
-                    int32_t fragmentLen = rclust->lastRefPos() + rclust->lastMemLen() - lclust->firstRefPos();
-                    if (lclust->firstRefPos() > rclust->firstRefPos()) {
-                        fragmentLen = lclust->lastRefPos() + lclust->lastMemLen() - rclust->firstRefPos();
-                    }
-                    if (fragmentLen < 0) { // @fatemeh : should we even be checking for this?
-                        std::cerr << "Fragment length cannot be smaller than zero!\n";
-                        exit(1);
-                    }
+    // coverage of the ends of the first pair that attained maxCoverage
+    bool hadBestPair{false};
+    double bestPairLeftCov{0}, bestPairRightCov{0};
+
+    using ClustIt = std::vector<pufferfish::util::MemCluster>::iterator;
+    auto tryPair = [&](size_t tid, ClustIt lclust, ClustIt rclust, bool concordantSearch) {
+      // if both the left and right clusters are oriented in the same direction, skip this pair
+      // NOTE: This should be optional as some libraries could allow this.
+      bool satisfiesOri = lclust->isFw != rclust->isFw;
+      if (concordantSearch and !satisfiesOri) { // if priority 0, ends should be concordant
+        return;
+      }
 
-                    // FILTERING fragments with size smaller than maxFragmentLength
-                    // FILTER just in case of priority 0 (round 0)
-                    if ((fragmentLen < maxFragmentLength) or (round > 0)) {
-                        // This will add a new potential mapping. Coverage of a mapping for read pairs is left->coverage + right->coverage
-                        // If we found a perfect coverage, we would only add those mappings that have the same perfect coverage
-                        auto totalCoverage = lclust->coverage + rclust->coverage;
-                        if ( (totalCoverage >= coverageRatio * maxCoverage) or
-                              (totalCoverage == perfectCoverage) ) {
-                            ++sameTxpCount;
-			    numConcordant += concordantSearch ? 1 : 0;
-                            jointMemsList.emplace_back(tid, lclust, rclust, fragmentLen);
-                            uint32_t currCoverage = jointMemsList.back().coverage();
-                            if (maxCoverage < currCoverage) {
-                                maxCoverage = currCoverage;
-                                if ( (lclust->coverage < maxLeft) or (rclust->coverage < maxRight)) {
-                                    isMaxLeftAndRight = false;
-                                } else {
-                                    isMaxLeftAndRight = true;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        } // @fatemeh : this nesting just seems too many levels deep.  Can we re-work the logic here to make things simpler?
-        round++;
+      bool isDovetail{false};
+      if (satisfiesOri) {
+        isDovetail = lclust->isFw ? (lclust->approxReadStartPos() > rclust->approxReadStartPos()) :
+          (rclust->approxReadStartPos() > lclust->approxReadStartPos());
+        if (isDovetail and (static_cast<uint64_t>(tid) < firstDecoyIndex)) { hadDovetail = true; }
+      }
+      // if noDovetail is set, then dovetail mappings are considered discordant
+      // otherwise we consider then concordant.
+      if (isDovetail and noDovetail and concordantSearch) {
+        return;
+      }
+
+      // FILTER 1
+      // filter read pairs based on the fragment length which is approximated by the distance between the left most start and right most hit end
+      int32_t fragmentLen = rclust->lastRefPos() + rclust->lastMemLen() - lclust->firstRefPos();
+      if (lclust->firstRefPos() > rclust->firstRefPos()) {
+        fragmentLen = lclust->lastRefPos() + lclust->lastMemLen() - rclust->firstRefPos();
+      }
+      if (fragmentLen < 0) { // @fatemeh : should we even be checking for this?
+        std::cerr << "Fragment length cannot be smaller than zero!\n";
+        exit(1);
+      }
+
+      // FILTERING fragments with size smaller than maxFragmentLength
+      // FILTER just in case of priority 0 (round 0)
+      if ((fragmentLen < maxFragmentLength) or !concordantSearch) {
+        // This will add a new potential mapping. Coverage of a mapping for read pairs is left->coverage + right->coverage
+        // If we found a perfect coverage, we would only add those mappings that have the same perfect coverage
+        auto totalCoverage = lclust->coverage + rclust->coverage;
+        if ( (totalCoverage >= coverageRatio * maxCoverage) or
+             (totalCoverage == perfectCoverage) ) {
+          ++sameTxpCount;
+          numConcordant += concordantSearch ? 1 : 0;
+          jointMemsList.emplace_back(tid, lclust, rclust, fragmentLen);
+          uint32_t currCoverage = jointMemsList.back().coverage();
+          if (maxCoverage < currCoverage) {
+            maxCoverage = currCoverage;
+            hadBestPair = true;
+            bestPairLeftCov = lclust->coverage;
+            bestPairRightCov = rclust->coverage;
+          }
+        }
+      }
+    };
+
+    // Concordant search.  Any pair passing the fragment length filter has its
+    // first reference positions within maxFragmentLength of each other, so
+    // with both ends' clusters ordered by firstRefPos() the candidate partners
+    // of each left cluster form a window that a two-pointer sweep maintains.
+    // Candidate pairs are then evaluated in the original (left, right) order.
+    struct JoinScratch {
+      std::vector<std::pair<int64_t, uint32_t>> lorder, rorder;
+      std::vector<uint64_t> candidates;
+    };
+    static thread_local JoinScratch scratch;
+    auto& lorder = scratch.lorder;
+    auto& rorder = scratch.rorder;
+    auto& candidates = scratch.candidates;
+    const int64_t maxFrag = static_cast<int64_t>(maxFragmentLength);
+    constexpr int64_t noPos = std::numeric_limits<int64_t>::max();
+
+    for (auto &leftClustItr : leftMemClusters) {
+      // reference id
+      size_t tid = leftClustItr.first;
+      // left mem clusters
+      auto &lClusts = *(leftClustItr.second);
+      updateMax(lClusts, maxLeft, maxLeftCnt);
+      // right mem clusters for the same reference id
+      auto* rClustsPtr = rightMemClusters.find_value(tid);
+      if (rClustsPtr == nullptr or rClustsPtr->empty()) { continue; }
+      auto &rClusts = *rClustsPtr;
+      updateMax(rClusts, maxRight, maxRightCnt);
+#if ALLOW_VERBOSE
+      std::cerr << "\ntid:" << tid << "\n";
+#endif // ALLOW_VERBOSE
+
+      // A dovetail is recorded for any oppositely oriented pair on this
+      // reference, whether or not it passes the fragment length filter; that
+      // only depends on the extreme read start positions of each orientation.
+      int64_t maxFwLeft{-noPos}, minRcLeft{noPos}, maxFwRight{-noPos}, minRcRight{noPos};
+      lorder.clear();
+      rorder.clear();
+      for (uint32_t i = 0; i < lClusts.size(); ++i) {
+        auto& c = lClusts[i];
+        lorder.emplace_back(c.firstRefPos(), i);
+        auto s = c.approxReadStartPos();
+        if (c.isFw) { maxFwLeft = std::max(maxFwLeft, s); } else { minRcLeft = std::min(minRcLeft, s); }
+      }
+      for (uint32_t i = 0; i < rClusts.size(); ++i) {
+        auto& c = rClusts[i];
+        rorder.emplace_back(c.firstRefPos(), i);
+        auto s = c.approxReadStartPos();
+        if (c.isFw) { maxFwRight = std::max(maxFwRight, s); } else { minRcRight = std::min(minRcRight, s); }
+      }
+      if ((static_cast<uint64_t>(tid) < firstDecoyIndex) and
+          ((minRcRight != noPos and maxFwLeft > minRcRight) or (minRcLeft != noPos and maxFwRight > minRcLeft))) {
+        hadDovetail = true;
+      }
+
+      std::sort(lorder.begin(), lorder.end());
+      std::sort(rorder.begin(), rorder.end());
+      candidates.clear();
+      size_t lo{0}, hi{0};
+      for (auto& lo_entry : lorder) {
+        int64_t lpos = lo_entry.first;
+        while (lo < rorder.size() and rorder[lo].first <= lpos - maxFrag) { ++lo; }
+        if (hi < lo) { hi = lo; }
+        while (hi < rorder.size() and rorder[hi].first < lpos + maxFrag) { ++hi; }
+        auto& lc = lClusts[lo_entry.second];
+        for (size_t j = lo; j < hi; ++j) {
+          if (lc.isFw != rClusts[rorder[j].second].isFw) {
+            candidates.push_back((static_cast<uint64_t>(lo_entry.second) << 32) | rorder[j].second);
+          }
+        }
+      }
+      std::sort(candidates.begin(), candidates.end());
+      for (auto c : candidates) {
+        tryPair(tid, lClusts.begin() + (c >> 32), rClusts.begin() + (c & 0xffffffff), true);
+      }
+    }
+    // right clusters on references the left end never hit
+    for (auto &rightClustItr : rightMemClusters) {
+      if (leftMemClusters.find_value(rightClustItr.first) == nullptr) {
+        updateMax(*(rightClustItr.second), maxRight, maxRightCnt);
+      }
     }
+    round++;
+
+    // Discordant search, only if no concordant pair was found; all pairs on
+    // a shared reference are eligible, so there is nothing to prune.
+    if (!jointMemsList.size() and !noDiscordant) {
+      for (auto &leftClustItr : leftMemClusters) {
+        size_t tid = leftClustItr.first;
+        auto &lClusts = *(leftClustItr.second);
+        auto* rClustsPtr = rightMemClusters.find_value(tid);
+        if (rClustsPtr == nullptr) { continue; }
+        auto &rClusts = *rClustsPtr;
+        for (auto lclust = lClusts.begin(); lclust != lClusts.end(); lclust++) {
+          for (auto rclust = rClusts.begin(); rclust != rClusts.end(); rclust++) {
+            tryPair(tid, lclust, rclust, false);
+          }
+        }
+      }
+      round++;
+    }
+
+    // The maximum coverage of a mem cluster for the left or right read
+    auto maxLeftOrRight = maxLeft > maxRight ? maxLeft : maxRight;
+    bool isMaxLeftAndRight = hadBestPair and
+      !((bestPairLeftCov < maxLeft) or (bestPairRightCov < maxRight));
     numDiscordant = sameTxpCount - numConcordant;
     (void) numDiscordant;
 
@@ -0,0 +1,108 @@
+// Maps read pairs through ReadBatchMapper and checks that the records it
+// gives back are the ones `pufferfish align` wrote for the same pairs:
+//
+//   pufferfish align -i <index> -1 <reads_1.fq> -2 <reads_2.fq> -o <align.sam>
+//   batch_mapper_test <index> <reads_1.fq> <reads_2.fq> <align.sam>
+//
+// align must run with its default mapping options on a dense index.  The
+// batch results go through the same SAM writer as align's, and the records
+// of every read are compared; returns 1 if any of them differ.
+
+#include "PufferfishIndex.hpp"
+#include "ReadBatchMapper.hpp"
+#include "SAMWriter.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool readFastq(const std::string& fname, std::vector<fastx_parser::ReadSeq>& reads) {
+  std::ifstream in(fname);
+  if (!in) { return false; }
+  std::string header, seq, plus, qual;
+  while (std::getline(in, header) and std::getline(in, seq) and std::getline(in, plus) and
+         std::getline(in, qual)) {
+    fastx_parser::ReadSeq r;
+    r.name = header.substr(1);
+    r.seq = seq;
+    reads.push_back(std::move(r));
+  }
+  return true;
+}
+
+// the records of each read, in the order they were written
+void addRecords(const std::string& text, std::map<std::string, std::string>& records) {
+  size_t b{0};
+  while (b < text.size()) {
+    size_t e = text.find('\n', b);
+    if (e == std::string::npos) { e = text.size(); }
+    if (text[b] != '@') {
+      std::string line = text.substr(b, e - b);
+      records[line.substr(0, line.find('\t'))] += line + '\n';
+    }
+    b = e + 1;
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 5) {
+    std::cerr << "usage: " << argv[0] << " <index> <reads_1.fq> <reads_2.fq> <align.sam>\n";
+    return 1;
+  }
+  std::vector<fastx_parser::ReadSeq> lefts, rights;
+  if (!readFastq(argv[2], lefts) or !readFastq(argv[3], rights) or lefts.size() != rights.size()) {
+    std::cerr << "could not read the pairs in " << argv[2] << " and " << argv[3] << "\n";
+    return 1;
+  }
+  std::vector<fastx_parser::ReadPair> pairs(lefts.size());
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    pairs[i].first = std::move(lefts[i]);
+    pairs[i].second = std::move(rights[i]);
+  }
+
+  PufferfishIndex index(argv[1]);
+  pufferfish::AlignmentOpts opts;
+  pufferfish::ReadBatchMapper<PufferfishIndex> mapper(index, opts);
+  auto mapped = mapper.mapBatch(pairs);
+
+  // as processReadsPair writes them
+  PairedAlignmentFormatter<PufferfishIndex*> formatter(&index);
+  fmt::MemoryWriter text;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    if (mapped[i].filtered) { continue; }
+    if (mapped[i].alignments.empty()) {
+      writeUnalignedPairToStream(pairs[i], text);
+    } else {
+      writeAlignmentsToStream(pairs[i], formatter, mapped[i].alignments, text, !opts.noOrphan);
+    }
+  }
+  std::map<std::string, std::string> batchRecords, alignRecords;
+  addRecords(text.str(), batchRecords);
+
+  std::ifstream samFile(argv[4]);
+  std::string samText((std::istreambuf_iterator<char>(samFile)), std::istreambuf_iterator<char>());
+  addRecords(samText, alignRecords);
+
+  size_t numDiffering{0};
+  for (auto& kv : alignRecords) {
+    auto it = batchRecords.find(kv.first);
+    if (it != batchRecords.end() and it->second == kv.second) { continue; }
+    if (++numDiffering <= 5) {
+      std::cerr << "align:\n" << kv.second << "mapBatch:\n"
+                << (it == batchRecords.end() ? std::string("(none)\n") : it->second);
+    }
+  }
+  for (auto& kv : batchRecords) {
+    if (alignRecords.find(kv.first) == alignRecords.end() and ++numDiffering <= 5) {
+      std::cerr << "only mapBatch reported " << kv.first << "\n";
+    }
+  }
+  std::cerr << numDiffering << " of " << alignRecords.size() << " reads have different records\n";
+  return numDiffering > 0 ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+// Checks the inter-sequence ksw2 extension kernel, which PuffAligner uses with
+// --batchAlignment, against the scalar ksw2 extension (ksw_extz) on the same
+// random queries and targets.  Every build of the kernel the CPU can run is
+// checked: SSE2, SSE4.1 and, when the library has one, AVX2.  Returns 1 if a
+// kernel's score for a target ever differs from ksw_extz's mqe.
+
+#include "ksw2pp/KSW2Aligner.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using BatchKernel = int (*)(void*, int, const uint8_t*, int, const int*, const uint8_t* const*, int8_t,
+                            const int8_t*, int8_t, int8_t, int, int*);
+
+struct Kernel {
+  std::string name;
+  BatchKernel fn;
+  bool supported;
+};
+
+struct Scoring {
+  int8_t match;
+  int8_t mismatch;
+  int8_t gapo;
+  int8_t gape;
+  int bandwidth;
+};
+
+// as KSW2Aligner builds it: N (code 4) scores 0 against everything
+std::vector<int8_t> scoreMatrix(int8_t match, int8_t mismatch) {
+  const int m = 5;
+  std::vector<int8_t> mat(m * m, 0);
+  for (int i = 0; i < m - 1; ++i) {
+    for (int j = 0; j < m - 1; ++j) { mat[i * m + j] = i == j ? match : mismatch; }
+  }
+  return mat;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  (void)argc;
+  (void)argv;
+  __builtin_cpu_init();
+  std::vector<Kernel> kernels{
+      {"SSE2", ksw_extz2_batch_sse2, static_cast<bool>(__builtin_cpu_supports("sse2"))},
+      {"SSE4.1", ksw_extz2_batch_sse41, static_cast<bool>(__builtin_cpu_supports("sse4.1"))},
+#ifdef KSW_HAVE_AVX2
+      {"AVX2", ksw_extz2_batch_avx2, static_cast<bool>(__builtin_cpu_supports("avx2"))},
+#endif
+  };
+  // the aligner defaults with its bandwidth of 15, a wider and a narrower band,
+  // and a scoring that takes the longer queries past the kernel's 16-bit limit
+  std::vector<Scoring> scorings{{2, -4, 5, 3, 15}, {2, -4, 5, 3, 40}, {1, -4, 6, 2, 3}, {40, -60, 60, 30, 15}};
+  std::mt19937 gen(17);
+  std::uniform_int_distribution<int> qlenDist(1, 160);
+  std::uniform_int_distribution<int> ntgtDist(1, 40);
+  std::uniform_int_distribution<int> baseDist(0, 3);
+  std::uniform_int_distribution<int> pctDist(0, 99);
+
+  void* km = km_init();
+  ksw_extz_t ez;
+  size_t numChecked{0}, numOverflows{0}, numFailed{0};
+  for (auto& sc : scorings) {
+    auto mat = scoreMatrix(sc.match, sc.mismatch);
+    for (size_t trial = 0; trial < 2000; ++trial) {
+      std::vector<uint8_t> query(qlenDist(gen));
+      for (auto& c : query) { c = (pctDist(gen) < 2) ? 4 : baseDist(gen); }
+      // targets near the query, so that matches, mismatches and gaps mix, of
+      // lengths on both sides of the query's and anything from one to a few
+      // vectors' worth of them
+      std::vector<std::vector<uint8_t>> targets(ntgtDist(gen));
+      for (auto& t : targets) {
+        int noise = pctDist(gen) % 30;
+        for (auto c : query) {
+          int p = pctDist(gen);
+          if (p < noise / 3) { continue; }
+          t.push_back((p < noise or c > 3) ? baseDist(gen) : c);
+          if (p >= 100 - noise / 3) { t.push_back(baseDist(gen)); }
+        }
+        int tail = pctDist(gen) % 20;
+        for (int k = 0; k < tail; ++k) { t.push_back(baseDist(gen)); }
+        if (t.empty()) { t.push_back(baseDist(gen)); }
+      }
+      std::vector<const uint8_t*> tptrs;
+      std::vector<int> tlens;
+      for (auto& t : targets) {
+        tptrs.push_back(t.data());
+        tlens.push_back(static_cast<int>(t.size()));
+      }
+
+      // ksw_extz writes past its row buffer once a target outruns the band
+      // (tlen > qlen + w); the rows it would see there cannot reach the end
+      // of the query anyway, so it gets the targets cut to that length
+      std::vector<int> expected;
+      for (auto& t : targets) {
+        int tlen = std::min<int>(t.size(), query.size() + sc.bandwidth);
+        ksw_extz(km, query.size(), query.data(), tlen, t.data(), 5, mat.data(), sc.gapo, sc.gape,
+                 sc.bandwidth, -1, KSW_EZ_SCORE_ONLY, &ez);
+        expected.push_back(ez.mqe);
+      }
+
+      for (auto& kernel : kernels) {
+        if (!kernel.supported) { continue; }
+        std::vector<int> mqe(targets.size());
+        int ret = kernel.fn(km, query.size(), query.data(), targets.size(), tlens.data(), tptrs.data(), 5,
+                            mat.data(), sc.gapo, sc.gape, sc.bandwidth, mqe.data());
+        if (ret != 0) {
+          // only allowed when the scores could leave the 16-bit lanes
+          long maxTlen = *std::max_element(tlens.begin(), tlens.end());
+          long bound = static_cast<long>(std::max<int>(sc.match, -sc.mismatch)) * query.size() + sc.gapo +
+                       static_cast<long>(sc.gape) * (query.size() + maxTlen);
+          if (bound < 0x4000 and ++numFailed <= 10) {
+            std::cerr << kernel.name << " refused a batch whose scores fit (qlen = " << query.size() << ")\n";
+          }
+          ++numOverflows;
+          continue;
+        }
+        for (size_t k = 0; k < targets.size(); ++k) {
+          ++numChecked;
+          if (mqe[k] != expected[k] and ++numFailed <= 10) {
+            std::cerr << kernel.name << " score " << mqe[k] << " != ksw_extz mqe " << expected[k]
+                      << " (qlen = " << query.size() << ", tlen = " << tlens[k] << ", w = " << sc.bandwidth
+                      << ", target " << k << " of " << targets.size() << ")\n";
+          }
+        }
+      }
+    }
+  }
+  km_destroy(km);
+
+  std::cerr << "kernels checked:";
+  for (auto& kernel : kernels) { std::cerr << " " << kernel.name << (kernel.supported ? "" : " (not on this CPU)"); }
+  std::cerr << "\n" << numChecked << " target scores compared, " << numOverflows << " batches beyond 16 bits, "
+            << numFailed << " mismatches\n";
+  return numFailed > 0 ? 1 : 0;
+}
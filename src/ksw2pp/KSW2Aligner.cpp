@@ -1,4 +1,5 @@
 #include "ksw2pp/KSW2Aligner.hpp"
+#include <cstring>
 #include <iostream>
 
 /*
@@ -48,11 +49,18 @@ int x86_simd(void)
 	if (cpuid[2]>>9 &1) flag |= SIMD_SSSE3;
 	if (cpuid[2]>>19&1) flag |= SIMD_SSE4_1;
 	if (cpuid[2]>>20&1) flag |= SIMD_SSE4_2;
-	if (cpuid[2]>>28&1) flag |= SIMD_AVX;
+	// the AVX bits are only usable if the OS saves the YMM state (OSXSAVE + XCR0)
+	bool ymmEnabled = false;
+	if (cpuid[2]>>27&1) {
+		uint32_t xcr0_lo, xcr0_hi;
+		asm volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+		ymmEnabled = (xcr0_lo & 0x6) == 0x6;
+	}
+	if (ymmEnabled && (cpuid[2]>>28&1)) flag |= SIMD_AVX;
 	if (max_id >= 7) {
 		__cpuidex(cpuid, 7, 0);
-		if (cpuid[1]>>5 &1) flag |= SIMD_AVX2;
-		if (cpuid[1]>>16&1) flag |= SIMD_AVX512F;
+		if (ymmEnabled && (cpuid[1]>>5 &1)) flag |= SIMD_AVX2;
+		if (ymmEnabled && (cpuid[1]>>16&1)) flag |= SIMD_AVX512F;
 	}
 	return flag;
 }
@@ -73,11 +81,13 @@ unsigned char seq_nt4_table_loc[256] = {
 
   KSW2Aligner::KSW2Aligner(int8_t match, int8_t mismatch) {
   unsigned int simd = x86_simd();
+  haveAVX2 = (simd & SIMD_AVX2);
   haveSSE41 = (simd & SIMD_SSE4_1);
   haveSSE2 = (simd & SIMD_SSE2);
   query_.clear();
   target_.clear();
   kalloc_allocator_.reset(km_init());
+  initExtz(&result_);
   int a = match;
   int b = mismatch;
   int m = 5;
@@ -98,14 +108,38 @@ unsigned char seq_nt4_table_loc[256] = {
 
 KSW2Aligner::KSW2Aligner(std::vector<int8_t> mat) {
   unsigned int simd = x86_simd();
+  haveAVX2 = (simd & SIMD_AVX2);
   haveSSE41 = (simd & SIMD_SSE4_1);
   haveSSE2 = (simd & SIMD_SSE2);
   query_.clear();
   target_.clear();
   kalloc_allocator_.reset(km_init());
+  initExtz(&result_);
   mat_ = mat;
 }
 
+void KSW2Aligner::initExtz(ksw_extz_t* ez, int cigarCapacity) {
+  std::memset(ez, 0, sizeof(ksw_extz_t));
+  ksw_reset_extz(ez);
+  if (cigarCapacity > 0) {
+    ez->cigar = static_cast<uint32_t*>(
+        kmalloc(kalloc_allocator_.get(), cigarCapacity * sizeof(uint32_t)));
+    ez->m_cigar = cigarCapacity;
+  }
+}
+
+KSW2WorkspaceStats KSW2Aligner::workspaceStats() const {
+  km_stat_t s;
+  km_getstat(kalloc_allocator_.get(), &s);
+  KSW2WorkspaceStats stats;
+  stats.capacity = s.capacity;
+  stats.available = s.available;
+  stats.largestFree = s.largest;
+  stats.numCores = s.n_cores;
+  stats.numGrowths = s.n_cores > 0 ? s.n_cores - 1 : 0;
+  return stats;
+}
+
 /**
  * from https://github.com/rob-p/edlib/blob/read-aligner/edlib/src/edlib.cpp
  * Takes char query and char target, recognizes alphabet and transforms them
@@ -248,6 +282,8 @@ int KSW2Aligner::operator()(const char* const queryOriginal,
                             const int targetLength) {
   int ret{0};
   switch (config_.atype) {
+  // a batch of one target is an ordinary extension
+  case KSW2AlignmentType::BATCH_EXTENSION:
   case KSW2AlignmentType::EXTENSION:
     ret = this->operator()(queryOriginal, queryLength, targetOriginal,
                            targetLength, &result_,
@@ -329,6 +365,8 @@ int KSW2Aligner::operator()(const uint8_t* const query_, const int queryLength,
                             const int targetLength) {
   int ret{0};
   switch (config_.atype) {
+  // a batch of one target is an ordinary extension
+  case KSW2AlignmentType::BATCH_EXTENSION:
   case KSW2AlignmentType::EXTENSION:
     ret = this->operator()(query_, queryLength, target_, targetLength, &result_,
                            EnumToType<KSW2AlignmentType::EXTENSION>());
@@ -365,6 +403,37 @@ int KSW2Aligner::operator()(const uint8_t* const query_, const int queryLength,
   return ez->score;
 }
 
+bool KSW2Aligner::operator()(const uint8_t* const query, const int queryLength,
+                             const uint8_t* const* targets,
+                             const int* targetLengths, const int numTargets,
+                             int* mqe,
+                             EnumToType<KSW2AlignmentType::BATCH_EXTENSION>) {
+  int8_t q = config_.gapo;
+  int8_t e = config_.gape;
+  int w = config_.bandwidth;
+  int ret{0};
+#ifdef KSW_HAVE_AVX2
+  if (haveAVX2) {
+    ret = ksw_extz2_batch_avx2(kalloc_allocator_.get(), queryLength, query,
+                               numTargets, targetLengths, targets,
+                               config_.alphabetSize, mat_.data(), q, e, w, mqe);
+    return ret == 0;
+  }
+#endif
+  if (haveSSE41) {
+    ret = ksw_extz2_batch_sse41(kalloc_allocator_.get(), queryLength, query,
+                                numTargets, targetLengths, targets,
+                                config_.alphabetSize, mat_.data(), q, e, w, mqe);
+  } else if (haveSSE2) {
+    ret = ksw_extz2_batch_sse2(kalloc_allocator_.get(), queryLength, query,
+                               numTargets, targetLengths, targets,
+                               config_.alphabetSize, mat_.data(), q, e, w, mqe);
+  } else {
+    std::abort();
+  }
+  return ret == 0;
+}
+
 int KSW2Aligner::operator()(const uint8_t* const query_, const int queryLength,
                             const uint8_t* const target_,
                             const int targetLength,
@@ -24,7 +24,7 @@ typedef struct _allocated_t {
 typedef struct {
 	size_t base[2], *loop_head;
 	allocated_t list_head, *list_tail;
-	size_t total_allocated;
+	size_t total_allocated, n_cores;
 } kmem_t;
 
 void *km_init()
@@ -56,6 +56,7 @@ static size_t *morecore(kmem_t *km, size_t nu)
 	km->list_tail = km->list_tail->next;
 
 	km->total_allocated += rnu * sizeof(size_t);
+	++km->n_cores;
 	*up = rnu; /* the size of the current block, and in this case the block is the same as the new core */
 	kfree(km, up + 1); /* initialize the new "core" */
 	return km->loop_head;
@@ -188,27 +189,34 @@ void *kcalloc(void *_km, size_t count, size_t size)
 	return p;
 }
 
-void km_stat(const void *_km)
+void km_getstat(const void *_km, km_stat_t *s)
 {
 	kmem_t *km = (kmem_t*)_km;
-	unsigned n_blocks, n_units;
-	size_t max_block = 0, *p, *q;
-	float frag;
+	size_t *p, *q;
 
-	if (km == 0 || !(p = km->loop_head)) return;
-	n_blocks = n_units = 0;
+	memset(s, 0, sizeof(km_stat_t));
+	if (km == 0) return;
+	s->capacity = km->total_allocated;
+	s->n_cores = km->n_cores;
+	if (!(p = km->loop_head)) return;
 	do {
 		q = PTR(p);
-		if (*p > max_block) max_block = *p;
-		n_units += *p;
+		if (*p * sizeof(size_t) > s->largest) s->largest = *p * sizeof(size_t);
+		s->available += *p * sizeof(size_t);
 		if (p + (*p) > q && q > p)
-			kerror("[kr_stat] The end of a free block enters another free block.");
+			kerror("[km_getstat] The end of a free block enters another free block.");
 		p = q;
-		++n_blocks;
+		++s->n_blocks;
 	} while (p != km->loop_head);
-	
-	--n_blocks;
-	frag = 1.0/1024.0 * n_units * sizeof(size_t) / n_blocks;
-	fprintf(stderr, "[kr_stat] tot=%lu, free=%lu, n_block=%u, max_block=%lu, frag_len=%.3fK\n",
-			km->total_allocated, n_units * sizeof(size_t), n_blocks, max_block * sizeof(size_t), frag);
+	--s->n_blocks; /* the sentinel in km->base */
+}
+
+void km_stat(const void *_km)
+{
+	km_stat_t s;
+	km_getstat(_km, &s);
+	if (s.n_blocks == 0) return;
+	fprintf(stderr, "[km_stat] tot=%lu, free=%lu, n_block=%lu, n_core=%lu, max_block=%lu, frag_len=%.3fK\n",
+			(unsigned long)s.capacity, (unsigned long)s.available, (unsigned long)s.n_blocks, (unsigned long)s.n_cores,
+			(unsigned long)s.largest, 1.0/1024.0 * s.available / s.n_blocks);
 }
@@ -0,0 +1,174 @@
+#include <string.h>
+#include "ksw2pp/ksw2.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#ifdef KSW_SSE2_ONLY
+#undef __SSE4_1__
+#endif
+
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+typedef __m256i kvec_t;
+#define KVEC_LANES 16
+#define kv_set1(x)       _mm256_set1_epi16(x)
+#define kv_zero()        _mm256_setzero_si256()
+#define kv_load(p)       _mm256_load_si256(p)
+#define kv_loadu(p)      _mm256_loadu_si256((const __m256i*)(p))
+#define kv_store(p, a)   _mm256_store_si256((p), (a))
+#define kv_storeu(p, a)  _mm256_storeu_si256((__m256i*)(p), (a))
+#define kv_cmpeq(a, b)   _mm256_cmpeq_epi16((a), (b))
+#define kv_cmpgt(a, b)   _mm256_cmpgt_epi16((a), (b))
+#define kv_max(a, b)     _mm256_max_epi16((a), (b))
+#define kv_adds(a, b)    _mm256_adds_epi16((a), (b))
+#define kv_subs(a, b)    _mm256_subs_epi16((a), (b))
+#define kv_blend(a, b, mask) _mm256_blendv_epi8((a), (b), (mask))
+#else
+typedef __m128i kvec_t;
+#define KVEC_LANES 8
+#define kv_set1(x)       _mm_set1_epi16(x)
+#define kv_zero()        _mm_setzero_si128()
+#define kv_load(p)       _mm_load_si128(p)
+#define kv_loadu(p)      _mm_loadu_si128((const __m128i*)(p))
+#define kv_store(p, a)   _mm_store_si128((p), (a))
+#define kv_storeu(p, a)  _mm_storeu_si128((__m128i*)(p), (a))
+#define kv_cmpeq(a, b)   _mm_cmpeq_epi16((a), (b))
+#define kv_cmpgt(a, b)   _mm_cmpgt_epi16((a), (b))
+#define kv_max(a, b)     _mm_max_epi16((a), (b))
+#define kv_adds(a, b)    _mm_adds_epi16((a), (b))
+#define kv_subs(a, b)    _mm_subs_epi16((a), (b))
+#ifdef __SSE4_1__
+#define kv_blend(a, b, mask) _mm_blendv_epi8((a), (b), (mask))
+#else
+#define kv_blend(a, b, mask) _mm_or_si128(_mm_andnot_si128((mask), (a)), _mm_and_si128((mask), (b)))
+#endif
+#endif
+
+/*
+ * Inter-sequence extension: one query against many targets, one target per
+ * 16-bit lane (eight per vector with SSE, sixteen with AVX2).  The DP is the plain banded recurrence
+ * (cells with |t-i| <= w) rather than the anti-diagonal difference
+ * recurrence of ksw_extz2_sse(); the two agree on mqe away from the lower
+ * band edge, i.e. whenever tlen > qlen - w.  Score only, no Z-drop.
+ */
+#ifdef KSW_CPU_DISPATCH
+#if defined(__AVX2__)
+int ksw_extz2_batch_avx2(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat, int8_t q, int8_t e, int w, int *mqe)
+#elif defined(__SSE4_1__)
+int ksw_extz2_batch_sse41(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat, int8_t q, int8_t e, int w, int *mqe)
+#else
+int ksw_extz2_batch_sse2(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat, int8_t q, int8_t e, int w, int *mqe)
+#endif
+#else
+int ksw_extz2_batch_sse(void *km, int qlen, const uint8_t *query, int n_tgt, const int *tlens, const uint8_t *const *targets, int8_t m, const int8_t *mat, int8_t q, int8_t e, int w, int *mqe)
+#endif // ~KSW_CPU_DISPATCH
+{
+	enum { L = KVEC_LANES };
+	int b, i, j, k, max_tlen = 0, max_sc;
+	const int16_t neg = -0x8000;
+	kvec_t neg_, qe_, e_, sc_mch_, sc_mis_, sc_N_, m1_;
+	kvec_t *tgt, *H0, *H1, *E, *mem;
+
+	for (k = 0; k < n_tgt; ++k) mqe[k] = KSW_NEG_INF;
+	if (m <= 1 || qlen <= 0 || n_tgt <= 0) return 0;
+	for (k = 0; k < n_tgt; ++k) max_tlen = max_tlen > tlens[k]? max_tlen : tlens[k];
+	if (max_tlen <= 0) return 0;
+	// every reachable score must stay clear of the saturation value
+	max_sc = mat[0] > -mat[1]? mat[0] : -mat[1];
+	if ((long)max_sc * qlen + q + (long)e * (qlen + max_tlen) >= 0x4000) return -1;
+
+	neg_    = kv_set1(neg);
+	qe_     = kv_set1(q + e);
+	e_      = kv_set1(e);
+	sc_mch_ = kv_set1(mat[0]);
+	sc_mis_ = kv_set1(mat[1]);
+	sc_N_   = kv_set1(mat[m*m-1]);
+	m1_     = kv_set1(m - 1); // wildcard
+
+	mem = (kvec_t*)kmalloc(km, ((size_t)max_tlen * 4 + 4) * sizeof(kvec_t) + sizeof(kvec_t) - 1);
+	tgt = (kvec_t*)(((size_t)mem + sizeof(kvec_t) - 1) / sizeof(kvec_t) * sizeof(kvec_t)); // vector aligned
+	H0 = tgt + max_tlen, H1 = H0 + max_tlen + 1, E = H1 + max_tlen + 1;
+
+	for (b = 0; b < n_tgt; b += L) {
+		int nb = n_tgt - b < L? n_tgt - b : L, tlen = 0;
+		int16_t tl[L];
+		kvec_t tl_, best_, *Hp = H0, *Hc = H1;
+		for (k = 0; k < L; ++k) {
+			tl[k] = k < nb? tlens[b + k] : 0;
+			tlen = tlen > tl[k]? tlen : tl[k];
+		}
+		if (tlen <= 0) continue;
+		tl_ = kv_loadu(tl);
+		// transpose the targets into lanes; padding is never counted in mqe
+		for (j = 0; j < tlen; ++j) {
+			int16_t col[L];
+			for (k = 0; k < L; ++k) col[k] = j < tl[k]? targets[b + k][j] : m - 1;
+			kv_store(&tgt[j], kv_loadu(col));
+		}
+		// row 0: a leading deletion of length j
+		for (j = 0; j <= tlen; ++j) {
+			Hp[j] = Hc[j] = E[j] = neg_;
+			if (j == 0) Hp[j] = kv_zero();
+			else if (w < 0 || j <= w) Hp[j] = kv_set1(-(q + e * j));
+		}
+		best_ = neg_;
+		for (i = 1; i <= qlen; ++i) {
+			int lo = 1, hi = tlen, qc = query[i - 1];
+			kvec_t f_, qc_ = kv_set1(qc), *tmp;
+			if (w >= 0) {
+				lo = i - w > 1? i - w : 1;
+				hi = i + w < tlen? i + w : tlen;
+			}
+			if (lo > hi) break;
+			// column 0: a leading insertion of length i
+			Hc[lo - 1] = (lo == 1 && (w < 0 || i <= w))? kv_set1(-(q + e * i)) : neg_;
+			f_ = neg_;
+			for (j = lo; j <= hi; ++j) {
+				kvec_t s, t, h, ej, eq, nm;
+				t = kv_load(&tgt[j - 1]);
+				eq = kv_cmpeq(t, qc_);
+				s = kv_blend(sc_mis_, sc_mch_, eq);
+				nm = qc == m - 1? kv_set1(-1) : kv_cmpeq(t, m1_);
+				s = kv_blend(s, sc_N_, nm);
+				ej = kv_max(kv_subs(kv_load(&E[j]), e_), kv_subs(kv_load(&Hp[j]), qe_));
+				kv_store(&E[j], ej);
+				f_ = kv_max(kv_subs(f_, e_), kv_subs(kv_load(&Hc[j - 1]), qe_));
+				h = kv_adds(kv_load(&Hp[j - 1]), s);
+				h = kv_max(h, kv_max(ej, f_));
+				kv_store(&Hc[j], h);
+				if (i == qlen) { // only columns inside each lane's target count
+					kvec_t in = kv_cmpgt(tl_, kv_set1(j - 1));
+					best_ = kv_max(best_, kv_blend(neg_, h, in));
+				}
+			}
+			tmp = Hp, Hp = Hc, Hc = tmp;
+		}
+		{
+			int16_t out[L];
+			kv_storeu(out, best_);
+			for (k = 0; k < nb; ++k)
+				if (out[k] != neg) mqe[b + k] = out[k];
+		}
+	}
+	kfree(km, mem);
+	return 0;
+}
+#undef kv_set1
+#undef kv_zero
+#undef kv_load
+#undef kv_loadu
+#undef kv_store
+#undef kv_storeu
+#undef kv_cmpeq
+#undef kv_cmpgt
+#undef kv_max
+#undef kv_adds
+#undef kv_subs
+#undef kv_blend
+#undef KVEC_LANES
+#endif // __SSE2__
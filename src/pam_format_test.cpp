@@ -0,0 +1,160 @@
+// Writes random PAM v2 files with PAMWriter and reads them back through PAMReader:
+// the header, the trailer and block index, and every block's columns.  Returns 1
+// if anything read back differs from what was written.
+
+#include "PuffMappingReader.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Mapping {
+  uint32_t refId;
+  pam::MappedEnd ends[2];
+  std::vector<std::pair<uint32_t, uint32_t>> intervals;
+};
+
+struct Read {
+  std::string name;
+  uint32_t lens[2];
+  std::vector<Mapping> mappings;
+};
+
+size_t numFailed{0};
+
+void check(bool ok, const std::string& what) {
+  if (!ok and ++numFailed <= 10) { std::cerr << what << " differs\n"; }
+}
+
+std::vector<Read> randomReads(std::mt19937& gen, size_t n, bool isPaired, uint32_t numRefs, bool intScores) {
+  std::uniform_int_distribution<uint32_t> small(0, 4);
+  std::uniform_int_distribution<uint32_t> big(0, 1u << 30);
+  std::uniform_int_distribution<int> coin(0, 1);
+  std::vector<Read> reads(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto& r = reads[i];
+    r.name = "read" + std::to_string(i) + std::string(small(gen), 'x');
+    r.lens[0] = 50 + small(gen);
+    r.lens[1] = isPaired ? 50 + small(gen) : 0;
+    r.mappings.resize(small(gen));
+    for (auto& m : r.mappings) {
+      m.refId = big(gen) % numRefs;
+      for (uint32_t e = 0; e < (isPaired ? 2u : 1u); ++e) {
+        auto& end = m.ends[e];
+        // keep at least one end of a mapping
+        end.available = e == 0 or coin(gen);
+        if (!end.available) { continue; }
+        end.numIntervals = small(gen);
+        end.score = intScores ? static_cast<double>(big(gen)) - (1 << 29) : big(gen) / 7.0;
+        end.pos = big(gen);
+        end.fw = coin(gen);
+        for (uint32_t k = 0; k < end.numIntervals; ++k) { m.intervals.emplace_back(big(gen), small(gen)); }
+      }
+    }
+  }
+  return reads;
+}
+
+void roundTrip(std::mt19937& gen, bool isPaired, bool intScores, const std::string& fname) {
+  std::vector<std::string> refNames{"chr1", "chr2", "a_much_longer_reference_name", "r"};
+  std::vector<uint32_t> refLengths{1000, 1u << 31, 7, 300};
+  uint32_t ends = isPaired ? 2 : 1;
+  std::vector<std::vector<Read>> blocks;
+  {
+    std::ofstream out(fname, std::ios::binary);
+    pam::PAMWriter writer(out, isPaired, true, refNames, refLengths);
+    pam::PAMBlockBuilder builder(isPaired, true);
+    std::vector<uint8_t> scratch;
+    for (size_t b = 0; b < 5; ++b) {
+      blocks.push_back(randomReads(gen, b == 4 ? 1 : 300 + 50 * b, isPaired, refNames.size(), intScores));
+      for (auto& r : blocks.back()) {
+        builder.beginRead(r.name, r.mappings.size(), r.lens[0], r.lens[1]);
+        for (auto& m : r.mappings) {
+          builder.addMapping(m.refId, m.ends[0], m.ends[1]);
+          for (auto& iv : m.intervals) { builder.addInterval(iv.first, iv.second); }
+        }
+      }
+      writer.writeBlock(builder, scratch);
+    }
+    writer.close();
+  }
+
+  auto logger = spdlog::stderr_logger_mt(fname);
+  PAMReader reader(fname, logger);
+  std::string tag = fname + ": ";
+  check(reader.version == 2, tag + "version");
+  check(reader.isPaired == isPaired and reader.hasIntervals, tag + "header flags");
+  check(reader.refNames == refNames, tag + "reference names");
+  check(std::vector<uint32_t>(reader.refLengths.begin(), reader.refLengths.end()) == refLengths,
+        tag + "reference lengths");
+  check(reader.blockOffsets.size() == blocks.size(), tag + "index size");
+
+  std::mutex iomutex;
+  Chunk chunk;
+  pam::PAMBlock block;
+  for (size_t b = 0; b < blocks.size() and b < reader.blockOffsets.size(); ++b) {
+    auto& reads = blocks[b];
+    std::string btag = tag + "block " + std::to_string(b) + " ";
+    check(reader.blockReads[b] == reads.size(), btag + "index read count");
+    if (!reader.readBlock(b, chunk, iomutex)) {
+      check(false, btag + "read");
+      continue;
+    }
+    block.decode(reinterpret_cast<const uint8_t*>(chunk.chunk_.data()), chunk.size(), isPaired);
+    check(block.numReads == reads.size(), btag + "read count");
+    if (block.numReads != reads.size()) { continue; }
+
+    size_t mapping{0}, mappedEnd{0};
+    const uint8_t* iv = block.intervals;
+    const uint8_t* ivEnd = block.intervals + block.intervalsSize;
+    for (size_t i = 0; i < reads.size(); ++i) {
+      auto& r = reads[i];
+      check(block.names.substr(block.nameOffsets[i], block.nameOffsets[i + 1] - block.nameOffsets[i]) == r.name,
+            btag + "name");
+      check(block.mappingCounts[i] == r.mappings.size(), btag + "mapping count");
+      check(block.readLens[i * ends] == r.lens[0] and (!isPaired or block.readLens[i * ends + 1] == r.lens[1]),
+            btag + "read length");
+      for (auto& m : r.mappings) {
+        check(block.refIds[mapping] == m.refId, btag + "ref id");
+        for (uint32_t e = 0; e < ends; ++e) {
+          auto& end = m.ends[e];
+          uint32_t cnt = block.intervalCounts[mapping * ends + e];
+          check(cnt == (end.available ? end.numIntervals + 1 : 0), btag + "interval count");
+          if (!end.available) { continue; }
+          check(block.scores[mappedEnd] == end.score, btag + "score");
+          check(block.positions[mappedEnd] == end.pos and (block.fw[mappedEnd] != 0) == end.fw, btag + "position");
+          ++mappedEnd;
+        }
+        for (auto& expected : m.intervals) {
+          uint64_t rpos = pam::getVarint(iv, ivEnd);
+          uint64_t len = pam::getVarint(iv, ivEnd);
+          check(rpos == expected.first and len == expected.second, btag + "interval");
+        }
+        ++mapping;
+      }
+    }
+    check(mapping == block.numMappings and mappedEnd == block.scores.size(), btag + "mapping total");
+    check(iv == ivEnd, btag + "interval column length");
+  }
+  // the blocks end where the index begins
+  check(reader.dataEnd == reader.nextBlock, tag + "index offset");
+  std::remove(fname.c_str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  (void)argc;
+  (void)argv;
+  std::mt19937 gen(7);
+  roundTrip(gen, true, true, "pam_format_test.pe.int");
+  roundTrip(gen, true, false, "pam_format_test.pe.dbl");
+  roundTrip(gen, false, true, "pam_format_test.se.int");
+  roundTrip(gen, false, false, "pam_format_test.se.dbl");
+  std::cerr << numFailed << " mismatches in the PAM v2 round trip\n";
+  return numFailed > 0 ? 1 : 0;
+}
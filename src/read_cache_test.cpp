@@ -0,0 +1,103 @@
+// Maps a set of read pairs in which every pair occurs twice, once without the
+// read cache and once with --readCacheSize, and checks that both give the
+// same SAM records and that the second run did answer pairs from the cache:
+//
+//   read_cache_test <index> <reads_1.fq> <reads_2.fq>
+//
+// The index must be dense.  Returns 1 if the records differ or the cache
+// was never hit.
+
+#include "PufferfishIndex.hpp"
+#include "ReadBatchMapper.hpp"
+#include "SAMWriter.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool readFastq(const std::string& fname, std::vector<fastx_parser::ReadSeq>& reads) {
+  std::ifstream in(fname);
+  if (!in) { return false; }
+  std::string header, seq, plus, qual;
+  while (std::getline(in, header) and std::getline(in, seq) and std::getline(in, plus) and
+         std::getline(in, qual)) {
+    fastx_parser::ReadSeq r;
+    r.name = header.substr(1);
+    r.seq = seq;
+    reads.push_back(std::move(r));
+  }
+  return true;
+}
+
+// The SAM records of the pairs, as processReadsPair writes them; cacheHits
+// gets the number of pairs answered from the read cache
+std::string mapToSam(PufferfishIndex& index, std::vector<fastx_parser::ReadPair>& pairs,
+                     uint32_t readCacheSize, uint64_t& cacheHits) {
+  pufferfish::AlignmentOpts opts;
+  opts.readCacheSize = readCacheSize;
+  pufferfish::ReadBatchMapper<PufferfishIndex> mapper(index, opts);
+  auto mapped = mapper.mapBatch(pairs);
+  cacheHits = mapper.counters().readCacheHits;
+
+  PairedAlignmentFormatter<PufferfishIndex*> formatter(&index);
+  fmt::MemoryWriter text;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    if (mapped[i].filtered) { continue; }
+    if (mapped[i].alignments.empty()) {
+      writeUnalignedPairToStream(pairs[i], text);
+    } else {
+      writeAlignmentsToStream(pairs[i], formatter, mapped[i].alignments, text, !opts.noOrphan);
+    }
+  }
+  return text.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 4) {
+    std::cerr << "usage: " << argv[0] << " <index> <reads_1.fq> <reads_2.fq>\n";
+    return 1;
+  }
+  std::vector<fastx_parser::ReadSeq> lefts, rights;
+  if (!readFastq(argv[2], lefts) or !readFastq(argv[3], rights) or lefts.size() != rights.size()) {
+    std::cerr << "could not read the pairs in " << argv[2] << " and " << argv[3] << "\n";
+    return 1;
+  }
+  // every pair, then every pair again in reverse order, so that the copies
+  // are anywhere from next to each other to a whole set apart
+  size_t n = lefts.size();
+  std::vector<fastx_parser::ReadPair> pairs(2 * n);
+  for (size_t i = 0; i < n; ++i) {
+    pairs[i].first = lefts[i];
+    pairs[i].second = rights[i];
+    pairs[2 * n - 1 - i].first = lefts[i];
+    pairs[2 * n - 1 - i].second = rights[i];
+  }
+
+  PufferfishIndex index(argv[1]);
+  uint64_t uncachedHits{0}, cachedHits{0};
+  auto uncached = mapToSam(index, pairs, 0, uncachedHits);
+  auto cached = mapToSam(index, pairs, static_cast<uint32_t>(pairs.size()), cachedHits);
+
+  bool ok{true};
+  if (cached != uncached) {
+    size_t b{0};
+    while (b < cached.size() and b < uncached.size() and cached[b] == uncached[b]) { ++b; }
+    b = uncached.rfind('\n', b) == std::string::npos ? 0 : uncached.rfind('\n', b) + 1;
+    std::cerr << "the records differ from:\nwithout the cache:\n"
+              << uncached.substr(b, uncached.find('\n', b) - b) << "\nwith the cache:\n"
+              << cached.substr(b, cached.find('\n', b) - b) << "\n";
+    ok = false;
+  }
+  if (cachedHits < n) {
+    std::cerr << "only " << cachedHits << " of the " << n << " repeated pairs came from the read cache\n";
+    ok = false;
+  }
+  std::cerr << pairs.size() << " pairs, " << cachedHits << " answered from the read cache; "
+            << (ok ? "same records with and without it\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
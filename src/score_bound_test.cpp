@@ -0,0 +1,89 @@
+// Checks score_bound::globalScoreBound, which PuffAligner uses to skip ksw2 for the
+// windows between MEMs, against the global ksw2 score of random read pieces and
+// reference windows.  Returns 1 if the bound is ever below the ksw2 score.
+
+#include "ScoreBound.hpp"
+#include "ksw2pp/KSW2Aligner.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+// N (code 4) matches nothing, as in PuffAligner::lcsLength
+int64_t lcsLength(const std::vector<uint8_t>& s, const std::vector<uint8_t>& t) {
+  std::vector<std::vector<int64_t>> d(s.size() + 1, std::vector<int64_t>(t.size() + 1, 0));
+  for (size_t i = 1; i <= s.size(); ++i) {
+    for (size_t j = 1; j <= t.size(); ++j) {
+      bool match = s[i - 1] < 4 and s[i - 1] == t[j - 1];
+      d[i][j] = std::max({d[i - 1][j], d[i][j - 1], d[i - 1][j - 1] + (match ? 1 : 0)});
+    }
+  }
+  return d[s.size()][t.size()];
+}
+
+struct Scoring {
+  int8_t match;
+  int8_t mismatch;
+  int8_t gapo;
+  int8_t gape;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  (void)argc;
+  (void)argv;
+  // the aligner defaults, and mismatch penalties above twice the gap extension
+  // penalty, where the cheapest pairing of unmatched bases depends on the Ns
+  std::vector<Scoring> scorings{{2, -4, 5, 3}, {2, -4, 4, 1}, {2, -6, 5, 1}, {1, -4, 2, 1}};
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> lenDist(1, 14);
+  std::uniform_int_distribution<int> baseDist(0, 3);
+  std::uniform_int_distribution<int> pctDist(0, 99);
+
+  size_t numChecked{0};
+  size_t numFailed{0};
+  for (auto& sc : scorings) {
+    ksw2pp::KSW2Aligner aligner(sc.match, sc.mismatch);
+    ksw2pp::KSW2Config config;
+    config.gapo = sc.gapo;
+    config.gape = sc.gape;
+    config.bandwidth = -1;
+    config.flag = KSW_EZ_SCORE_ONLY;
+    aligner.config() = config;
+
+    for (size_t trial = 0; trial < 50000; ++trial) {
+      std::vector<uint8_t> piece(lenDist(gen));
+      for (auto& c : piece) { c = (pctDist(gen) < 15) ? 4 : baseDist(gen); }
+      // a reference window close to the piece, so that gaps and mismatches mix
+      std::vector<uint8_t> ref;
+      for (auto c : piece) {
+        int p = pctDist(gen);
+        if (p < 15) { continue; }
+        ref.push_back((p < 35 or c > 3) ? baseDist(gen) : c);
+        if (p >= 85) { ref.push_back(baseDist(gen)); }
+      }
+      if (ref.empty()) { ref.push_back(baseDist(gen)); }
+
+      int64_t m = piece.size(), n = ref.size();
+      int64_t ns = std::count(piece.begin(), piece.end(), 4);
+      int64_t ub = score_bound::globalScoreBound(sc.match, -sc.mismatch, sc.gapo, sc.gape,
+                                                 m, n, lcsLength(piece, ref), ns);
+      int score = aligner(piece.data(), m, ref.data(), n,
+                          ksw2pp::EnumToType<ksw2pp::KSW2AlignmentType::GLOBAL>());
+      ++numChecked;
+      if (ub < score) {
+        if (++numFailed <= 10) {
+          std::cerr << "bound " << ub << " < ksw2 score " << score << " (m = " << m
+                    << ", n = " << n << ", Ns = " << ns << ", mismatch = " << int(sc.mismatch)
+                    << ", gap extend = " << int(sc.gape) << ")\n";
+        }
+      }
+    }
+  }
+  std::cerr << numFailed << " of " << numChecked << " bounds were below the ksw2 score\n";
+  return numFailed > 0 ? 1 : 0;
+}